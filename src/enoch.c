@@ -23,6 +23,7 @@
 #include <argp.h>
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,7 +31,23 @@
 #include "./logging.h"
 #include "./px_common.h"
 #include "./px_crypto.h"
+#include "./px_batch.h"
 #include "./px_io.h"
+#include "./px_keyring.h"
+#include "./px_par.h"
+#include "./px_secmem.h"
+#include "./px_stats.h"
+#include "./px_trace.h"
+#include "./px_variant.h"
+
+/* Key stream letters per output block, a multiple of one line (40). */
+#define STRMBLK 4000
+
+/* Bytes per output block of --random. */
+#define RANDBLK 65536
+
+/* Passwords per batch of --gen-keys. */
+#define GENBATCH 4096
 
 int loglevel = LOGLEVEL_WRN;
 
@@ -40,16 +57,47 @@ int loglevel = LOGLEVEL_WRN;
 const char *argp_program_version = "1.0";
 const char *argp_program_bug_adrress = "<turysaz@posteo.org>";
 static char doc[] =
-    "Implementation of Bruce Schneier's solitaire/pontifex cryptosystem.";
-static char adoc[] = "";
+    "Implementation of Bruce Schneier's solitaire/pontifex cryptosystem."
+    "\vIf FILEs are given, each is encrypted to FILE.px, or decrypted"
+    " from FILE.px to FILE, in a batch.";
+static char adoc[] = "[FILE...]";
 
 static struct argp_option opts[] = {
     /* name      key      arg flags    doc                              group */
     /* Operation modes */
     { "encrypt", 'e',       0, 0, "Encrypt input. This is the default.",    0 },
     { "decrypt", 'd',       0, 0, "Decrypt input."                            },
-    { "stream",  's',     "N", 0, "Just print N keystream symbols."           },
+    {
+        "stream",
+        's',
+        "N",
+        0,
+        "Just print N keystream symbols, 0 for an endless key stream."
+    },
+    {
+        "random",
+        12,
+        "N",
+        0,
+        "Just print N pseudo-random bytes drawn from the key stream, 0 for"
+        " endless bytes."
+    },
     { "gen-key",  1 ,       0, 0, "Generate and print a passwd-based key."    },
+    {
+        "gen-keys",
+        7,
+        0,
+        0,
+        "Generate keys for the passwords from the input, one per line"
+        " (ID<TAB>PASSWD or PASSWD)."
+    },
+    {
+        "mk-keyring",
+        6,
+        0,
+        0,
+        "Convert PONTIFEX KEY blocks from the input into a keyring."
+    },
 
     /* I/O definition */
     { "input",   'i',  "FILE", 0, "Read input from FILE instead of stdin.", 1 },
@@ -59,6 +107,8 @@ static struct argp_option opts[] = {
     { "key",     'k',   "KEY", 0, "Define symmetric key.",                  2 },
     { "password",'p',"PASSWD", 0, "Use an alphabetic  passphrase"             },
     { "key-file",'f',  "FILE", 0, "Read key from FILE."                       },
+    { "keyring",  4 ,  "FILE", 0, "Read key from keyring FILE (with --key-id)" },
+    { "key-id",   5 ,    "ID", 0, "ID of the key in the keyring or key file"  },
     {
         "move-jokers",
         'j',
@@ -69,8 +119,75 @@ static struct argp_option opts[] = {
 
     /* behavior */
     { "raw",     'r',       0, 0, "Skip PONTIFEX MESSAGE frame. (-e / -d)", 3 },
+    {
+        "binary",
+        9,
+        0,
+        0,
+        "Transcode arbitrary bytes to letters before encryption and back"
+        " after decryption. (-e / -d)"
+    },
     { "verbose", 'v',       0, 0, "Increases verbosity (up to '-vv')"         },
     { "quiet",   'q',       0, 0, "Reduces all log output except errors"      },
+    {
+        "threads",
+        't',
+        "N",
+        0,
+        "Use N threads (-d, --gen-keys). Default: all CPUs"
+    },
+    {
+        "pipeline",
+        10,
+        0,
+        0,
+        "Generate the key stream of long messages on a second thread."
+        " (-e / -d)"
+    },
+    {
+        "segment",
+        11,
+        "N",
+        0,
+        "Split the message into segments of N letters, a multiple of 5,"
+        " that are encrypted in parallel with decks derived from the key."
+        " Framed messages record N for decryption. (-e / -d)"
+    },
+    {
+        "engine",
+        13,
+        "NAME",
+        0,
+        "Key stream engine: table (default), reference, branch-free, or"
+        " auto for the fastest on this machine. The engine is checked"
+        " against the test vectors before use."
+    },
+    {
+        "io-backend",
+        2,
+        "NAME",
+        0,
+        "I/O backend for FILEs: auto, uring or threads"
+    },
+    { "stats",    3 ,       0, 0, "Print run statistics as JSON to stderr"    },
+    {
+        "format",
+        8,
+        "NAME",
+        0,
+        "Cipher text and key stream format: text (default), cards, one"
+        " byte per letter with the values 1-26, or packed, 5 bits per"
+        " letter (-e / -d / -s)"
+    },
+    {
+        "deck",
+        14,
+        "NAME",
+        0,
+        "Deck of the cipher: std (default, 54 cards), small (28 cards) or"
+        " ext (82 cards, A-Z, 0-9 and . , ? -). Keys from -p or -k only."
+        " (-e / -d / -s / --gen-key)"
+    },
     { 0 }
 };
 
@@ -81,7 +198,10 @@ enum runmode {
     MD_ENCR, /* Encrypt message */
     MD_DECR, /* Decrypt message */
     MD_STRM, /* Print key stream */
-    MD_PKEY  /* Generate and print key */
+    MD_RAND, /* Print bytes from the key stream */
+    MD_PKEY, /* Generate and print key */
+    MD_GKEYS, /* Generate and print keys for many passwords */
+    MD_MKKR  /* Convert keys into a keyring */
 };
 
 /*
@@ -90,12 +210,24 @@ enum runmode {
  */
 struct runopts {
     enum runmode mode;
-    card key[54];
+    card *key; /* points into the secure arena, or to keymem */
+    card keymem[PX_MAXCARDS];
     FILE *input;
     FILE *output;
     char raw; /* bool flag: raw output */
+    char binary; /* bool flag: transcode bytes with px_b26enc() */
     char movjok; /* bool flag: move jokers on key generation */
-    int length; /* output length */
+    unsigned long length; /* key stream or byte count, 0 = unlimited */
+    int nthreads; /* number of worker threads, 0 = one per CPU */
+    unsigned int engine; /* PX_ENG_*, see px_opts */
+    char pipeline; /* bool flag: see px_opts */
+    unsigned long segment; /* letters per segment, 0 = no segments */
+    char **files; /* batch input files */
+    int nfiles;
+    int iobackend; /* PX_BIO_* */
+    int format; /* PXF_*, cipher text and key stream format */
+    struct px_stats *stats; /* run statistics, NULL if disabled */
+    const struct px_variant *variant; /* deck of --deck, NULL for std */
 };
 
 /*
@@ -108,6 +240,8 @@ struct cliargs {
     char *keyf;
     char *keystr;
     char *pw;
+    char *keyring;
+    char *keyid;
     struct runopts *options;
 };
 
@@ -118,25 +252,50 @@ struct runopts _defrunopts(void) {
     struct runopts options;
     int i;
 
+    options.key = NULL; /* set by _setkeymem() */
     options.mode = MD_ENCR;
     options.input = stdin;
     options.output = stdout;
     options.raw = 0;
+    options.binary = 0;
     options.movjok = 0;
     options.length = 5;
-
-    for (i = 0; i < sizeof(options.key); i++) {
-        options.key[i] = (char)i;
+    options.nthreads = 0;
+    options.engine = PX_ENG_TABLE;
+    options.pipeline = 0;
+    options.segment = 0;
+    options.files = NULL;
+    options.nfiles = 0;
+    options.iobackend = PX_BIO_AUTO;
+    options.format = PXF_TEXT;
+    options.stats = NULL;
+    options.variant = NULL;
+
+    for (i = 0; i < sizeof(options.keymem); i++) {
+        options.keymem[i] = (char)i;
     }
 
     return options;
 }
 
+/*
+ * Moves the key of a runopts struct into the secure arena, if possible.
+ */
+static void _setkeymem(struct runopts *opts) {
+    card *slot;
+
+    slot = px_smget();
+    if (slot) memcpy(slot, opts->keymem, sizeof(opts->keymem));
+    opts->key = slot ? slot : opts->keymem;
+}
+
 /*
  * Cleans and frees the content of a runopts struct.
  */
 static void _clrrunopts(struct runopts *opts) {
-    memset(opts->key, 0, 54); /* Clear key */
+    memset(opts->keymem, 0, sizeof(opts->keymem)); /* Clear key */
+    if (opts->key != opts->keymem) px_smput(opts->key);
+    opts->key = opts->keymem;
     if(opts->input != stdin) fclose(opts->input);
     if(opts->output != stdout) fclose(opts->output);
 }
@@ -158,6 +317,8 @@ static struct cliargs _defcliargs(struct runopts *options) {
     arguments.keyf = NULL;
     arguments.keystr = NULL;
     arguments.pw = NULL;
+    arguments.keyring = NULL;
+    arguments.keyid = NULL;
     arguments.options = options;
 
     return arguments;
@@ -193,6 +354,14 @@ static void _clrcliargs (struct cliargs *arg) {
         free(arg->keystr);
         arg->keystr = NULL;
     }
+    if (arg->keyring) {
+        free(arg->keyring);
+        arg->keyring = NULL;
+    }
+    if (arg->keyid) {
+        free(arg->keyid);
+        arg->keyid = NULL;
+    }
     if (arg->inputf) {
         free(arg->inputf);
         arg->inputf = NULL;
@@ -203,21 +372,46 @@ static void _clrcliargs (struct cliargs *arg) {
     }
 }
 
+/* Guards the run statistics against concurrent workers. */
+static pthread_mutex_t statslock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Adds the statistics of a worker to the run statistics.
+ */
+static void _addstats(struct runopts *args, const struct px_stats *st) {
+    pthread_mutex_lock(&statslock);
+    px_addstats(args->stats, st);
+    pthread_mutex_unlock(&statslock);
+}
+
+/*
+ * Adds the time since t to a phase of the run statistics, if enabled.
+ */
+static void _tick(struct runopts *args, const int phase, double *t) {
+    double now;
+
+    if (!args->stats) return;
+    now = px_now();
+    args->stats->time[phase] += now - *t;
+    *t = now;
+}
+
 /*
  * Returns the number of read chars, including the terminating NUL.
  */
 static int _readall(FILE *stream, char **content) {
     size_t bufsize = 1024,
            n = 0;
-    char c;
+    int c;
 
-    *content = malloc(bufsize * sizeof(char));
+    *content = px_malloc(bufsize * sizeof(char));
     if (!(*content)) goto err;
 
-    while ((c = fgetc(stream)) != '\0' && !feof(stream)) {
+    /* Binary cipher text formats may hold 0 bytes, so read up to EOF. */
+    while ((c = fgetc(stream)) != EOF) {
         (*content)[n++] = c;
         if (n == bufsize) {
-            *content = realloc(*content, (bufsize *=2) * sizeof(char));
+            *content = px_realloc(*content, (bufsize *=2) * sizeof(char));
             if (!*content) goto err;
         }
     }
@@ -225,48 +419,57 @@ static int _readall(FILE *stream, char **content) {
     /* empty input */
     if (!n) return 0;
 
-    *content = realloc(*content, n * sizeof(char));
+    *content = px_realloc(*content, (n + 1) * sizeof(char));
     if (!*content) goto err;
 
-    (*content)[n-1] = '\0';
+    (*content)[n] = '\0';
 
-    return n;
+    return n + 1;
 
 err:
     LOG_ERR(("Internal memory error!\n"));
-    if (*content) free(*content);
+    if (*content) px_free(*content);
     exit(ENOMEM);
 }
 
 /*
- * Prints the content of a zero-terminated buffer in groups of 5.
+ * Formats letters in groups of 5, with 8 groups per line. The letters
+ * start a new line, so pieces of a multiple of 40 letters continue the
+ * groups of the previous piece.
+ *
+ * \returns The number of chars written to out, at most 2 * n.
  */
-static void _outgrp(const char *buffer, FILE *stream) {
-    char c;
-    int i = 0;
-    while ((c = buffer[i++])) {
-        fputc(c, stream);
+static int _fmtgrp(const char *letters, const int n, char *out) {
+    int i, o = 0;
+
+    for (i = 1; i <= n; i++) {
+        out[o++] = letters[i - 1];
 
         /* Grouping an linebreaks */
         if (i % 40 == 0 ) {
-            fputc('\n', stream);
+            out[o++] = '\n';
         } else if (i % 5 == 0) {
-            fputc(' ', stream);
+            out[o++] = ' ';
         }
     }
 
-    fputc('\n', stream);
+    return o;
 }
 
 /*
  * Parses a key written as decimal numbers from a file
  * and saves it in the program args.
+ *
+ * If the file holds PONTIFEX KEY blocks, the one with the given ID
+ * is used. The ID may be NULL if there is only one block.
  */
-static int _readkey(card *key, char *filename) {
+static int _readkey(card *key, char *filename, const char *id) {
     FILE *kfile;
     char *buffer;
+    struct px_keyent *keys = NULL;
     int failure = 0,
-        nread = 0;
+        nread = 0,
+        nkeys, i;
 
     kfile = fopen(filename, "r");
     if (!kfile) {
@@ -283,7 +486,32 @@ static int _readkey(card *key, char *filename) {
 
     /* Note: the failure code may get overridden by the EIO
      * below. That's not nice, but accepted. */
-    failure = px_rdkey(buffer, key);
+    nkeys = px_rdkeys(buffer, nread - 1, &keys);
+    if (nkeys < 0) {
+        failure = EINVAL;
+    } else if (nkeys == 0) {
+        if (id) {
+            LOG_ERR(("--key-id needs PONTIFEX KEY blocks in the key file.\n"));
+            failure = EINVAL;
+        } else {
+            failure = px_rdkey(buffer, key);
+        }
+    } else {
+        for (i = 0; i < nkeys; i++) {
+            if (id ? !strcmp(keys[i].id, id) : nkeys == 1) break;
+        }
+        if (i < nkeys) {
+            memcpy(key, keys[i].deck, 54);
+        } else if (id) {
+            LOG_ERR(("No key '%s' in '%s'!\n", id, filename));
+            failure = ENOENT;
+        } else {
+            LOG_ERR(("'%s' holds several keys, use --key-id.\n", filename));
+            failure = EINVAL;
+        }
+        memset(keys, 0, nkeys * sizeof(*keys));
+        px_free(keys);
+    }
 
     if (fclose(kfile)) {
         LOG_ERR(("Could not close keyfile.\n"));
@@ -292,10 +520,275 @@ static int _readkey(card *key, char *filename) {
     }
 
 clean:
-    free(buffer);
+    px_free(buffer);
+    return failure;
+}
+
+/*
+ * Looks up a key in a keyring file and saves it in the program args.
+ */
+static int _readkeyring(card *key, const char *path, const char *id) {
+    struct px_keyring kr;
+    const card *found;
+    int failure = 0;
+
+    if (px_kropen(path, &kr)) return EIO;
+
+    found = px_krfind(&kr, id);
+    if (found) {
+        memcpy(key, found, 54);
+    } else {
+        LOG_ERR(("No valid key '%s' in keyring '%s'!\n", id, path));
+        failure = ENOENT;
+    }
+
+    px_krclose(&kr);
+    return failure;
+}
+
+/*
+ * Reads PONTIFEX KEY blocks from the input and writes them
+ * as a keyring to the output.
+ */
+static int _mkkeyring(struct runopts *args) {
+    char *text = NULL;
+    int ntext, n;
+
+    ntext = _readall(args->input, &text);
+    if (!ntext) {
+        LOG_ERR(("Empty input, abort.\n"));
+        return EINVAL;
+    }
+
+    n = px_krbuild(text, ntext - 1, args->output);
+    px_free(text);
+
+    if (n < 0) return EINVAL;
+    LOG_INF(("Wrote %i keys to the keyring.\n", n));
+    return 0;
+}
+
+/*
+ * Reads passwords from the input, one per line, and prints their
+ * keys as PONTIFEX KEY blocks. A line may start with an ID and a tab,
+ * otherwise the line number is used as ID. Empty lines are skipped.
+ * The passwords are read and their keys generated in batches of
+ * GENBATCH, so memory does not grow with the length of the list.
+ */
+static int _genkeys(struct runopts *args) {
+    char *text = NULL,
+         *pws[GENBATCH],
+         *tmp, *tab;
+    size_t offs[GENBATCH],
+           ntext,
+           captext = 0;
+    struct px_keyent *keys = NULL;
+    card *decks = NULL;
+    unsigned long line = 0;
+    int n, i, c = 0, len,
+        failure = 0;
+
+    keys = calloc(GENBATCH, sizeof(*keys));
+    decks = malloc(GENBATCH * 54);
+    if (!keys || !decks) {
+        LOG_ERR(("Internal memory error!\n"));
+        failure = ENOMEM;
+        goto clean;
+    }
+
+    while (c != EOF) {
+        /* the next batch of non-empty lines */
+        for (n = 0, ntext = 0; n < GENBATCH && c != EOF; ) {
+            offs[n] = ntext;
+            while ((c = getc(args->input)) != EOF && c != '\n') {
+                if (ntext + 1 >= captext) {
+                    captext = captext ? 2 * captext : 1024;
+                    tmp = px_realloc(text, captext);
+                    if (!tmp) {
+                        LOG_ERR(("Internal memory error!\n"));
+                        failure = ENOMEM;
+                        goto clean;
+                    }
+                    text = tmp;
+                }
+                text[ntext++] = c;
+            }
+            if (c == EOF && ntext == offs[n]) break;
+            line++;
+            if (ntext > offs[n] && text[ntext - 1] == '\r') ntext--;
+            if (ntext == offs[n]) continue; /* empty line */
+            text[ntext++] = '\0';
+
+            memset(keys[n].id, 0, sizeof(keys[n].id));
+            tab = memchr(text + offs[n], '\t', ntext - offs[n]);
+            if (tab) {
+                len = tab - (text + offs[n]);
+                if (len == 0 || len >= PX_KEYIDLEN) {
+                    LOG_ERR(("Invalid ID in line %lu!\n", line));
+                    failure = EINVAL;
+                    goto clean;
+                }
+                memcpy(keys[n].id, text + offs[n], len);
+                offs[n] += len + 1;
+            } else {
+                sprintf(keys[n].id, "%lu", line);
+            }
+            n++;
+        }
+
+        if (!n) break;
+        for (i = 0; i < n; i++) pws[i] = text + offs[i];
+
+        if (px_keygens((const char * const *)pws, n, args->movjok, decks,
+                args->nthreads)) {
+            LOG_ERR(("Key generation failed.\n"));
+            failure = EINVAL;
+            goto clean;
+        }
+
+        for (i = 0; i < n; i++) {
+            memcpy(keys[i].deck, decks + i * 54, 54);
+            px_prkeyent(&keys[i], args->output);
+        }
+    }
+
+    if (!line) {
+        LOG_ERR(("Empty input, abort.\n"));
+        failure = EINVAL;
+    }
+
+clean:
+    /* Passwords and keys are wiped. */
+    if (text) {
+        memset(text, 0, captext);
+        px_free(text);
+    }
+    if (keys) {
+        memset(keys, 0, GENBATCH * sizeof(*keys));
+        free(keys);
+    }
+    if (decks) {
+        memset(decks, 0, GENBATCH * 54);
+        free(decks);
+    }
     return failure;
 }
 
+/*
+ * Writes a decrypted message, one per line. In binary mode, the
+ * letters are transcoded back to the original bytes instead.
+ */
+static void _wrplain(struct runopts *args, const char *text) {
+    char *data = NULL;
+    int n;
+
+    if (!args->binary) {
+        fprintf(args->output, "%s\n", text);
+        return;
+    }
+
+    n = px_b26dec(text, strlen(text), &data);
+    if (n < 0) return;
+    fwrite(data, sizeof(char), n, args->output);
+    px_free(data);
+}
+
+/*
+ * Shared state of the parallel decryption of message blocks.
+ */
+struct decjob {
+    struct runopts *args;
+    const struct px_msgblk *blks;
+    char **results; /* decrypted blocks, NULL on failure */
+};
+
+/*
+ * Decrypts the i-th message block of a decjob.
+ */
+static void _decblk(void *ctx, int i) {
+    struct decjob *job = ctx;
+    struct px_opts opts = { 1 };
+    struct px_stats st;
+    char *message = NULL;
+    int nmessage;
+
+    job->results[i] = NULL;
+    memset(&st, 0, sizeof(st));
+    if (job->args->stats) opts.stats = &st;
+    opts.engine = job->args->engine;
+    opts.pipeline = job->args->pipeline;
+    opts.segment = job->blks[i].seglen
+        ? job->blks[i].seglen : job->args->segment;
+    opts.nthreads = job->args->nthreads;
+
+    nmessage = px_rdblock(&job->blks[i], &message);
+    if (nmessage == -1) {
+        LOG_ERR(("Internal memory error!\n"));
+        return;
+    }
+
+    if (px_decrypt(
+            job->args->key, message, nmessage, &job->results[i], &opts) < 0) {
+        LOG_ERR(("Error in crypto algorithm.\n"));
+        job->results[i] = NULL;
+    }
+
+    px_free(message);
+    if (opts.stats) _addstats(job->args, &st);
+}
+
+/*
+ * Decrypts all message blocks within the input, distributed over
+ * multiple threads. The plain texts are printed in the original order.
+ */
+static void _decblks(struct runopts *args, const char *text, int ntext) {
+    struct px_msgblk *blks = NULL;
+    struct decjob job;
+    double t = 0;
+    int i, nblks;
+
+    nblks = px_scanciphers(text, ntext, &blks);
+    if (nblks == -1) {
+        LOG_ERR(("Internal memory error!\n"));
+        goto clean;
+    }
+    if (nblks == 0) {
+        LOG_ERR(("The message was malformed.\n"));
+        goto clean;
+    }
+
+    LOG_INF(("Decrypting %i message block(s).\n", nblks));
+
+    job.args = args;
+    job.blks = blks;
+    job.results = calloc(nblks, sizeof(char *));
+    if (!job.results) {
+        LOG_ERR(("Internal memory error!\n"));
+        goto clean;
+    }
+
+    if (px_pfor(nblks, args->nthreads, _decblk, &job) != 0) {
+        LOG_ERR(("Could not start decryption.\n"));
+    }
+
+    if (args->stats) t = px_now();
+    PX_TRACE0(write_begin);
+    for (i = 0; i < nblks; i++) {
+        if (job.results[i]) {
+            _wrplain(args, job.results[i]);
+            px_free(job.results[i]);
+        }
+    }
+    fflush(args->output);
+    PX_TRACE0(write_end);
+    _tick(args, PX_PH_WRITE, &t);
+
+    free(job.results);
+
+clean:
+    if (blks) px_free(blks);
+}
+
 /*
  * Reads a plain text or cipher text message from the input,
  * performs the encryption or decryption and prints the
@@ -304,14 +797,28 @@ clean:
 void _cipher(struct runopts *args) {
     char *filebuf = NULL, /* buffer for raw file content*/
          *message = NULL, /* input buffer */
-         *output = NULL; /* output buffer */
+         *output = NULL, /* output buffer */
+         *formatted = NULL, /* formatted output */
+         *cards = NULL, /* message read from card values */
+         *letters = NULL; /* binary message transcoded to letters */
     struct px_opts opts = { 1 };
     int cryptexit = 0;
     int nmessage = 0;
     unsigned int flags = 0;
+    double t = 0;
+
+    opts.stats = args->stats;
+    opts.engine = args->engine;
+    opts.pipeline = args->pipeline;
+    opts.segment = args->segment;
+    opts.nthreads = args->nthreads;
+    if (args->stats) t = px_now();
 
     /* Read message */
+    PX_TRACE0(read_begin);
     nmessage = _readall(args->input, &filebuf);
+    PX_TRACE1(read_end, nmessage);
+    _tick(args, PX_PH_READ, &t);
 
     /* Set the message to raw content by default. Important for freeing. */
     message = filebuf;
@@ -322,36 +829,248 @@ void _cipher(struct runopts *args) {
     }
 
     if (args->mode == MD_ENCR) {
-        cryptexit = px_encrypt(args->key, message, nmessage, &output, &opts);
+        if (args->binary) {
+            nmessage = px_b26enc(filebuf, nmessage - 1, &letters);
+            if (nmessage < 0) {
+                LOG_ERR(("Internal memory error!\n"));
+                goto clean;
+            }
+        }
+
+        cryptexit = px_encrypt(args->key, letters ? letters : message,
+            nmessage, &output, &opts);
         if (cryptexit < 0) {
             LOG_ERR(("Error in crypto algorithm.\n"));
             goto clean;
         }
 
         if(args->raw) flags |= PXO_RAW;
-        px_prcipher(output, args->output, flags);
-    } else {
-        if (!args->raw) {
-            nmessage = px_rdcipher(filebuf, &message);
-            free(filebuf); /* The raw content is no longer needed. */
-            if (nmessage == -1) {
-                LOG_ERR(("The message was malformed.\n"))
+        if (args->stats) t = px_now();
+        if (args->format == PXF_CARDS) {
+            cryptexit = px_tocards(output);
+        } else {
+            if (args->format == PXF_PACKED) {
+                cryptexit = px_pack(output, &formatted);
+            } else {
+                cryptexit = px_fmtsegments(
+                    output, flags, args->segment, &formatted);
+            }
+            if (cryptexit < 0) {
+                LOG_ERR(("Internal memory error!\n"));
                 goto clean;
             }
         }
-
-        cryptexit = px_decrypt(args->key, message, nmessage, &output, &opts);
+        _tick(args, PX_PH_FORMAT, &t);
+
+        PX_TRACE0(write_begin);
+        fwrite(formatted ? formatted : output, sizeof(char), cryptexit,
+            args->output);
+        fflush(args->output);
+        PX_TRACE0(write_end);
+        _tick(args, PX_PH_WRITE, &t);
+    } else if (!args->raw && args->format == PXF_TEXT) {
+        _decblks(args, filebuf, nmessage);
+    } else {
+        if (args->format != PXF_TEXT) {
+            cryptexit = args->format == PXF_CARDS
+                ? px_rdcards(filebuf, nmessage - 1, &cards)
+                : px_unpack(filebuf, nmessage - 1, &cards);
+            if (cryptexit < 0) goto clean;
+            cryptexit = px_decrypt(
+                args->key, cards, cryptexit - 1, &output, &opts);
+        } else {
+            cryptexit = px_decrypt(
+                args->key, message, nmessage, &output, &opts);
+        }
         if (cryptexit < 0) {
             LOG_ERR(("Error in crypto algorithm.\n"));
             goto clean;
         }
 
-        fprintf(args->output, "%s\n", output);
+        if (args->stats) t = px_now();
+        PX_TRACE0(write_begin);
+        _wrplain(args, output);
+        fflush(args->output);
+        PX_TRACE0(write_end);
+        _tick(args, PX_PH_WRITE, &t);
+    }
+
+clean:
+    if (message) px_free(message);
+    if (output) px_free(output);
+    if (formatted) px_free(formatted);
+    if (cards) px_free(cards);
+    if (letters) px_free(letters);
+}
+
+/*
+ * Encrypts or decrypts the content of one file of a batch.
+ * See px_batchfn.
+ */
+static int _cipherbuf(void *ctx, const char *in, int nin, char **out) {
+    struct runopts *args = ctx;
+    struct px_opts opts = { 1 };
+    struct px_stats st;
+    struct px_msgblk *blks = NULL;
+    char *message = NULL,
+         *result = NULL;
+    double t = 0;
+    int i, n, nblks,
+        nout = 0;
+
+    *out = NULL;
+    memset(&st, 0, sizeof(st));
+    if (args->stats) opts.stats = &st;
+    opts.engine = args->engine;
+    opts.pipeline = args->pipeline;
+    opts.segment = args->segment;
+    opts.nthreads = args->nthreads;
+
+    if (args->mode == MD_ENCR) {
+        if (args->binary) {
+            n = px_b26enc(in, nin, &message);
+            if (n < 0) return -1;
+            in = message;
+            nin = n - 1;
+        }
+        n = px_encrypt(args->key, in, nin, &result, &opts);
+        if (message) px_free(message);
+        if (n < 0) return -1;
+        if (args->stats) t = px_now();
+        if (args->format == PXF_CARDS) {
+            nout = n ? px_tocards(result) : 0;
+            *out = result;
+            result = NULL;
+        } else if (args->format == PXF_PACKED) {
+            nout = px_pack(n ? result : "", out);
+        } else {
+            nout = px_fmtsegments(n ? result : "",
+                args->raw ? PXO_RAW : 0, args->segment, out);
+        }
+        if (result) px_free(result);
+        if (args->stats) {
+            st.time[PX_PH_FORMAT] += px_now() - t;
+            _addstats(args, &st);
+        }
+        return nout;
+    }
+
+    /* Decryption, the message blocks are placed one per line. */
+    if (args->format != PXF_TEXT) {
+        n = args->format == PXF_CARDS
+            ? px_rdcards(in, nin, &message)
+            : px_unpack(in, nin, &message);
+        if (n < 0) return -1;
+        nin = n - 1;
+        nblks = 1;
+    } else if (args->raw) {
+        nblks = 1;
+    } else {
+        nblks = px_scanciphers(in, nin, &blks);
+        if (nblks <= 0) {
+            LOG_ERR(("The message was malformed.\n"));
+            return -1;
+        }
+    }
+
+    *out = px_malloc(nin + nblks + 1); /* plain text is never longer */
+    if (!*out) goto fail;
+
+    for (i = 0; i < nblks; i++) {
+        if (message) {
+            n = px_decrypt(args->key, message, nin, &result, &opts);
+            px_free(message);
+            message = NULL;
+        } else if (args->raw) {
+            n = px_decrypt(args->key, in, nin, &result, &opts);
+        } else {
+            if (px_rdblock(&blks[i], &message) < 0) goto fail;
+            opts.segment = blks[i].seglen ? blks[i].seglen : args->segment;
+            n = px_decrypt(args->key, message, strlen(message), &result, &opts);
+            px_free(message);
+            message = NULL;
+        }
+
+        if (n < 0) goto fail;
+        if (n > 0 && args->binary) {
+            /* The bytes are always fewer than the letters. */
+            n = px_b26dec(result, n - 1, &message);
+            px_free(result);
+            if (n < 0) goto fail;
+            memcpy(*out + nout, message, n);
+            nout += n;
+            px_free(message);
+            message = NULL;
+            continue;
+        }
+        if (n > 0) {
+            memcpy(*out + nout, result, n - 1);
+            nout += n - 1;
+            px_free(result);
+        }
+        (*out)[nout++] = '\n';
+    }
+
+    (*out)[nout] = '\0';
+    if (blks) px_free(blks);
+    if (args->stats) _addstats(args, &st);
+    return nout;
+
+fail:
+    LOG_ERR(("Error in crypto algorithm.\n"));
+    if (message) px_free(message);
+    if (blks) px_free(blks);
+    if (*out) px_free(*out);
+    *out = NULL;
+    return -1;
+}
+
+/*
+ * Encrypts or decrypts all files given as arguments.
+ * Encrypting FILE writes FILE.px, decrypting FILE.px writes FILE.
+ *
+ * Returns 0 on success, EIO if any file failed.
+ */
+static int _batch(struct runopts *args) {
+    char **outpaths;
+    size_t len;
+    int i, failed = -1;
+
+    outpaths = calloc(args->nfiles, sizeof(char *));
+    if (!outpaths) goto clean;
+
+    for (i = 0; i < args->nfiles; i++) {
+        len = strlen(args->files[i]);
+        outpaths[i] = malloc(len + 4);
+        if (!outpaths[i]) goto clean;
+        strcpy(outpaths[i], args->files[i]);
+
+        if (args->mode == MD_ENCR) {
+            strcat(outpaths[i], ".px");
+        } else if (len > 3 && !strcmp(outpaths[i] + len - 3, ".px")) {
+            outpaths[i][len - 3] = '\0';
+        } else {
+            strcat(outpaths[i], ".pt");
+        }
+        LOG_INF(("%s -> %s\n", args->files[i], outpaths[i]));
     }
 
+    failed = px_batch(
+        args->files, outpaths, args->nfiles,
+        args->nthreads, args->iobackend, _cipherbuf, args);
+
 clean:
-    if (message) free(message);
-    if (output) free(output);
+    if (failed < 0) LOG_ERR(("Batch processing failed.\n"));
+    if (failed > 0) LOG_ERR(("%i file(s) failed.\n", failed));
+
+    if (outpaths) {
+        for (i = 0; i < args->nfiles; i++) {
+            if (outpaths[i]) free(outpaths[i]);
+        }
+        free(outpaths);
+    }
+
+    return failed ? EIO : 0;
 }
 
 /*
@@ -359,17 +1078,209 @@ clean:
  * The number of letters is defined within the args.
  */
 static void _stream(struct runopts *args) {
-    char *output = NULL;
+    char letters[STRMBLK + 1],
+         out[2 * STRMBLK];
     struct px_opts opts = { 1 };
-
-    if (px_stream(args->key, args->length, &output, &opts) != 0) {
-        LOG_ERR(("Key stream generation failed.\n"))
+    struct px_ks ks;
+    unsigned long left = args->length;
+    double t = 0;
+    int n, nout;
+
+    opts.stats = args->stats;
+    opts.engine = args->engine;
+
+    if (args->format == PXF_PACKED
+            && (!left || left > 0x7fffffffUL / 5 - PX_PKHEADER)) {
+        LOG_ERR(("The packed format needs a key stream length from 1"
+            " to %lu.\n", 0x7fffffffUL / 5 - PX_PKHEADER));
         return;
     }
 
-    _outgrp(output, args->output);
+    if (px_ksopen(&ks, args->key, &opts)) return;
+
+    if (args->format == PXF_PACKED) {
+        px_pkhead(left, out);
+        fwrite(out, sizeof(char), PX_PKHEADER, args->output);
+    }
+
+    /* One block at a time, so memory does not grow with the length. */
+    do {
+        n = !args->length || left > STRMBLK ? STRMBLK : left;
+        if (px_ksread(&ks, letters, n)) {
+            LOG_ERR(("Key stream generation failed.\n"));
+            break;
+        }
+
+        if (args->stats) t = px_now();
+        PX_TRACE0(write_begin);
+        if (args->format == PXF_CARDS) {
+            letters[n] = '\0';
+            nout = px_tocards(letters);
+            memcpy(out, letters, nout);
+        } else if (args->format == PXF_PACKED) {
+            nout = px_pkletters(letters, n, out);
+        } else {
+            nout = _fmtgrp(letters, n, out);
+        }
+        nout = fwrite(out, sizeof(char), nout, args->output) != nout;
+        PX_TRACE0(write_end);
+        _tick(args, PX_PH_WRITE, &t);
+
+        if (nout) {
+            LOG_ERR(("Could not write the key stream!\n"));
+            break;
+        }
+        left -= n;
+    } while (!args->length || left);
+
+    if (args->format == PXF_TEXT) fputc('\n', args->output);
+    fflush(args->output);
+
+    px_ksclose(&ks);
+    memset(letters, 0, sizeof(letters));
+    memset(out, 0, sizeof(out));
+}
+
+/*
+ * Prints bytes drawn from the key stream to the output, see
+ * px_rand_bytes(). The number of bytes is defined within the args.
+ */
+static int _random(struct runopts *args) {
+    unsigned char out[RANDBLK];
+    struct px_opts opts = { 1 };
+    struct px_rand r;
+    unsigned long left = args->length;
+    double t = 0;
+    int n, failure = 0;
+
+    opts.stats = args->stats;
+    opts.engine = args->engine;
+    if (px_rand_open(&r, args->key, &opts)) return EINVAL;
+
+    do {
+        n = !args->length || left > RANDBLK ? RANDBLK : left;
+        if (px_rand_bytes(&r, out, n)) {
+            LOG_ERR(("Key stream generation failed.\n"));
+            failure = EINVAL;
+            break;
+        }
+
+        if (args->stats) t = px_now();
+        if (fwrite(out, 1, n, args->output) != n) {
+            LOG_ERR(("Could not write the random bytes!\n"));
+            failure = EIO;
+            break;
+        }
+        _tick(args, PX_PH_WRITE, &t);
+        left -= n;
+    } while (!args->length || left);
+
+    fflush(args->output);
+
+    px_rand_close(&r);
+    memset(out, 0, sizeof(out));
+    return failure;
+}
+
+/*
+ * Encrypts or decrypts the input with a deck of --deck. The cipher
+ * text is framed and grouped like the standard one, but holds the
+ * characters of the deck's alphabet.
+ */
+static int _vcipher(struct runopts *args) {
+    const struct px_variant *v = args->variant;
+    struct px_msgblk *blks = NULL;
+    char *input = NULL,
+         *output = NULL,
+         *formatted = NULL;
+    int ninput, nblks, i,
+        failure = EINVAL;
+
+    ninput = _readall(args->input, &input);
+    if (!ninput) {
+        LOG_ERR(("Empty input, abort.\n"));
+        return EINVAL;
+    }
+
+    if (args->mode == MD_ENCR) {
+        if (px_vencrypt(v, args->key, input, &output) < 0
+                || px_fmtsegments(
+                    output, args->raw ? PXO_RAW : 0, 0, &formatted) < 0) {
+            LOG_ERR(("Error in crypto algorithm.\n"));
+            goto clean;
+        }
+        fputs(formatted, args->output);
+    } else if (args->raw) {
+        if (px_vdecrypt(v, args->key, input, &output) < 0) {
+            LOG_ERR(("Error in crypto algorithm.\n"));
+            goto clean;
+        }
+        _wrplain(args, output);
+    } else {
+        /* px_rdblock() only keeps letters, so the blocks are cut out. */
+        nblks = px_scanciphers(input, ninput, &blks);
+        if (nblks <= 0) {
+            LOG_ERR(("The message was malformed.\n"));
+            goto clean;
+        }
+        for (i = 0; i < nblks; i++) {
+            input[blks[i].end - input] = '\0';
+            if (px_vdecrypt(v, args->key, blks[i].start, &output) < 0) {
+                LOG_ERR(("Error in crypto algorithm.\n"));
+                goto clean;
+            }
+            _wrplain(args, output);
+            px_free(output);
+            output = NULL;
+        }
+    }
+    failure = 0;
+
+clean:
+    fflush(args->output);
+    px_free(input);
+    px_free(output);
+    px_free(formatted);
+    if (blks) px_free(blks);
+    return failure;
+}
+
+/*
+ * Prints the key stream of a deck of --deck, like _stream().
+ */
+static int _vstream(struct runopts *args) {
+    char letters[STRMBLK],
+         out[2 * STRMBLK];
+    card deck[PX_MAXCARDS];
+    unsigned long left = args->length;
+    int n, nout,
+        failure = 0;
+
+    memcpy(deck, args->key, args->variant->ncards);
+
+    do {
+        n = !args->length || left > STRMBLK ? STRMBLK : left;
+        if (px_vstream(args->variant, deck, letters, n)) {
+            failure = EINVAL;
+            break;
+        }
 
-    if (output) free(output);
+        nout = _fmtgrp(letters, n, out);
+        if (fwrite(out, sizeof(char), nout, args->output) != nout) {
+            LOG_ERR(("Could not write the key stream!\n"));
+            failure = EIO;
+            break;
+        }
+        left -= n;
+    } while (!args->length || left);
+
+    fputc('\n', args->output);
+    fflush(args->output);
+
+    memset(deck, 0, sizeof(deck));
+    memset(letters, 0, sizeof(letters));
+    memset(out, 0, sizeof(out));
+    return failure;
 }
 
 /*
@@ -392,6 +1303,51 @@ static int _trypint(char *number, int *result) {
     return 1;
 }
 
+/*
+ * Parses an unsigned long integer.
+ * Return:
+ *      1 on success, 0 on failure
+ */
+static int _trypulong(char *number, unsigned long *result) {
+    char *end;
+
+    errno = 0;
+    *result = strtoul(number, &end, 10);
+    if (!isdigit(*number) || *end || errno == ERANGE) {
+        LOG_ERR(("%s is not a integer!\n", number));
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Checks that the options work with a deck of --deck, which has its
+ * own cipher functions, see px_variant.h.
+ *
+ * \returns 0 if they do, -1 if not.
+ */
+static int _vcheck(const struct cliargs *args) {
+    const struct runopts *o = args->options;
+
+    if (o->mode != MD_ENCR && o->mode != MD_DECR && o->mode != MD_STRM
+            && o->mode != MD_PKEY) {
+        LOG_ERR(("--deck works with -e, -d, -s and --gen-key only.\n"));
+        return -1;
+    }
+    if (o->movjok || o->binary || o->pipeline || o->segment || o->nfiles
+            || o->format != PXF_TEXT) {
+        LOG_ERR(("--deck does not work with -j, --binary, --pipeline,"
+            " --segment, --format or FILEs.\n"));
+        return -1;
+    }
+    if (args->keyf || args->keyring || args->keyid) {
+        LOG_ERR(("--deck needs a key from -p or -k.\n"));
+        return -1;
+    }
+    return 0;
+}
+
 /*
  *  Step 2 of the argument evaluation:
  *  After all arguments have been collected and stored in
@@ -407,39 +1363,101 @@ static error_t _evalpargs(struct cliargs *args) {
         case MD_DECR: LOG_INF(("Decrytion mode\n")); break;
         case MD_STRM:
             LOG_INF((
-                "Stream mode with %i symbols\n",
+                "Stream mode with %lu symbols (0 = unlimited)\n",
+                args->options->length));
+            break;
+        case MD_RAND:
+            LOG_INF((
+                "Random mode with %lu bytes (0 = unlimited)\n",
                 args->options->length));
             break;
         case MD_PKEY:
             LOG_INF(("Print-key mode\n"));
             break;
+        case MD_GKEYS:
+            LOG_INF(("Batch key generation mode\n"));
+            break;
+        case MD_MKKR:
+            LOG_INF(("Keyring conversion mode\n"));
+            break;
     }
 
     if (args->options->raw) LOG_INF(("Output in raw mode\n"));
 
+    if (args->options->variant && _vcheck(args)) return ENOTSUP;
+
     if (args->pw) {
         LOG_INF(("Generating key from password.\n"));
-        px_keygen(args->pw, args->options->movjok, args->options->key);
+        if (args->options->variant) {
+            px_vkeygen(args->options->variant, args->pw, args->options->key);
+        } else {
+            px_keygen(args->pw, args->options->movjok, args->options->key);
+        }
         keydef++;
     }
     if (args->keystr) {
         LOG_INF(("Using key '%s'\n", args->keystr));
-        failure = px_rdkey(args->keystr, args->options->key);
+        failure = args->options->variant
+            ? px_rddeck(args->keystr, args->options->variant->ncards,
+                args->options->key)
+            : px_rdkey(args->keystr, args->options->key);
         keydef++;
     }
     if (args->keyf) {
         LOG_INF(("Using key file '%s'\n", args->keyf));
-        failure = _readkey(args->options->key, args->keyf);
+        failure = _readkey(args->options->key, args->keyf, args->keyid);
+        keydef++;
+    }
+
+    if (args->keyring || (args->keyid && !args->keyf)) {
+        if (!args->keyring || !args->keyid) {
+            LOG_ERR(("--keyring needs --key-id and vice versa.\n"));
+            return ENOTSUP;
+        }
+        LOG_INF(("Using key '%s' from keyring '%s'\n",
+            args->keyid, args->keyring));
+        failure = _readkeyring(
+            args->options->key, args->keyring, args->keyid);
         keydef++;
     }
 
     if (failure) return failure; /* assuming the px_ funcs do the logging. */
 
-    if (keydef != 1) {
+    if (args->options->mode == MD_MKKR || args->options->mode == MD_GKEYS) {
+        if (keydef) {
+            LOG_ERR(("--gen-keys and --mk-keyring do not take a key.\n"));
+            return ENOTSUP;
+        }
+    } else if (keydef != 1) {
         LOG_ERR(("Invalid key definition. Abort.\n"));
         return ENOTSUP;
     }
 
+    /* The engine of --engine has been checked already. */
+    switch (args->options->mode) {
+        case MD_ENCR:
+        case MD_DECR:
+        case MD_STRM:
+        case MD_RAND:
+            if (px_engcheck(args->options->engine)) return ENOTSUP;
+            LOG_INF(("Key stream engine '%s'\n",
+                px_engname(args->options->engine)));
+            break;
+        default:
+            break;
+    }
+
+    if (args->options->nfiles) {
+        if (args->inputf || args->outputf) {
+            LOG_ERR(("FILE arguments cannot be combined with -i or -o.\n"));
+            return ENOTSUP;
+        }
+        if (args->options->mode != MD_ENCR && args->options->mode != MD_DECR) {
+            LOG_ERR(("FILE arguments are only supported for -e and -d.\n"));
+            return ENOTSUP;
+        }
+    }
+
     if(args->inputf) {
         LOG_INF(("Reading input from '%s'\n", args->inputf));
         args->options->input = fopen(args->inputf, "r");
@@ -461,6 +1479,9 @@ static error_t _evalpargs(struct cliargs *args) {
     return 0;
 }
 
+/* Run statistics, see --stats */
+static struct px_stats stats;
+
 /*
  *  Step 1 of the argument evaluation:
  *  Collect all arguments and store them as a cliargs struct.
@@ -473,6 +1494,7 @@ static error_t parseargs(
         struct argp_state *state) {
     struct cliargs *args = state->input;
     size_t length;
+    int e;
 
     switch (key) {
         case 'e': /* --encrypt */
@@ -483,7 +1505,11 @@ static error_t parseargs(
             break;
         case 's': /* --stream=N */
             args->options->mode = MD_STRM;
-            if (!_trypint(arg, &(args->options->length))) return ENOTSUP;
+            if (!_trypulong(arg, &(args->options->length))) return ENOTSUP;
+            break;
+        case  12: /* --random=N */
+            args->options->mode = MD_RAND;
+            if (!_trypulong(arg, &(args->options->length))) return ENOTSUP;
             break;
         case   1: /* --gen-key */
             args->options->mode = MD_PKEY;
@@ -526,12 +1552,98 @@ static error_t parseargs(
         case 'r': /* --raw */
             args->options->raw = 1;
             break;
+        case   9: /* --binary */
+            args->options->binary = 1;
+            break;
+        case  10: /* --pipeline */
+            args->options->pipeline = 1;
+            break;
+        case  11: /* --segment=N */
+            if (!_trypulong(arg, &(args->options->segment))) return ENOTSUP;
+            if (args->options->segment % 5) {
+                LOG_ERR(("The segment length must be a multiple of 5.\n"));
+                return ENOTSUP;
+            }
+            if (args->options->segment > PX_SEGMAX) {
+                LOG_ERR(("The segment length must be at most %lu.\n",
+                    PX_SEGMAX));
+                return ENOTSUP;
+            }
+            break;
         case 'v': /* --verbose */
             loglevel++;
             break;
         case 'q': /* --quiet */
             loglevel = LOGLEVEL_ERR;
             break;
+        case 't': /* --threads=N */
+            if (!_trypint(arg, &(args->options->nthreads))) return ENOTSUP;
+            break;
+        case  13: /* --engine=NAME */
+            e = px_engselect(arg);
+            if (e < 0) return ENOTSUP;
+            args->options->engine = e;
+            break;
+        case   2: /* --io-backend=NAME */
+            if (!strcmp(arg, "auto")) {
+                args->options->iobackend = PX_BIO_AUTO;
+            } else if (!strcmp(arg, "uring")) {
+                args->options->iobackend = PX_BIO_URING;
+            } else if (!strcmp(arg, "threads")) {
+                args->options->iobackend = PX_BIO_THREADS;
+            } else {
+                LOG_ERR(("Unknown I/O backend '%s'!\n", arg));
+                return ENOTSUP;
+            }
+            break;
+        case   4: /* --keyring=FILE */
+            length = strlen(arg) + 1; /* + '\0' */
+            args->keyring = malloc(length);
+            if (!args->keyring) return ENOMEM;
+            strncpy(args->keyring, arg, length);
+            break;
+        case   5: /* --key-id=ID */
+            length = strlen(arg) + 1; /* + '\0' */
+            args->keyid = malloc(length);
+            if (!args->keyid) return ENOMEM;
+            strncpy(args->keyid, arg, length);
+            break;
+        case   7: /* --gen-keys */
+            args->options->mode = MD_GKEYS;
+            break;
+        case   6: /* --mk-keyring */
+            args->options->mode = MD_MKKR;
+            break;
+        case   8: /* --format=NAME */
+            if (!strcmp(arg, "text")) {
+                args->options->format = PXF_TEXT;
+            } else if (!strcmp(arg, "cards")) {
+                args->options->format = PXF_CARDS;
+            } else if (!strcmp(arg, "packed")) {
+                args->options->format = PXF_PACKED;
+            } else {
+                LOG_ERR(("Unknown format '%s'!\n", arg));
+                return ENOTSUP;
+            }
+            break;
+        case   3: /* --stats */
+            args->options->stats = &stats;
+            break;
+        case  14: /* --deck=NAME */
+            args->options->variant = px_variant(arg);
+            if (!args->options->variant) {
+                LOG_ERR(("Unknown deck '%s'!\n", arg));
+                return ENOTSUP;
+            }
+            /* The standard deck keeps its own engines. */
+            if (args->options->variant->ncards == 54) {
+                args->options->variant = NULL;
+            }
+            break;
+        case ARGP_KEY_ARGS: /* FILE... */
+            args->options->files = state->argv + state->next;
+            args->options->nfiles = state->argc - state->next;
+            break;
         case ARGP_KEY_END:
             /*
              * All arguments have been collected.
@@ -553,7 +1665,15 @@ int main(int argc, char **argv) {
     struct cliargs arguments;
     error_t failure;
 
+    /*
+     * The arena holds the key and a deck for each cipher run in flight.
+     * If it runs out, the crypto functions fall back to memory of their
+     * own, so this only needs to be large enough for the common case.
+     */
+    px_sminit(4 * px_ncpus() + 8);
+
     options = _defrunopts();
+    _setkeymem(&options);
     arguments = _defcliargs(&options);
 
     failure = argp_parse(&parser, argc, argv, 0, 0, &arguments);
@@ -561,24 +1681,50 @@ int main(int argc, char **argv) {
 
     if (failure) {
         LOG_ERR(("%s\n", strerror(failure)));
+        _clrrunopts(&options);
+        px_smdone();
         exit(failure);
     }
 
     switch (options.mode) {
         case MD_ENCR:
         case MD_DECR:
-            _cipher(&options);
+            if (options.variant) {
+                failure = _vcipher(&options);
+            } else if (options.nfiles) {
+                failure = _batch(&options);
+            } else {
+                _cipher(&options);
+            }
             break;
         case MD_STRM:
-            _stream(&options);
+            if (options.variant) {
+                failure = _vstream(&options);
+            } else {
+                _stream(&options);
+            }
+            break;
+        case MD_RAND:
+            failure = _random(&options);
             break;
         case MD_PKEY:
-            px_prkey(options.key, options.output, options.raw ? PXO_RAW : 0);
+            px_prdeck(options.key,
+                options.variant ? options.variant->ncards : 54,
+                options.output, options.raw ? PXO_RAW : 0);
+            break;
+        case MD_GKEYS:
+            failure = _genkeys(&options);
+            break;
+        case MD_MKKR:
+            failure = _mkkeyring(&options);
             break;
     }
 
+    if (options.stats) px_prstats(options.stats, stderr);
+
     _clrrunopts(&options);
+    px_smdone(); /* wipes all key and deck material */
 
-    return 0;
+    return failure;
 }
 
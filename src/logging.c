@@ -0,0 +1,36 @@
+/*
+ *  logging.c : writes log messages.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdarg.h>
+
+#include "./logging.h"
+
+/*
+ * Writes a log message.
+ * See header.
+ */
+void logprintf(const char *format, ...) {
+    va_list ap;
+
+    va_start(ap, format);
+    vfprintf(LOGFILE, format, ap);
+    va_end(ap);
+}
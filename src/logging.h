@@ -29,13 +29,23 @@ extern int loglevel;
 #define LOGLEVEL_INF 2
 #define LOGLEVEL_DBG 3
 
-#define LOGFILE stdout;
+/*
+ * Log messages go to stderr, so they never mix with the output of
+ * enoch, e.g. the bytes of a binary format written to stdout.
+ */
+#define LOGFILE stderr
+
+/**
+ * Writes a log message to LOGFILE, like printf().
+ */
+void logprintf(const char *format, ...);
 
 #define LOG_1(level, prefix, args) \
-    do { if (level <= loglevel) { printf(prefix) ; printf args; } } while (0)
+    do { if (level <= loglevel) { fputs(prefix, LOGFILE); logprintf args; } } \
+    while (0)
 
 #define LOG_2(level, args) \
-    do { if (level <= loglevel) printf args; } while (0)
+    do { if (level <= loglevel) logprintf args; } while (0)
 
 #define LOG_ERR(format) LOG_1(LOGLEVEL_ERR, "ERROR: ", format);
 #define LOG_WRN(format) LOG_1(LOGLEVEL_WRN, "WARNING: ", format);
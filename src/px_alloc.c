@@ -0,0 +1,256 @@
+/*
+ *  px_alloc.c : Implementation of the allocator hooks and the arena.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "./px_alloc.h"
+
+/*
+ * Unit of the arena. Each block starts with one that holds its size,
+ * so the blocks stay aligned for any type.
+ */
+union align {
+    size_t n;
+    long l;
+    double d;
+    void *p;
+};
+
+/*
+ * A chunk of an arena.
+ */
+struct archunk {
+    struct archunk *prev;
+    size_t size; /* bytes of data */
+    size_t used; /* bytes handed out */
+    size_t top; /* highest used, to be wiped */
+    union align data[1];
+};
+
+/* Bytes of a block for n bytes of memory, with its header. */
+#define BLKSIZE(n) \
+    (sizeof(union align) \
+        * (1 + ((n) + sizeof(union align) - 1) / sizeof(union align)))
+
+/* The allocator of the thread, NULL for malloc(). */
+static __thread const struct px_allocator *current;
+
+/*
+ * Sets the allocator of the calling thread.
+ * See header.
+ */
+const struct px_allocator *px_set_allocator(const struct px_allocator *a) {
+    const struct px_allocator *prev = current;
+
+    current = a;
+    return prev;
+}
+
+/*
+ * Allocates memory with the allocator of the calling thread.
+ * See header.
+ */
+void *px_malloc(size_t n) {
+    return current ? current->alloc(current->ctx, n) : malloc(n);
+}
+
+/*
+ * Resizes memory from px_malloc().
+ * See header.
+ */
+void *px_realloc(void *p, size_t n) {
+    return current ? current->resize(current->ctx, p, n) : realloc(p, n);
+}
+
+/*
+ * Releases memory from px_malloc().
+ * See header.
+ */
+void px_free(void *p) {
+    if (current) {
+        current->release(current->ctx, p);
+    } else {
+        free(p);
+    }
+}
+
+/*
+ * Gets the header of an arena block.
+ */
+static union align *_arhdr(void *p) {
+    return (union align *)p - 1;
+}
+
+/*
+ * Allocates a new chunk of at least size bytes.
+ *
+ * \returns 0 on success, -1 if out of memory.
+ */
+static int _archunk(struct px_arena *a, size_t size) {
+    struct archunk *c;
+
+    if (size < PX_ARCHUNK) size = PX_ARCHUNK;
+    if (size < a->total) size = a->total; /* grow geometrically */
+
+    c = malloc(offsetof(struct archunk, data) + size);
+    if (!c) return -1;
+
+    c->prev = a->chunk;
+    c->size = size;
+    c->used = 0;
+    c->top = 0;
+    a->chunk = c;
+    a->total += size;
+    return 0;
+}
+
+/*
+ * Wipes and releases all chunks of an arena.
+ */
+static void _arfree(struct px_arena *a) {
+    struct archunk *c;
+
+    while ((c = a->chunk)) {
+        a->chunk = c->prev;
+        memset(c->data, 0, c->top);
+        free(c);
+    }
+    a->total = 0;
+    a->last = NULL;
+}
+
+/*
+ * Allocates memory from an arena.
+ * See header.
+ */
+void *px_aralloc(struct px_arena *a, size_t n) {
+    struct archunk *c = a->chunk;
+    union align *h;
+    size_t need = BLKSIZE(n);
+
+    if (!c || c->size - c->used < need) {
+        if (_archunk(a, need)) return NULL;
+        c = a->chunk;
+    }
+
+    h = (union align *)((char *)c->data + c->used);
+    h->n = n;
+    c->used += need;
+    if (c->top < c->used) c->top = c->used;
+
+    a->last = h + 1;
+    return a->last;
+}
+
+/*
+ * Hook for px_malloc().
+ */
+static void *_aralloc(void *ctx, size_t n) {
+    return px_aralloc(ctx, n);
+}
+
+/*
+ * Hook for px_realloc(). The latest block grows in place while its
+ * chunk has room, other blocks are copied.
+ */
+static void *_arresize(void *ctx, void *p, size_t n) {
+    struct px_arena *a = ctx;
+    struct archunk *c = a->chunk;
+    union align *h;
+    size_t old;
+    void *q;
+
+    if (!p) return px_aralloc(a, n);
+
+    h = _arhdr(p);
+    old = h->n;
+
+    if (p == a->last
+            && c->size - c->used + BLKSIZE(old) >= BLKSIZE(n)) {
+        c->used += BLKSIZE(n) - BLKSIZE(old);
+        if (c->top < c->used) c->top = c->used;
+        h->n = n;
+        return p;
+    }
+
+    if (n <= old) {
+        h->n = n;
+        return p;
+    }
+
+    q = px_aralloc(a, n);
+    if (q) memcpy(q, p, old);
+    return q;
+}
+
+/*
+ * Hook for px_free(). Only the latest block is taken back.
+ */
+static void _arrelease(void *ctx, void *p) {
+    struct px_arena *a = ctx;
+
+    if (!p || p != a->last) return;
+
+    a->chunk->used -= BLKSIZE(_arhdr(p)->n);
+    a->last = NULL;
+}
+
+/*
+ * Sets up an empty arena.
+ * See header.
+ */
+void px_arinit(struct px_arena *a) {
+    memset(a, 0, sizeof(*a));
+    a->hooks.alloc = _aralloc;
+    a->hooks.resize = _arresize;
+    a->hooks.release = _arrelease;
+    a->hooks.ctx = a;
+}
+
+/*
+ * Takes back all memory of an arena.
+ * See header.
+ */
+void px_arreset(struct px_arena *a) {
+    size_t total = a->total;
+
+    if (a->chunk && a->chunk->prev) {
+        /* Merge, so the next batch of the same size fits one chunk. */
+        _arfree(a);
+        _archunk(a, total);
+    } else if (a->chunk) {
+        memset(a->chunk->data, 0, a->chunk->top);
+        a->chunk->used = 0;
+        a->chunk->top = 0;
+    }
+    a->last = NULL;
+}
+
+/*
+ * Wipes and releases all memory of an arena.
+ * See header.
+ */
+void px_ardone(struct px_arena *a) {
+    _arfree(a);
+}
+
+#undef BLKSIZE
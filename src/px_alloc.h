@@ -0,0 +1,127 @@
+#ifndef PX_ALLOC__H_
+#define PX_ALLOC__H_
+
+/*
+ *  px_alloc.h : declares the allocator hooks for result buffers and
+ *               an arena allocator.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+
+/*
+ * The buffers that the library returns to its callers, like the
+ * results of px_encrypt() or px_fmtcipher(), are allocated with
+ * px_malloc() and have to be released with px_free().
+ *
+ * Each thread has its own allocator, malloc() unless another one is
+ * set. A buffer has to be released by the thread that allocated it,
+ * with the allocator still set. Threads started by the library, like
+ * the workers of px_pfor(), start with malloc().
+ */
+
+/**
+ * Allocator hooks.
+ */
+struct px_allocator {
+    void *(*alloc)(void *ctx, size_t n); /* NULL if out of memory */
+    void *(*resize)(void *ctx, void *p, size_t n); /* like realloc() */
+    void (*release)(void *ctx, void *p); /* p may be NULL */
+    void *ctx;
+};
+
+/**
+ * Sets the allocator of the calling thread.
+ *
+ * \para a  The allocator, NULL for malloc(). It has to stay valid
+ *          until it is replaced.
+ *
+ * \returns The previous allocator, NULL for malloc().
+ */
+const struct px_allocator *px_set_allocator(const struct px_allocator *a);
+
+/**
+ * Allocates memory with the allocator of the calling thread.
+ */
+void *px_malloc(size_t n);
+
+/**
+ * Resizes memory from px_malloc(), like realloc().
+ */
+void *px_realloc(void *p, size_t n);
+
+/**
+ * Releases memory from px_malloc(). p may be NULL.
+ */
+void px_free(void *p);
+
+/*
+ * The arena hands out memory from large chunks by bumping an offset.
+ * Releasing or growing the latest block works in place, releasing
+ * other blocks does nothing. All memory is taken back at once by
+ * px_arreset(), which makes the arena fit for a batch of work:
+ * allocate freely, then reset.
+ */
+
+/** Size of the first chunk of an arena. */
+#define PX_ARCHUNK 65536
+
+/**
+ * An arena. Not thread-safe, use one per thread.
+ */
+struct px_arena {
+    struct px_allocator hooks; /* allocate from this arena */
+    struct archunk *chunk; /* current chunk, linked to the older ones */
+    size_t total; /* bytes of all chunks */
+    void *last; /* latest block */
+};
+
+/**
+ * Sets up an empty arena. No memory is allocated yet.
+ *
+ * \para a  The arena.
+ */
+void px_arinit(struct px_arena *a);
+
+/**
+ * Allocates memory from an arena.
+ *
+ * \para a  The arena.
+ * \para n  Number of bytes.
+ *
+ * \returns The memory, aligned for any type, NULL if out of memory.
+ */
+void *px_aralloc(struct px_arena *a, size_t n);
+
+/**
+ * Takes back all memory of an arena and wipes it. The chunks are
+ * merged into one that is kept for the next batch.
+ *
+ * \para a  The arena.
+ */
+void px_arreset(struct px_arena *a);
+
+/**
+ * Wipes and releases all memory of an arena.
+ *
+ * \para a  The arena.
+ */
+void px_ardone(struct px_arena *a);
+
+#endif
@@ -0,0 +1,670 @@
+/*
+ *  px_attack.c : Implementation of the search for partially known keys.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./px_attack.h"
+#include "./px_crypto.h"
+#include "./px_par.h"
+#include "./px_stats.h"
+#include "./logging.h"
+
+/* Maximum number of jobs the ranks are split into. */
+#define PX_MAXJOBS (1L << 16)
+
+/* Search nodes a deque of px_solve() holds at first. */
+#define PX_DEQUEMIN 256
+
+#define LOAD_ACQ(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*
+ * Shared state of a search.
+ */
+struct search {
+    card deck[54]; /* the partial key */
+    int slots[54]; /* positions of the unknown cards */
+    card missing[54]; /* the missing cards, ascending */
+    int k; /* number of unknown cards */
+    const card *expect;
+    int n;
+    unsigned long total; /* k! */
+    unsigned long perjob; /* ranks per job */
+    pthread_mutex_t lock; /* guards keys */
+    card *keys; /* found by the workers, nkeys * 54 cards */
+    int nkeys;
+};
+
+/*
+ * Sets perm to the permutation of the ascending cards in set with the
+ * given rank in lexicographic order.
+ */
+static void _unrank(const card *set, const int k, unsigned long rank,
+        card *perm) {
+    card left[54];
+    unsigned long f = 1;
+    int i, j;
+
+    memcpy(left, set, k);
+    for (i = 2; i < k; i++) f *= i; /* (k-1)! */
+
+    for (i = 0; i < k; i++) {
+        j = rank / f;
+        rank %= f;
+        perm[i] = left[j];
+        memmove(left + j, left + j + 1, k - i - j - 1);
+        if (k - i - 1 > 0) f /= k - i - 1;
+    }
+}
+
+/*
+ * Rearranges perm into the next permutation in lexicographic order.
+ */
+static void _nextperm(card *perm, const int k) {
+    card c;
+    int i, j;
+
+    for (i = k - 2; i >= 0 && perm[i] > perm[i + 1]; i--);
+    if (i < 0) return; /* last permutation */
+    for (j = k - 1; perm[j] < perm[i]; j--);
+
+    c = perm[i]; perm[i] = perm[j]; perm[j] = c;
+    for (i++, j = k - 1; i < j; i++, j--) {
+        c = perm[i]; perm[i] = perm[j]; perm[j] = c;
+    }
+}
+
+/*
+ * Tests the candidates of one range of ranks.
+ */
+static void _searchjob(void *ctx, int job) {
+    struct search *s = ctx;
+    card deck[54], perm[54], *tmp;
+    unsigned long rank, last;
+    int i;
+
+    rank = (unsigned long)job * s->perjob;
+    last = rank + s->perjob < s->total ? rank + s->perjob : s->total;
+
+    memcpy(deck, s->deck, 54);
+    _unrank(s->missing, s->k, rank, perm);
+
+    for (; rank < last; rank++) {
+        for (i = 0; i < s->k; i++) deck[s->slots[i]] = perm[i];
+
+        if (px_ksmatch(deck, s->expect, s->n) == s->n) {
+            pthread_mutex_lock(&s->lock);
+            tmp = realloc(s->keys, (s->nkeys + 1) * 54);
+            if (tmp) {
+                s->keys = tmp;
+                memcpy(s->keys + s->nkeys * 54, deck, 54);
+                s->nkeys++;
+            } else {
+                LOG_ERR(("Internal memory error! Dropping a result.\n"));
+            }
+            pthread_mutex_unlock(&s->lock);
+        }
+
+        _nextperm(perm, s->k);
+    }
+}
+
+/*
+ * Derives the key stream from a crib.
+ * See header.
+ */
+int px_crib(const char *pt, const char *ct, card **expect) {
+    int n = 0, d;
+
+    *expect = px_malloc(strlen(pt) + 1);
+    if (!*expect) return -1;
+
+    for (;;) {
+        while (*pt && !isalpha(*pt)) pt++;
+        while (*ct && !isalpha(*ct)) ct++;
+        if (!*pt || !*ct) break;
+
+        /* c = m + k (mod 26) */
+        d = (ASCII2CARD(*ct) - ASCII2CARD(*pt) + 26) % 26;
+        (*expect)[n++] = d == 0 ? 26 : d;
+        pt++;
+        ct++;
+    }
+
+    if (*pt || *ct) {
+        LOG_ERR(("Plain text and cipher text differ in length!\n"));
+        px_free(*expect);
+        *expect = NULL;
+        return -1;
+    }
+
+    return n;
+}
+
+/*
+ * Searches all completions of a partially known key.
+ * See header.
+ */
+int px_search(
+    const card *deck,
+    const card *expect,
+    const int n,
+    const int nthreads,
+    struct px_searchres *res) {
+
+    struct search s;
+    char used[55];
+    unsigned long njobs;
+    double t;
+    int i, ret;
+
+    memset(res, 0, sizeof(*res));
+    memset(used, 0, sizeof(used));
+    memcpy(s.deck, deck, 54);
+    s.expect = expect;
+    s.n = n;
+    s.keys = NULL;
+    s.nkeys = 0;
+    s.k = 0;
+
+    for (i = 0; i < 54; i++) {
+        if (deck[i] < 0 || deck[i] > 54 || (deck[i] && used[(int)deck[i]])) {
+            LOG_ERR(("Invalid or duplicate card at position %i!\n", i + 1));
+            return -1;
+        }
+        used[(int)deck[i]] = 1;
+        if (!deck[i]) s.slots[s.k++] = i;
+    }
+
+    for (i = 1, ret = 0; i <= 54; i++) {
+        if (!used[i]) s.missing[ret++] = i;
+    }
+
+    /* k! must be countable. */
+    s.total = 1;
+    for (i = 2; i <= s.k; i++) {
+        if (s.total > (unsigned long)-1 / i) {
+            LOG_ERR(("Too many unknown cards!\n"));
+            return -1;
+        }
+        s.total *= i;
+    }
+
+    njobs = s.total < PX_MAXJOBS ? s.total : PX_MAXJOBS;
+    s.perjob = (s.total + njobs - 1) / njobs;
+    njobs = (s.total + s.perjob - 1) / s.perjob;
+
+    LOG_INF(("Searching %lu candidates for %i unknown cards.\n",
+        s.total, s.k));
+
+    pthread_mutex_init(&s.lock, NULL);
+    t = px_now();
+    ret = px_pfor(njobs, nthreads, _searchjob, &s);
+    res->seconds = px_now() - t;
+    pthread_mutex_destroy(&s.lock);
+
+    /* The workers do not use the allocator of the caller. */
+    if (!ret && s.nkeys) {
+        res->keys = px_malloc((size_t)s.nkeys * 54);
+        if (res->keys) {
+            memcpy(res->keys, s.keys, (size_t)s.nkeys * 54);
+            res->nkeys = s.nkeys;
+        } else {
+            LOG_ERR(("Internal memory error!\n"));
+            ret = -1;
+        }
+    }
+    free(s.keys);
+
+    res->candidates = s.total;
+    return ret;
+}
+
+/*
+ * Open search nodes of one thread of px_solve(). The owner works on
+ * the newest node, thieves take the oldest.
+ */
+struct deque {
+    pthread_mutex_t lock;
+    card *nodes; /* partial decks, cap * 54 cards */
+    size_t lo, hi, cap; /* the nodes in [lo, hi) are open */
+};
+
+/*
+ * Shared state of px_solve().
+ */
+struct solve {
+    const card *expect;
+    int n;
+    int nthreads;
+    int maxdecks;
+    struct deque *dq; /* one per thread */
+    unsigned long pending; /* nodes pushed, but not yet expanded */
+    unsigned long nodes;
+    unsigned long steals;
+    int stop; /* set when enough decks were found, or on failure */
+    int failed;
+    pthread_mutex_t lock; /* guards decks */
+    card *decks; /* found by the workers, ndecks * 54 cards */
+    int ndecks;
+};
+
+/*
+ * Moves an item of a played deck, like px_move() of px_crypto.c.
+ */
+static void _smove(int *d, const int from, const int to) {
+    int c = d[from], i;
+
+    if (from < to) {
+        for (i = from; i < to; i++) d[i] = d[i + 1];
+    } else {
+        for (i = from; i > to; i--) d[i] = d[i - 1];
+    }
+    d[to] = c;
+}
+
+/*
+ * Writes the children of a node, which assign each card of cards to
+ * the slot, or the card to each unknown slot if slot is negative.
+ *
+ * \returns The number of children.
+ */
+static int _children(const card *deck, const int slot, const card c,
+        const card *cards, const int ncards, card *kids) {
+    int i, k = 0;
+
+    if (slot < 0) {
+        for (i = 0; i < 54; i++) {
+            if (deck[i]) continue;
+            memcpy(kids + k * 54, deck, 54);
+            kids[k++ * 54 + i] = c;
+        }
+    } else {
+        for (i = 0; i < ncards; i++) {
+            memcpy(kids + k * 54, deck, 54);
+            kids[k++ * 54 + slot] = cards[i];
+        }
+    }
+
+    return k;
+}
+
+/*
+ * Plays the rounds of the expected key stream on a partial deck, with
+ * each unknown card played as -(slot + 1), until a round contradicts
+ * the key stream or needs an unknown card. In the latter case, the
+ * children of the node assign that card.
+ *
+ * \param deck  The partial deck, 0 for unknown cards.
+ * \param kids  out: The children, up to 54 decks.
+ *
+ * \returns The number of children, 0 if the deck contradicts the key
+ *          stream, -1 if it reproduces all of it.
+ */
+static int _branch(const struct solve *s, const card *deck, card *kids) {
+    int d[54], b[54];
+    card missing[54], cand[2];
+    char used[55];
+    int i, j, k, nmissing = 0, ja, jb, j1, j2, v, o, e, ncand;
+
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < 54; i++) {
+        d[i] = deck[i] ? deck[i] : -(i + 1);
+        used[(int)deck[i]] = 1;
+    }
+    for (i = 1; i <= 54; i++) {
+        if (!used[i]) missing[nmissing++] = i;
+    }
+
+    for (k = 0; k < s->n; ) {
+        e = s->expect[k];
+
+        /* move the jokers, if they are placed */
+        for (ja = 0; ja < 54 && d[ja] != 53; ja++);
+        if (ja == 54) return _children(deck, -1, 53, NULL, 0, kids);
+        _smove(d, ja, ja % 53 + 1);
+
+        for (jb = 0; jb < 54 && d[jb] != 54; jb++);
+        if (jb == 54) return _children(deck, -1, 54, NULL, 0, kids);
+        _smove(d, jb, (jb % 53 + 1) % 53 + 1);
+
+        /* triple cut */
+        for (ja = 0; d[ja] != 53; ja++);
+        for (jb = 0; d[jb] != 54; jb++);
+        j1 = ja < jb ? ja : jb;
+        j2 = ja > jb ? ja : jb;
+        memcpy(b, d + j2 + 1, (53 - j2) * sizeof(int));
+        memcpy(b + 53 - j2, d + j1, (j2 - j1 + 1) * sizeof(int));
+        memcpy(b + 54 - j1, d, j1 * sizeof(int));
+
+        /* count cut by the bottom card */
+        v = b[53];
+        if (v < 0) {
+            return _children(deck, -v - 1, 0, missing, nmissing, kids);
+        }
+        if (v > 53) v = 53;
+        memcpy(d, b + v, (53 - v) * sizeof(int));
+        memcpy(d + 53 - v, b, v * sizeof(int));
+        d[53] = b[53];
+
+        /* the top card points to the output card */
+        v = d[0];
+        if (v < 0) {
+            /* drop top cards that point to a contradicting card */
+            for (i = j = 0; i < nmissing; i++) {
+                o = d[missing[i] < 53 ? missing[i] : 53];
+                if (o > 0 && o <= 52 && (o - 1) % 26 + 1 != e) continue;
+                if (o < 0 && used[e] && used[e + 26]) continue;
+                memcpy(kids + j * 54, deck, 54);
+                kids[j++ * 54 - v - 1] = missing[i];
+            }
+            return j;
+        }
+
+        o = d[v < 53 ? v : 53];
+        if (o < 0) {
+            /* both jokers are placed, so it is a card of the letter */
+            ncand = 0;
+            if (!used[e]) cand[ncand++] = e;
+            if (!used[e + 26]) cand[ncand++] = e + 26;
+            return _children(deck, -o - 1, 0, cand, ncand, kids);
+        }
+
+        if (o > 52) continue; /* jokers are skipped */
+        if ((o - 1) % 26 + 1 != e) return 0;
+        k++;
+    }
+
+    return -1;
+}
+
+/*
+ * Compares two decks for qsort().
+ */
+static int _cmpdeck(const void *a, const void *b) {
+    return memcmp(a, b, 54);
+}
+
+/*
+ * Adds a node to the deque of a thread.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _push(struct deque *q, const card *nodes, const int n) {
+    card *tmp;
+    size_t cap;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->lo == q->hi) q->lo = q->hi = 0;
+    if (q->hi + n > q->cap) {
+        cap = q->cap * 2 >= q->hi + n ? q->cap * 2 : q->hi + n;
+        tmp = realloc(q->nodes, cap * 54);
+        if (!tmp) {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        q->nodes = tmp;
+        q->cap = cap;
+    }
+    memcpy(q->nodes + q->hi * 54, nodes, (size_t)n * 54);
+    q->hi += n;
+    pthread_mutex_unlock(&q->lock);
+
+    return 0;
+}
+
+/*
+ * Takes the newest node of the deque, or the oldest if steal is set.
+ *
+ * \returns 1 if a node was taken, 0 if the deque is empty.
+ */
+static int _pop(struct deque *q, card *node, const int steal) {
+    int ret = 0;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->lo < q->hi) {
+        if (steal) {
+            memcpy(node, q->nodes + q->lo++ * 54, 54);
+        } else {
+            memcpy(node, q->nodes + --q->hi * 54, 54);
+        }
+        ret = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return ret;
+}
+
+/*
+ * Adds a deck to the result.
+ */
+static void _solution(struct solve *s, const card *deck) {
+    card *tmp;
+
+    pthread_mutex_lock(&s->lock);
+    if (!s->maxdecks || s->ndecks < s->maxdecks) {
+        tmp = realloc(s->decks, (s->ndecks + 1) * 54);
+        if (tmp) {
+            s->decks = tmp;
+            memcpy(s->decks + s->ndecks * 54, deck, 54);
+            s->ndecks++;
+        } else {
+            LOG_ERR(("Internal memory error!\n"));
+            STORE_REL(&s->failed, 1);
+            STORE_REL(&s->stop, 1);
+        }
+    }
+    if (s->maxdecks && s->ndecks >= s->maxdecks) {
+        STORE_REL(&s->stop, 1);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * Works on the nodes of one thread, and steals nodes of the other
+ * threads when it runs out of them, until no node is pending.
+ */
+static void _solvejob(void *ctx, int t) {
+    struct solve *s = ctx;
+    card node[54], kids[54 * 54];
+    unsigned long nodes = 0, steals = 0;
+    int i, k;
+
+    while (!LOAD_ACQ(&s->stop)) {
+        if (!_pop(&s->dq[t], node, 0)) {
+            for (i = 1; i < s->nthreads; i++) {
+                if (_pop(&s->dq[(t + i) % s->nthreads], node, 1)) break;
+            }
+            if (i >= s->nthreads) {
+                if (!LOAD_ACQ(&s->pending)) break;
+                sched_yield();
+                continue;
+            }
+            steals++;
+        }
+
+        nodes++;
+        k = _branch(s, node, kids);
+        if (k < 0) {
+            _solution(s, node);
+        } else if (k > 0) {
+            /* children are pending before their parent is done */
+            __atomic_add_fetch(&s->pending, k, __ATOMIC_ACQ_REL);
+            if (_push(&s->dq[t], kids, k)) {
+                LOG_ERR(("Internal memory error!\n"));
+                STORE_REL(&s->failed, 1);
+                STORE_REL(&s->stop, 1);
+            }
+        }
+        __atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL);
+    }
+
+    __atomic_add_fetch(&s->nodes, nodes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->steals, steals, __ATOMIC_RELAXED);
+}
+
+/*
+ * Finds the states of a partially known deck that produce a key
+ * stream.
+ * See header.
+ */
+int px_solve(
+    const card *deck,
+    const card *expect,
+    const int n,
+    const int nthreads,
+    const int maxdecks,
+    struct px_solveres *res) {
+
+    struct solve s;
+    char used[55];
+    double t;
+    int i, ret = -1;
+
+    if (deck == NULL || (expect == NULL && n > 0) || res == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [9c21]\n"));
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < 54; i++) {
+        if (deck[i] < 0 || deck[i] > 54 || (deck[i] && used[(int)deck[i]])) {
+            LOG_ERR(("Invalid or duplicate card at position %i!\n", i + 1));
+            return -1;
+        }
+        used[(int)deck[i]] = 1;
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.expect = expect;
+    s.n = n;
+    s.nthreads = nthreads > 0 ? nthreads : px_ncpus();
+    s.maxdecks = maxdecks;
+
+    s.dq = calloc(s.nthreads, sizeof(*s.dq));
+    if (!s.dq) {
+        LOG_ERR(("Internal memory error!\n"));
+        return -1;
+    }
+    for (i = 0; i < s.nthreads; i++) {
+        pthread_mutex_init(&s.dq[i].lock, NULL);
+    }
+    for (i = 0; i < s.nthreads; i++) {
+        s.dq[i].cap = PX_DEQUEMIN;
+        s.dq[i].nodes = malloc(PX_DEQUEMIN * 54);
+        if (!s.dq[i].nodes) {
+            LOG_ERR(("Internal memory error!\n"));
+            goto cleanup;
+        }
+    }
+    pthread_mutex_init(&s.lock, NULL);
+
+    /* the root is the partial deck itself */
+    _push(&s.dq[0], deck, 1);
+    s.pending = 1;
+
+    t = px_now();
+    ret = px_pfor(s.nthreads, s.nthreads, _solvejob, &s);
+    res->seconds = px_now() - t;
+    pthread_mutex_destroy(&s.lock);
+
+    if (s.failed) ret = -1;
+    res->complete = !s.pending;
+    res->nodes = s.nodes;
+    res->steals = s.steals;
+
+    /* The workers do not use the allocator of the caller. */
+    if (!ret && s.ndecks) {
+        qsort(s.decks, s.ndecks, 54, _cmpdeck);
+        res->decks = px_malloc((size_t)s.ndecks * 54);
+        if (res->decks) {
+            memcpy(res->decks, s.decks, (size_t)s.ndecks * 54);
+            res->ndecks = s.ndecks;
+        } else {
+            LOG_ERR(("Internal memory error!\n"));
+            ret = -1;
+        }
+    }
+
+cleanup:
+    for (i = 0; i < s.nthreads; i++) {
+        pthread_mutex_destroy(&s.dq[i].lock);
+        if (s.dq[i].nodes) free(s.dq[i].nodes);
+    }
+    free(s.dq);
+    free(s.decks);
+
+    return ret;
+}
+
+/*
+ * Tests passwords against a key stream.
+ * See header.
+ */
+int px_pwmatch(
+    const char * const *passwords,
+    const int n,
+    const card *expect,
+    const int nexpect,
+    const int mvjokers,
+    const int nthreads,
+    char *match) {
+
+    card *keys;
+    int i, found = 0;
+
+    if (passwords == NULL || expect == NULL || match == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [4b7e]\n"));
+        return -1;
+    }
+
+    if (n <= 0) return 0;
+
+    keys = malloc((size_t)n * 54);
+    if (!keys) {
+        LOG_ERR(("Internal memory error!\n"));
+        return -1;
+    }
+
+    if (px_keygens(passwords, n, mvjokers, keys, nthreads)) {
+        free(keys);
+        return -1;
+    }
+
+    /* Candidate keys are no secrets, see px_ksmatch(). */
+    for (i = 0; i < n; i++) {
+        match[i] = px_ksmatch(keys + i * 54, expect, nexpect) == nexpect;
+        found += match[i];
+    }
+
+    free(keys);
+    return found;
+}
+
+#undef PX_MAXJOBS
+#undef PX_DEQUEMIN
+#undef LOAD_ACQ
+#undef STORE_REL
@@ -0,0 +1,151 @@
+#ifndef PX_ATTACK__H_
+#define PX_ATTACK__H_
+
+/*
+ *  px_attack.h : declares the search for partially known keys with a
+ *                known plain text.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "./px_common.h"
+#include "./px_alloc.h"
+
+/**
+ * Result of a search.
+ */
+struct px_searchres {
+    card *keys; /* the keys that match the crib, nkeys * 54 cards */
+    int nkeys;
+    unsigned long candidates; /* number of tested keys */
+    double seconds; /* wall clock time of the search */
+};
+
+/**
+ * Result of px_solve().
+ */
+struct px_solveres {
+    card *decks; /* ndecks partial decks, 0 for unconstrained cards */
+    int ndecks;
+    int complete; /* 1 if all decks were found, 0 if stopped early */
+    unsigned long nodes; /* search nodes expanded */
+    unsigned long steals; /* nodes that threads took from others */
+    double seconds; /* wall clock time of the search */
+};
+
+/**
+ * Derives the key stream from a crib, a known pair of plain text and
+ * cipher text. Non-alphabetic characters are ignored.
+ *
+ * \param pt      The plain text, 0-terminated.
+ * \param ct      The cipher text, 0-terminated.
+ * \param expect  out: Pointer to the allocated key stream, as numbers
+ *                1-26 (see px_ksmatch()).
+ *
+ * \returns The length of the key stream, -1 if the texts do not have
+ *          the same number of letters or on failure.
+ */
+int px_crib(const char *pt, const char *ct, card **expect);
+
+/**
+ * Searches all completions of a partially known key for the ones that
+ * reproduce a key stream.
+ *
+ * The k unknown slots are filled with all k! orders of the missing
+ * cards. The completions are numbered by their permutation rank, and
+ * ranges of ranks are distributed over the threads. Each candidate is
+ * dropped as soon as its key stream differs from the expected one.
+ *
+ * \param deck      The partial key. Unknown slots are 0.
+ * \param expect    The expected key stream, see px_crib().
+ * \param n         Length of the expected key stream.
+ * \param nthreads  Number of threads, 0 for one per processor.
+ * \param res       out: The result. res->keys needs to be freed by
+ *                  px_free().
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_search(
+    const card *deck,
+    const card *expect,
+    const int n,
+    const int nthreads,
+    struct px_searchres *res);
+
+/**
+ * Finds the states of a partially known deck that produce a key
+ * stream, without trying all completions like px_search().
+ *
+ * The rounds of the key stream are played on the partial deck. Where
+ * a round needs an unknown card, the search branches: on the position
+ * of a joker, on the bottom card of the count cut, on the top card,
+ * and on the output card. The output card has to match the next key
+ * stream letter, so only two cards are left for it, and top cards
+ * that point to a known, contradicting output card are dropped.
+ * Branches end at the first contradiction.
+ *
+ * Each result is a partial deck that reproduces the whole key stream,
+ * whichever way its unknown cards are completed. The threads keep
+ * their open branches in deques, and idle threads steal the oldest
+ * branches of others, which are the largest subtrees.
+ *
+ * \param deck      The partial key. Unknown slots are 0.
+ * \param expect    The expected key stream, see px_crib().
+ * \param n         Length of the expected key stream.
+ * \param nthreads  Number of threads, 0 for one per processor.
+ * \param maxdecks  Stop after this many decks, 0 for no limit.
+ * \param res       out: The result, res->decks sorted by memcmp().
+ *                  res->decks needs to be freed by px_free().
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_solve(
+    const card *deck,
+    const card *expect,
+    const int n,
+    const int nthreads,
+    const int maxdecks,
+    struct px_solveres *res);
+
+/**
+ * Tests passwords against a key stream. The key of each password is
+ * generated by px_keygens(), then compared by px_ksmatch().
+ *
+ * \param passwords Pointers to n zero-terminated passwords.
+ * \param n         Number of passwords.
+ * \param expect    The expected key stream, see px_crib().
+ * \param nexpect   Length of the expected key stream.
+ * \param mvjokers  Boolean flag that defines if the jokers shall be moved
+ *                  on key generation.
+ * \param nthreads  Number of threads, 0 for one per processor.
+ * \param match     out: n flags, 1 for the passwords whose key
+ *                  reproduces the key stream, 0 for the others.
+ *
+ * \returns The number of matching passwords, -1 on failure.
+ */
+int px_pwmatch(
+    const char * const *passwords,
+    const int n,
+    const card *expect,
+    const int nexpect,
+    const int mvjokers,
+    const int nthreads,
+    char *match);
+
+#endif
+
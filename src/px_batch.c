@@ -0,0 +1,733 @@
+/*
+ *  px_batch.c : Implementation of the batch processing of many files.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__GNUC__) && !defined(PX_NO_URING)
+#define PX_HAVE_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "./px_alloc.h"
+#include "./px_batch.h"
+#include "./px_par.h"
+#include "./px_trace.h"
+#include "./logging.h"
+
+/*
+ * An arena of the pool of a batch, see _bartake().
+ */
+struct barena {
+    struct px_arena arena;
+    struct barena *next; /* all arenas of the batch */
+    struct barena *idle; /* next idle arena */
+};
+
+/*
+ * One file of a batch. The buffer holds the input first, and the
+ * output after the transformation. Both are allocated from the arena
+ * of the file.
+ */
+struct bfile {
+    int fd;
+    struct barena *ar;
+    char *buf;
+    int nbuf; /* length of buf, -1 if the file failed */
+    int done; /* bytes read or written so far */
+    struct iovec iov;
+};
+
+/*
+ * Shared state of a batch run.
+ */
+struct batch {
+    char * const *inpaths;
+    char * const *outpaths;
+    struct bfile *files;
+    int n;
+    px_batchfn fn;
+    void *ctx;
+    pthread_mutex_t arlock; /* guards the pool of arenas */
+    struct barena *arenas;
+    struct barena *idle;
+};
+
+/*
+ * Takes an idle arena from the pool, or creates one.
+ *
+ * \returns The arena, NULL if out of memory.
+ */
+static struct barena *_bartake(struct batch *b) {
+    struct barena *a;
+
+    pthread_mutex_lock(&b->arlock);
+    a = b->idle;
+    if (a) b->idle = a->idle;
+    pthread_mutex_unlock(&b->arlock);
+    if (a) return a;
+
+    a = malloc(sizeof(*a));
+    if (!a) return NULL;
+    px_arinit(&a->arena);
+
+    pthread_mutex_lock(&b->arlock);
+    a->next = b->arenas;
+    b->arenas = a;
+    pthread_mutex_unlock(&b->arlock);
+    return a;
+}
+
+/*
+ * Resets an arena and puts it back into the pool.
+ */
+static void _barput(struct batch *b, struct barena *a) {
+    px_arreset(&a->arena);
+
+    pthread_mutex_lock(&b->arlock);
+    a->idle = b->idle;
+    b->idle = a;
+    pthread_mutex_unlock(&b->arlock);
+}
+
+/*
+ * Opens an input file and allocates the buffer for its content.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _bopenin(struct batch *b, int i) {
+    struct bfile *f = &b->files[i];
+    struct stat st;
+
+    f->done = 0;
+    PX_TRACE1(batch_open, i);
+    f->fd = open(b->inpaths[i], O_RDONLY);
+    if (f->fd < 0) {
+        LOG_ERR(("Could not open '%s'!\n", b->inpaths[i]));
+        return -1;
+    }
+
+    if (fstat(f->fd, &st) || st.st_size >= 0x7fffffff) {
+        LOG_ERR(("Could not read '%s'!\n", b->inpaths[i]));
+        close(f->fd);
+        return -1;
+    }
+
+    f->nbuf = (int)st.st_size;
+    f->ar = _bartake(b);
+    f->buf = f->ar ? px_aralloc(&f->ar->arena, f->nbuf + 1) : NULL;
+    if (!f->buf) {
+        LOG_ERR(("Internal memory error!\n"));
+        if (f->ar) _barput(b, f->ar);
+        f->ar = NULL;
+        close(f->fd);
+        return -1;
+    }
+    f->buf[f->nbuf] = '\0';
+
+    return 0;
+}
+
+/*
+ * Opens an output file.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _bopenout(struct batch *b, int i) {
+    struct bfile *f = &b->files[i];
+
+    f->done = 0;
+    f->fd = open(b->outpaths[i], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (f->fd < 0) {
+        LOG_ERR(("Could not open '%s'!\n", b->outpaths[i]));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Replaces the input of a file by the transformed output.
+ */
+static void _btransform(struct batch *b, int i) {
+    struct bfile *f = &b->files[i];
+    const struct px_allocator *prev;
+    char *out = NULL;
+
+    f->buf[f->done] = '\0'; /* the file may have shrunk meanwhile */
+
+    /* The temporaries of fn and its result come from the arena. */
+    prev = px_set_allocator(&f->ar->arena.hooks);
+    f->nbuf = b->fn(b->ctx, f->buf, f->done, &out);
+    px_set_allocator(prev);
+    f->buf = out;
+
+    if (f->nbuf < 0) {
+        LOG_ERR(("Could not process '%s'.\n", b->inpaths[i]));
+        f->buf = NULL;
+    }
+}
+
+/*
+ * Releases the buffers of a file by resetting its arena.
+ */
+static void _bfree(struct batch *b, struct bfile *f) {
+    if (f->ar) _barput(b, f->ar);
+    f->ar = NULL;
+    f->buf = NULL;
+}
+
+/*
+ * =============  Thread backend ================
+ */
+
+/*
+ * Processes one file with blocking I/O.
+ */
+static void _tfile(void *ctx, int i) {
+    struct batch *b = ctx;
+    struct bfile *f = &b->files[i];
+    ssize_t res;
+
+    if (_bopenin(b, i)) {
+        f->nbuf = -1;
+        return;
+    }
+
+    while (f->done < f->nbuf) {
+        res = read(f->fd, f->buf + f->done, f->nbuf - f->done);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) break;
+        f->done += res;
+    }
+    close(f->fd);
+    PX_TRACE2(batch_read, i, f->done);
+
+    _btransform(b, i);
+    if (f->nbuf < 0) goto clean;
+
+    if (_bopenout(b, i)) {
+        f->nbuf = -1;
+        goto clean;
+    }
+
+    while (f->done < f->nbuf) {
+        res = write(f->fd, f->buf + f->done, f->nbuf - f->done);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) {
+            LOG_ERR(("Could not write '%s'!\n", b->outpaths[i]));
+            f->nbuf = -1;
+            break;
+        }
+        f->done += res;
+    }
+    close(f->fd);
+    PX_TRACE2(batch_write, i, f->nbuf);
+
+clean:
+    _bfree(b, f);
+}
+
+/*
+ * Runs the batch on blocking threads.
+ * More threads than processors are used, so the cipher work of some
+ * files overlaps with the I/O of others.
+ */
+static int _tbatch(struct batch *b, int nthreads) {
+    if (nthreads <= 0) nthreads = px_ncpus();
+    return px_pfor(b->n, 2 * nthreads, _tfile, b);
+}
+
+/*
+ * =============  io_uring backend ================
+ */
+
+#ifdef PX_HAVE_URING
+
+#define PX_QDEPTH 32 /* files in flight */
+#define PX_EFDTAG (~(__u64)0) /* user data of the worker notifications */
+
+#define LOAD_ACQ(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*
+ * Mapped io_uring instance.
+ */
+struct uring {
+    int fd;
+    void *sq, *cq; /* ring mappings */
+    size_t nsq, ncq; /* mapping sizes */
+    struct io_uring_sqe *sqes;
+    size_t nsqes;
+    unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+    unsigned *cqhead, *cqtail, *cqmask;
+    struct io_uring_cqe *cqes;
+    unsigned entries;
+    unsigned pending; /* prepared but not yet submitted */
+};
+
+/*
+ * Work queues between the I/O thread and the workers.
+ * Every file enters each queue once, so plain arrays suffice.
+ */
+struct uqueues {
+    struct batch *b;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int *work, nwork, nextwork; /* files to transform */
+    int *done, ndone, nextdone; /* transformed files */
+    int stop;
+    int efd; /* eventfd to wake up the I/O thread */
+};
+
+static void _uclose(struct uring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->nsqes);
+    if (r->cq && r->cq != MAP_FAILED && r->cq != r->sq) munmap(r->cq, r->ncq);
+    if (r->sq && r->sq != MAP_FAILED) munmap(r->sq, r->nsq);
+    close(r->fd);
+}
+
+/*
+ * Sets up and maps a ring.
+ *
+ * \returns 0 on success, -1 if io_uring is not available.
+ */
+static int _uinit(struct uring *r, unsigned entries) {
+    struct io_uring_params p;
+
+    memset(r, 0, sizeof(*r));
+    memset(&p, 0, sizeof(p));
+
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    r->entries = p.sq_entries;
+    r->nsq = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->ncq = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->ncq > r->nsq) r->nsq = r->ncq;
+        r->ncq = r->nsq;
+    }
+
+    r->sq = mmap(NULL, r->nsq, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq == MAP_FAILED) goto fail;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq = r->sq;
+    } else {
+        r->cq = mmap(NULL, r->ncq, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq == MAP_FAILED) goto fail;
+    }
+
+    r->nsqes = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->nsqes, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    r->sqhead = (unsigned *)((char *)r->sq + p.sq_off.head);
+    r->sqtail = (unsigned *)((char *)r->sq + p.sq_off.tail);
+    r->sqmask = (unsigned *)((char *)r->sq + p.sq_off.ring_mask);
+    r->sqarray = (unsigned *)((char *)r->sq + p.sq_off.array);
+    r->cqhead = (unsigned *)((char *)r->cq + p.cq_off.head);
+    r->cqtail = (unsigned *)((char *)r->cq + p.cq_off.tail);
+    r->cqmask = (unsigned *)((char *)r->cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq + p.cq_off.cqes);
+
+    return 0;
+
+fail:
+    _uclose(r);
+    return -1;
+}
+
+/*
+ * Queues a readv/writev request. The ring is sized so that it
+ * can never run full.
+ */
+static void _uprep(
+    struct uring *r,
+    int op,
+    int fd,
+    struct iovec *iov,
+    __u64 off,
+    __u64 data) {
+
+    struct io_uring_sqe *sqe;
+    unsigned tail, idx;
+
+    tail = *r->sqtail;
+    idx = tail & *r->sqmask;
+    sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->off = off;
+    sqe->addr = (unsigned long)iov;
+    sqe->len = 1;
+    sqe->user_data = data;
+
+    r->sqarray[idx] = idx;
+    STORE_REL(r->sqtail, tail + 1);
+    r->pending++;
+}
+
+/*
+ * Submits all queued requests and waits for at least one completion.
+ */
+static int _uwait(struct uring *r) {
+    long res;
+
+    do {
+        res = syscall(__NR_io_uring_enter, r->fd, r->pending, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0);
+    } while (res < 0 && errno == EINTR);
+
+    if (res < 0) return -1;
+
+    r->pending -= res;
+    return 0;
+}
+
+/*
+ * Worker thread: transforms files until the I/O thread stops.
+ */
+static void *_uworker(void *arg) {
+    struct uqueues *q = arg;
+    __u64 one = 1;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (q->nextwork == q->nwork && !q->stop) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        if (q->nextwork == q->nwork) {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        i = q->work[q->nextwork++];
+        pthread_mutex_unlock(&q->lock);
+
+        _btransform(q->b, i);
+
+        pthread_mutex_lock(&q->lock);
+        q->done[q->ndone++] = i;
+        pthread_mutex_unlock(&q->lock);
+
+        if (write(q->efd, &one, sizeof(one)) < 0) {
+            LOG_ERR(("Could not notify I/O thread. [3f0a]\n"));
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Hands a completely read file over to the workers.
+ */
+static void _upush(struct uqueues *q, int i) {
+    pthread_mutex_lock(&q->lock);
+    q->work[q->nwork++] = i;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/*
+ * Queues the next read or write of a file.
+ */
+static void _uiofile(struct uring *r, struct bfile *f, int i, int op) {
+    f->iov.iov_base = f->buf + f->done;
+    f->iov.iov_len = f->nbuf - f->done;
+    _uprep(r, op, f->fd, &f->iov, f->done, (__u64)i * 2 + (op == IORING_OP_WRITEV));
+}
+
+/*
+ * The I/O loop: Keeps reads and writes of up to PX_QDEPTH files in
+ * flight and passes the file contents to and from the workers.
+ */
+static int _uloop(struct uring *r, struct uqueues *q) {
+    struct batch *b = q->b;
+    struct bfile *f;
+    struct io_uring_cqe *cqe;
+    __u64 evbuf;
+    struct iovec eviov;
+    unsigned head;
+    int next = 0, /* next file to open */
+        active = 0, /* files in flight */
+        finished = 0,
+        i, res;
+
+    eviov.iov_base = &evbuf;
+    eviov.iov_len = sizeof(evbuf);
+    _uprep(r, IORING_OP_READV, q->efd, &eviov, 0, PX_EFDTAG);
+
+    while (finished < b->n) {
+        /* Start reading more files. */
+        while (next < b->n && active < PX_QDEPTH) {
+            i = next++;
+            f = &b->files[i];
+            if (_bopenin(b, i)) {
+                f->nbuf = -1;
+                finished++;
+                continue;
+            }
+            active++;
+
+            if (f->nbuf == 0) {
+                close(f->fd);
+                _upush(q, i);
+            } else {
+                _uiofile(r, f, i, IORING_OP_READV);
+            }
+        }
+
+        if (finished == b->n) break;
+
+        if (_uwait(r)) {
+            LOG_ERR(("io_uring failure! [b71d]\n"));
+            return -1;
+        }
+
+        /* Reap completions */
+        head = *r->cqhead;
+        while (head != LOAD_ACQ(r->cqtail)) {
+            cqe = &r->cqes[head & *r->cqmask];
+            res = cqe->res;
+
+            if (cqe->user_data == PX_EFDTAG) {
+                /* Workers have finished files, write them. */
+                pthread_mutex_lock(&q->lock);
+                while (q->nextdone < q->ndone) {
+                    i = q->done[q->nextdone++];
+                    f = &b->files[i];
+                    if (f->nbuf < 0 || _bopenout(b, i)) {
+                        f->nbuf = -1;
+                        _bfree(b, f);
+                        finished++;
+                        active--;
+                    } else if (f->nbuf == 0) {
+                        close(f->fd);
+                        _bfree(b, f);
+                        finished++;
+                        active--;
+                    } else {
+                        _uiofile(r, f, i, IORING_OP_WRITEV);
+                    }
+                }
+                pthread_mutex_unlock(&q->lock);
+
+                _uprep(r, IORING_OP_READV, q->efd, &eviov, 0, PX_EFDTAG);
+            } else if (cqe->user_data % 2 == 0) {
+                /* read completion */
+                i = cqe->user_data / 2;
+                f = &b->files[i];
+                if (res < 0) {
+                    LOG_ERR(("Could not read '%s'!\n", b->inpaths[i]));
+                    close(f->fd);
+                    f->nbuf = -1;
+                    _bfree(b, f);
+                    finished++;
+                    active--;
+                } else if (res > 0 && (f->done += res) < f->nbuf) {
+                    _uiofile(r, f, i, IORING_OP_READV); /* short read */
+                } else {
+                    close(f->fd);
+                    PX_TRACE2(batch_read, i, f->done);
+                    _upush(q, i);
+                }
+            } else {
+                /* write completion */
+                i = cqe->user_data / 2;
+                f = &b->files[i];
+                if (res > 0 && (f->done += res) < f->nbuf) {
+                    _uiofile(r, f, i, IORING_OP_WRITEV); /* short write */
+                } else {
+                    if (res <= 0) {
+                        LOG_ERR(("Could not write '%s'!\n", b->outpaths[i]));
+                        f->nbuf = -1;
+                    }
+                    close(f->fd);
+                    PX_TRACE2(batch_write, i, f->nbuf);
+                    _bfree(b, f);
+                    finished++;
+                    active--;
+                }
+            }
+
+            head++;
+            STORE_REL(r->cqhead, head);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Runs the batch on io_uring.
+ *
+ * \returns the result of the loop, -2 if io_uring is not available.
+ */
+static int _ubatch(struct batch *b, int nthreads) {
+    pthread_t threads[64];
+    struct uring r;
+    struct uqueues q;
+    int i, started = 0, ret = -1;
+
+    if (_uinit(&r, 2 * PX_QDEPTH)) return -2;
+
+    memset(&q, 0, sizeof(q));
+    q.b = b;
+    q.efd = eventfd(0, 0);
+    q.work = malloc(b->n * sizeof(int));
+    q.done = malloc(b->n * sizeof(int));
+    if (q.efd < 0 || !q.work || !q.done) {
+        LOG_ERR(("Could not set up batch queues. [c55e]\n"));
+        goto clean;
+    }
+
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.cond, NULL);
+
+    if (nthreads <= 0) nthreads = px_ncpus();
+    if (nthreads > 64) nthreads = 64;
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, _uworker, &q)) break;
+        started++;
+    }
+
+    if (started) {
+        ret = _uloop(&r, &q);
+    } else {
+        LOG_ERR(("Could not start worker threads.\n"));
+    }
+
+    pthread_mutex_lock(&q.lock);
+    q.stop = 1;
+    pthread_cond_broadcast(&q.cond);
+    pthread_mutex_unlock(&q.lock);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&q.cond);
+    pthread_mutex_destroy(&q.lock);
+
+clean:
+    _uclose(&r); /* cancels the pending eventfd read */
+    if (q.efd >= 0) close(q.efd);
+    if (q.work) free(q.work);
+    if (q.done) free(q.done);
+    return ret;
+}
+
+#undef LOAD_ACQ
+#undef STORE_REL
+#undef PX_EFDTAG
+#undef PX_QDEPTH
+
+#endif /* PX_HAVE_URING */
+
+/*
+ * =============  Header API implementation ================
+ */
+
+/**
+ * Processes a batch of files.
+ * See header.
+ */
+int px_batch(
+    char * const *inpaths,
+    char * const *outpaths,
+    const int n,
+    const int nthreads,
+    const int backend,
+    px_batchfn fn,
+    void *ctx) {
+
+    struct batch b;
+    struct barena *a;
+    int i, ret = -2, failed = 0;
+
+    b.inpaths = inpaths;
+    b.outpaths = outpaths;
+    b.n = n;
+    b.fn = fn;
+    b.ctx = ctx;
+    b.arenas = NULL;
+    b.idle = NULL;
+    b.files = calloc(n > 0 ? n : 1, sizeof(struct bfile));
+    if (!b.files) {
+        LOG_ERR(("Internal memory error!\n"));
+        return -1;
+    }
+    pthread_mutex_init(&b.arlock, NULL);
+
+#ifdef PX_HAVE_URING
+    if (backend != PX_BIO_THREADS) {
+        ret = _ubatch(&b, nthreads);
+        if (ret == -2) {
+            LOG_INF(("io_uring not available, using threads.\n"));
+        } else {
+            LOG_DBG(("Batch processed with io_uring.\n"));
+        }
+    }
+#endif
+
+    if (ret == -2) {
+        if (backend == PX_BIO_URING) {
+            LOG_ERR(("io_uring not available!\n"));
+            ret = -1;
+        } else {
+            ret = _tbatch(&b, nthreads);
+        }
+    }
+
+    if (ret == 0) {
+        for (i = 0; i < n; i++) {
+            if (b.files[i].nbuf < 0) failed++;
+        }
+        ret = failed;
+    }
+
+    while ((a = b.arenas)) {
+        b.arenas = a->next;
+        px_ardone(&a->arena);
+        free(a);
+    }
+    pthread_mutex_destroy(&b.arlock);
+
+    free(b.files);
+    return ret;
+}
+
@@ -0,0 +1,83 @@
+#ifndef PX_BATCH__H_
+#define PX_BATCH__H_
+
+/*
+ *  px_batch.h : declares the batch processing of many files, which
+ *               overlaps the file I/O with the cipher work.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "./px_alloc.h"
+
+/* I/O backends, see px_batch() */
+#define PX_BIO_AUTO 0
+#define PX_BIO_URING 1
+#define PX_BIO_THREADS 2
+
+/**
+ * Transforms the content of one file.
+ *
+ * \param ctx   Context pointer passed to px_batch().
+ * \param in    The file content, 0-terminated.
+ * \param nin   Length of the file content (0-terminator not included).
+ * \param out   out: Pointer to the result, allocated with px_malloc().
+ *              Freed by px_batch().
+ *
+ * \returns The length of the result, -1 on failure.
+ */
+typedef int (*px_batchfn)(void *ctx, const char *in, int nin, char **out);
+
+/**
+ * Reads all input files, transforms their contents on a pool of
+ * worker threads and writes the results to the output files.
+ *
+ * With the io_uring backend, reads and writes of many files are kept
+ * in flight by a single I/O thread while the workers do the cipher
+ * work. The thread backend uses blocking I/O on more threads than
+ * there are processors, so that I/O and cipher work still overlap.
+ * PX_BIO_AUTO prefers io_uring and falls back to threads if io_uring
+ * is not available.
+ *
+ * Each file gets an arena from a pool for its content and result. fn
+ * runs with that arena as allocator of the thread, see px_alloc.h, so
+ * whatever it allocates is taken back at once after the file is
+ * written, and the arena is reused for the next file.
+ *
+ * \param inpaths   Paths of the input files.
+ * \param outpaths  Paths of the output files, same order.
+ * \param n         Number of files.
+ * \param nthreads  Number of worker threads, 0 for one per processor.
+ * \param backend   I/O backend, one of PX_BIO_*.
+ * \param fn        Transformation function.
+ * \param ctx       Context pointer passed to fn.
+ *
+ * \returns The number of files that failed, -1 if the backend could not
+ *          be started.
+ */
+int px_batch(
+    char * const *inpaths,
+    char * const *outpaths,
+    const int n,
+    const int nthreads,
+    const int backend,
+    px_batchfn fn,
+    void *ctx);
+
+#endif
+
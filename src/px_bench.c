@@ -0,0 +1,67 @@
+/*
+ *  px_bench.c : Compares the speed of the key stream engines.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./logging.h"
+#include "./px_crypto.h"
+#include "./px_stats.h"
+
+int loglevel = LOGLEVEL_ERR;
+
+/*
+ * Generates the key stream of a few keys with every engine and prints
+ * the letters per second. Usage: pxbench [LETTERS]
+ */
+int main(int argc, char **argv) {
+    const char *passwords[] = { "foo", "cryptonomicon", "solitaire" };
+    struct px_opts opts = { 1 };
+    card key[54];
+    char *buf;
+    double t;
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int e, i;
+
+    if (count <= 0) {
+        LOG_ERR(("Usage: pxbench [LETTERS]\n"));
+        return 1;
+    }
+
+    for (e = 0; e < PX_NENGINES; e++) {
+        opts.engine = e;
+        t = px_now();
+
+        for (i = 0; i < 3; i++) {
+            px_keygen(passwords[i], 0, key);
+            if (px_stream(key, count, &buf, &opts)) {
+                LOG_ERR(("Key stream generation failed.\n"));
+                return 1;
+            }
+            free(buf);
+        }
+
+        t = px_now() - t;
+        printf("%-12s %10.0f letters/s\n", px_engname(e), 3 * count / t);
+    }
+
+    return 0;
+}
@@ -24,12 +24,34 @@
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "./px_crypto.h"
+#include "./px_par.h"
+#include "./px_secmem.h"
+#include "./px_stats.h"
+#include "./px_steptab.h"
+#include "./px_trace.h"
 #include "./logging.h"
 
 #define INVALID_CARD (card)254
 
+/* Number of letters that are normalized, get their key stream and
+   are substituted in one go. */
+#define PX_CHUNK 256
+
+/* Number of passwords that px_keygens() interleaves per thread. */
+#define PX_LANES 8
+
+/* Slots of PX_CHUNK key stream letters in the ring of the pipeline,
+   and the shortest message that is worth a second thread. */
+#define PX_RINGSLOTS 16
+#define PX_PIPEMIN (8 * PX_CHUNK)
+
+#define LOAD_ACQ(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
 /*
  * Move a card in the deck to another position.
  * Indices are zero-based.
@@ -66,8 +88,6 @@ static void px_move(card *deck, int oldi, int newi) {
 static int px_mjokers(card *deck) {
     int i, j;
 
-    LOG_DBG(("Move jokers.\n"));
-
     j = -1;
     for (i = 0; i < 54; i++) {
         if (deck[i] == 53) { j = i; break; }
@@ -79,7 +99,7 @@ static int px_mjokers(card *deck) {
     }
 
     i = (j % 53) + 1; /* Move 1 and wrap around if necessary. */
-    LOG_DBG(("Joker A from %i to %i.\n", j, i));
+    PX_TRACE2(joker_a, j, i);
     px_move(deck, j, i);
 
     j = -1;
@@ -94,7 +114,7 @@ static int px_mjokers(card *deck) {
 
     i = (j % 53) + 1;
     i = (i % 53) + 1; /*Joker B needs this twice. */
-    LOG_DBG(("Joker B from %i to %i.\n", j, i));
+    PX_TRACE2(joker_b, j, i);
     px_move(deck, j, i);
 
     return 1;
@@ -103,24 +123,21 @@ static int px_mjokers(card *deck) {
 /*
  * Performs the second solitaire round, which is the triple cut.
  *
- * \param deck  Pointer to the deck, containing numbers 1-54.
+ * \param deck    Pointer to the deck, containing numbers 1-54.
+ * \param buffer  Pointer to 54 cards of scratch memory.
  *
  * \returns 1 on success, 0 on failure.
  */
-static int px_tcut(card *deck) {
+static int px_tcut(card *deck, card *buffer) {
     int i,
         ja = -1, /* joker indices */
         jb = -1,
         j1 = -1,
         j2 = -1;
-    card buffer[54];
     int lp1, lp2, lp3; /* lengths of parts 1-3 */
-    int ret = 0;
-
-    memset(buffer, 0, sizeof(buffer));
 
     /* locate jokers */
-    for (i = 0; i < sizeof(buffer); i++) {
+    for (i = 0; i < 54; i++) {
         if (deck[i] == 53) ja = i;
         if (deck[i] == 54) jb = i;
         if (ja >= 0 && jb >= 0) break;
@@ -128,7 +145,7 @@ static int px_tcut(card *deck) {
 
     if (ja < 0 || jb < 0) {
         LOG_ERR(("Could not locate jokers!\n"));
-        goto clean;
+        return 0;
     }
 
     /* get joker order and sizes of the three parts */
@@ -138,9 +155,7 @@ static int px_tcut(card *deck) {
     lp2 = j2-j1+1;
     lp3 = 53-j2;
 
-    LOG_DBG((
-        "Triple cut:\nj1: %i, j2: %i\nlengths: %i, %i, %i\n",
-        j1, j2, lp1, lp2, lp3));
+    PX_TRACE2(triple_cut, j1, j2);
 
     /* rearrange parts */
     memcpy(buffer, deck+j2+1, lp3);
@@ -148,13 +163,9 @@ static int px_tcut(card *deck) {
     memcpy(buffer+lp2+lp3, deck, lp1);
 
     /* write back to original deck */
-    memcpy(deck, &buffer, sizeof(buffer));
-
-    ret = 1;
+    memcpy(deck, buffer, 54);
 
-clean:
-    memset(&buffer, 0, sizeof(buffer));
-    return ret;
+    return 1;
 }
 
 /*
@@ -165,12 +176,12 @@ clean:
  * \param pwdkey For the encryption and encryption, set the pwdkey to 0.
  *               When generating a key from a password, this needs to be
  *               set to the current password character.
+ *
+ * \param buffer Pointer to 54 cards of scratch memory.
  */
-static void px_ccut(card *deck, char pwdkey) {
-    card buffer[54];
+static void px_ccut(card *deck, char pwdkey, card *buffer) {
     char count;
 
-    memset(buffer, 0, sizeof(buffer));
     buffer[53] = deck[53];
 
     count = pwdkey == 0 ? deck[53] : pwdkey;
@@ -178,11 +189,7 @@ static void px_ccut(card *deck, char pwdkey) {
     /* Both jokers count as 53 */
     count = count == 54 ? 53 : count;
 
-    LOG_DBG((
-        "Count cut:\n"
-        "Inserting %i cards to position %i,"
-        " moving %i cards from position %i to front.\n",
-        count, 53-count, 53-count, count));
+    PX_TRACE1(count_cut, count);
 
     /*
      * Remember that the array indices start from zero,
@@ -194,47 +201,388 @@ static void px_ccut(card *deck, char pwdkey) {
     memcpy(buffer + 53 - count, deck, count);
     memcpy(buffer, deck + count, 53 - count);
 
-    memcpy(deck, &buffer, sizeof(buffer));
-
-    /* Cleanup */
-    memset(&buffer, 0, sizeof(buffer));
+    memcpy(deck, buffer, 54);
 }
 
 /*
- * Returns the next key stream card, while modifying the deck.
- * The returned letter is a number from 1 to 52, not an ASCII char!
+ * Performs one round of the key stream algorithm, while modifying
+ * the deck, and returns the output card.
+ * The returned card is a number from 1 to 54, not an ASCII char!
  *
- * Note that this will never yield a joker card!
+ * Note that the output may be a joker, which is not a valid key
+ * stream letter. See px_ksgen().
  *
- * \param deck  Pointer to the deck, containing numbers 1-54.
+ * \param deck    Pointer to the deck, containing numbers 1-54.
+ * \param buffer  Pointer to 54 cards of scratch memory.
  *
- * \returns values 1-52 normally, INVALID_CARD on error.
+ * \returns values 1-54 normally, INVALID_CARD on error.
  */
-static card px_next(card *deck) {
+static card px_round(card *deck, card *buffer) {
     int offset;
     card next;
 
-    do {
-        if (!px_mjokers(deck)) return INVALID_CARD;
-        if (!px_tcut(deck)) return INVALID_CARD;
-        px_ccut(deck, 0);
-        /* both jokers have the count val of 53. */
-        offset = deck[0] <= 53 ? deck[0] : 53;
-
-        next = deck[offset];
-        if (next > 52) LOG_DBG(("Skipping output: %i\n", next));
-    } while (next > 52);
+    if (!px_mjokers(deck)) return INVALID_CARD;
+    if (!px_tcut(deck, buffer)) return INVALID_CARD;
+    px_ccut(deck, 0, buffer);
+    /* both jokers have the count val of 53. */
+    offset = deck[0] <= 53 ? deck[0] : 53;
 
-    LOG_DBG((
-        "Output: Top card: %i, taking %i from index %i.\n",
-        deck[0], next, offset));
+    next = deck[offset];
 
     return next;
 }
 
+/*
+ * New position of the card at p (p != j), after the card at j was
+ * moved to k. The comparisons yield 0 or 1 and are compiled to flag
+ * moves, not to jumps.
+ */
+#define BF_POS(p, j, k) \
+    ((p) - (((j) < (p)) & ((p) <= (k))) + (((k) <= (p)) & ((p) < (j))))
+
+#ifdef PX_USDT
+/*
+ * Fires the probes of the steps of px_round() for a round of
+ * px_round_tab(), which performs all steps at once. The positions
+ * follow from the ones of the jokers before the round.
+ */
+static void px_trace_tab(int ja, int jb, const int count) {
+    int k, j1;
+
+    k = ja % 53 + 1;
+    PX_TRACE2(joker_a, ja, k);
+    jb = BF_POS(jb, ja, k);
+    ja = k;
+
+    k = (jb % 53 + 1) % 53 + 1;
+    PX_TRACE2(joker_b, jb, k);
+    ja = BF_POS(ja, jb, k);
+    jb = k;
+
+    j1 = ja < jb ? ja : jb;
+    PX_TRACE2(triple_cut, j1, ja ^ jb ^ j1);
+    PX_TRACE1(count_cut, count);
+}
+#endif
+
+/*
+ * Table-driven variant of px_round().
+ *
+ * The joker move and the triple cut are looked up from px_steptab, the
+ * count cut is a rotation of the first 53 cards by the value of the
+ * bottom card. All three are applied as one gather pass from the old
+ * deck into a new one.
+ *
+ * \param deck    Pointer to the deck, containing numbers 1-54.
+ * \param buffer  Pointer to 54 cards of scratch memory.
+ *
+ * \returns values 1-54 normally, INVALID_CARD on error.
+ */
+static card px_round_tab(card *deck, card *buffer) {
+    const unsigned char *g;
+    const card *ja, *jb;
+    int i, count, offset;
+
+    ja = memchr(deck, 53, 54);
+    jb = memchr(deck, 54, 54);
+    if (ja == NULL || jb == NULL) {
+        LOG_ERR(("Could not locate jokers!\n"));
+        return INVALID_CARD;
+    }
+
+    g = px_steptab[ja - deck][jb - deck].gather;
+
+    /* The bottom card stays in place during the count cut. */
+    buffer[53] = deck[g[53]];
+    count = buffer[53] < 53 ? buffer[53] : 53;
+#ifdef PX_USDT
+    px_trace_tab(ja - deck, jb - deck, count);
+#endif
+
+    for (i = 0; i < 53 - count; i++) buffer[i] = deck[g[i + count]];
+    for (; i < 53; i++) buffer[i] = deck[g[i + count - 53]];
+
+    memcpy(deck, buffer, 54);
+
+    /* both jokers have the count val of 53. */
+    offset = deck[0] <= 53 ? deck[0] : 53;
+    return deck[offset];
+}
+
+/*
+ * Branch-free variant of px_move(). The direction only selects the
+ * offsets of one memmove().
+ */
+static void px_move_bf(card *deck, int j, int k) {
+    card c = deck[j];
+    int up = j < k,
+        lo = k + (j - k) * up, /* min(j, k) */
+        n = (k - j) * (2 * up - 1); /* |k - j| */
+
+    memmove(deck + lo + !up, deck + lo + up, n);
+    deck[k] = c;
+}
+
+/*
+ * Branch-free variant of px_round().
+ *
+ * The jokers are located by a full scan with masks instead of loops
+ * that stop early. Their moves, including the wrap around, are plain
+ * arithmetic, and the new positions of the jokers follow from the old
+ * ones. The cuts are copies of computed lengths. So no branch depends
+ * on the deck data, as such branches are mispredicted on random decks.
+ *
+ * \param deck    Pointer to the deck, containing numbers 1-54.
+ * \param buffer  Pointer to 54 cards of scratch memory.
+ *
+ * \returns values 1-54 normally, INVALID_CARD on error.
+ */
+static card px_round_bf(card *deck, card *buffer) {
+    int i,
+        ja = 0, jb = 0, /* joker positions */
+        k, j1, j2, count;
+
+    for (i = 0; i < 54; i++) {
+        ja |= i & -(deck[i] == 53);
+        jb |= i & -(deck[i] == 54);
+    }
+
+    if ((deck[ja] != 53) | (deck[jb] != 54)) {
+        LOG_ERR(("Could not locate jokers!\n"));
+        return INVALID_CARD;
+    }
+
+    /* Joker A moves 1, joker B 2, wrapping around below the top card. */
+    k = ja + 1 - 53 * (ja == 53);
+    PX_TRACE2(joker_a, ja, k);
+    px_move_bf(deck, ja, k);
+    jb = BF_POS(jb, ja, k);
+    ja = k;
+
+    k = jb + 1 - 53 * (jb == 53);
+    k = k + 1 - 53 * (k == 53);
+    PX_TRACE2(joker_b, jb, k);
+    px_move_bf(deck, jb, k);
+    ja = BF_POS(ja, jb, k);
+    jb = k;
+
+    /* triple cut */
+    j1 = ja + (jb - ja) * (jb < ja);
+    j2 = ja ^ jb ^ j1;
+    PX_TRACE2(triple_cut, j1, j2);
+    memcpy(buffer, deck + j2 + 1, 53 - j2);
+    memcpy(buffer + 53 - j2, deck + j1, j2 - j1 + 1);
+    memcpy(buffer + 54 - j1, deck, j1);
+
+    /* count cut, both jokers count 53 */
+    count = buffer[53] - (buffer[53] == 54);
+    PX_TRACE1(count_cut, count);
+    deck[53] = buffer[53];
+    memcpy(deck + 53 - count, buffer, count);
+    memcpy(deck, buffer + count, 53 - count);
+
+    return deck[deck[0] - (deck[0] == 54)];
+}
+
+#undef BF_POS
+
+/*
+ * The key stream engines, indexed by PX_ENG_*. A new engine only needs
+ * a round function with the contract of px_round() and an entry here,
+ * px_engcheck() verifies it before it is selected by name.
+ */
+static const struct {
+    const char *name;
+    card (*round)(card *deck, card *buffer);
+} engines[PX_NENGINES] = {
+    { "table", px_round_tab },
+    { "reference", px_round },
+    { "branch-free", px_round_bf }
+};
+
+/* Results of px_engcheck(): 0 unchecked, 1 passed, -1 failed, and the
+   engine picked by calibration, -1 until the first "auto". */
+static pthread_mutex_t englock = PTHREAD_MUTEX_INITIALIZER;
+static int engchecked[PX_NENGINES];
+static int engauto = -1;
+
+/*
+ * Returns the round function for the engine selected
+ * in the options.
+ */
+static card (*px_engine(const struct px_opts *opts))(card *, card *) {
+    return opts->engine < PX_NENGINES
+        ? engines[opts->engine].round
+        : px_round_tab;
+}
+
+/*
+ * Generates key stream letters, while modifying the deck.
+ * The letters are numbers from 1 to 52, not ASCII chars!
+ * Joker outputs are skipped.
+ *
+ * \param deck    Pointer to the deck, containing numbers 1-54.
+ * \param buffer  Pointer to 54 cards of scratch memory.
+ * \param round   The round function of the engine.
+ * \param ks      out: Pointer to n cards for the key stream.
+ * \param n       Number of key stream letters to generate.
+ * \param skipped in/out: Counter of skipped joker outputs.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int px_ksgen(
+    card *deck,
+    card *buffer,
+    card (*round)(card *, card *),
+    card *ks,
+    const int n,
+    unsigned long *skipped) {
+
+    int i;
+    card c;
+
+    /* A joker output is overwritten by the next round. */
+    for (i = 0; i < n;) {
+        c = round(deck, buffer);
+        PX_TRACE1(step, c);
+        if (c == INVALID_CARD) return -1;
+        ks[i] = c;
+        i += c <= 52;
+        *skipped += c > 52;
+    }
+
+    return 0;
+}
+
+/*
+ * Single-producer, single-consumer ring of key stream letters.
+ * The producer thread owns the deck and fills slot after slot, the
+ * consumer takes the letters in order. Both only wait if the ring is
+ * full or empty, without locks.
+ */
+struct ksring {
+    card ks[PX_RINGSLOTS][PX_CHUNK];
+    card *deck;
+    card *scratch;
+    card (*round)(card *, card *);
+    unsigned long skipped; /* read after the producer is joined */
+    unsigned head; /* filled slots, written by the producer */
+    char pad[64]; /* keeps head and tail on separate cache lines */
+    unsigned tail; /* taken slots, written by the consumer */
+    int off; /* letters taken from the current slot */
+    int stop; /* set by the consumer when done */
+    int failed; /* set by the producer on errors */
+    pthread_t thread;
+};
+
+/*
+ * Producer thread of a ksring.
+ */
+static void *px_ringfill(void *arg) {
+    struct ksring *r = arg;
+    unsigned head = 0;
+
+    for (;;) {
+        while (head - LOAD_ACQ(&r->tail) == PX_RINGSLOTS) {
+            if (LOAD_ACQ(&r->stop)) return NULL;
+            sched_yield();
+        }
+        if (LOAD_ACQ(&r->stop)) return NULL;
+
+        if (px_ksgen(r->deck, r->scratch, r->round,
+                r->ks[head % PX_RINGSLOTS], PX_CHUNK, &r->skipped)) {
+            STORE_REL(&r->failed, 1);
+            return NULL;
+        }
+        STORE_REL(&r->head, ++head);
+    }
+}
+
+/*
+ * Takes the next n key stream letters from a ksring.
+ *
+ * \returns 0 on success, -1 if the producer failed.
+ */
+static int px_ringget(struct ksring *r, card *ks, int n) {
+    card *slot;
+    int m;
+
+    while (n > 0) {
+        while (LOAD_ACQ(&r->head) == r->tail) {
+            if (LOAD_ACQ(&r->failed)) return -1;
+            sched_yield();
+        }
+
+        slot = r->ks[r->tail % PX_RINGSLOTS];
+        m = PX_CHUNK - r->off < n ? PX_CHUNK - r->off : n;
+        memcpy(ks, slot + r->off, m);
+        ks += m;
+        n -= m;
+        r->off += m;
+
+        if (r->off == PX_CHUNK) {
+            r->off = 0;
+            STORE_REL(&r->tail, r->tail + 1);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Starts the producer of a key stream ring on a deck.
+ *
+ * \returns The ring, NULL if no thread could be started.
+ */
+static struct ksring *px_ringstart(
+    card *deck,
+    card *scratch,
+    card (*round)(card *, card *)) {
+
+    struct ksring *r;
+
+    r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+
+    r->deck = deck;
+    r->scratch = scratch;
+    r->round = round;
+    if (pthread_create(&r->thread, NULL, px_ringfill, r)) {
+        free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+/*
+ * Stops the producer, adds its skipped jokers to the statistics and
+ * wipes the ring.
+ */
+static void px_ringstop(struct ksring *r, struct px_stats *st) {
+    STORE_REL(&r->stop, 1);
+    pthread_join(r->thread, NULL);
+    st->skipped += r->skipped;
+    memset(r, 0, sizeof(*r));
+    free(r);
+}
+
 #define PX_ENCR 0
 #define PX_DECR 1
 
+/*
+ * Adds the time since the last phase change to a phase.
+ *
+ * \param st     The statistics.
+ * \param phase  The phase that just ended (PX_PH_*).
+ * \param t      in/out: Timestamp of the last phase change.
+ */
+static void px_tick(struct px_stats *st, const int phase, double *t) {
+    double now = px_now();
+    st->time[phase] += now - *t;
+    *t = now;
+}
+
 /*
  * Cipher character substitution.
  *
@@ -257,10 +605,7 @@ static card px_subst(card m, card k, const int decrypt) {
 
     s = s == 0 ? 26 : s; /* Fake modulo... */
 
-    LOG_DBG(("SUBST: m: %i(%c), k:%i(%c), R: %i(%c)\n",
-            m, CARD2ASCII(m),
-            k, CARD2ASCII(k),
-            s, CARD2ASCII(s)));
+    PX_TRACE3(subst, m, k, s);
     return s;
 }
 
@@ -285,13 +630,28 @@ static int px_cipher(
     const struct px_opts *opts,
     const int decrypt) {
 
-    card deck[54]; /* copy of the key */
-    card k; /* key stream character */
+    card local[2 * 54]; /* used if the secure arena is exhausted */
+    card *deck, /* copy of the key */
+         *scratch; /* scratch memory for the key stream */
+    void *slot;
+    card (*round)(card *, card *); /* key stream round function */
+    struct ksring *ring = NULL; /* key stream pipeline, if used */
+    card m[PX_CHUNK], /* message letters */
+         k[PX_CHUNK]; /* key stream letters */
+    struct px_stats st; /* collected locally, added to opts->stats */
+    double t = 0; /* timestamp of the last phase change */
     char c; /* character read from buffer */
     int i = 0, /* read index */
-        o = 0; /* write index */
+        o = 0, /* write index */
+        j, n;
     int ret = -1;
 
+    slot = px_smget();
+    deck = slot ? slot : local;
+    scratch = deck + 54;
+    memset(&st, 0, sizeof(st));
+    PX_TRACE2(cipher_begin, nmsg, decrypt);
+
     /* Input validation */
     if (key == NULL || msg == NULL || buf == NULL || opts == NULL) {
         ret = -1;
@@ -306,12 +666,13 @@ static int px_cipher(
     }
 
     memcpy(deck, key, 54);
+    round = px_engine(opts);
 
     /*
      * Create output buffer, add 4 bytes for 'X' padding and
      * one for a 0-terminator.
      */
-    *buf = malloc((nmsg + 5) * sizeof(char));
+    *buf = px_malloc((nmsg + 5) * sizeof(char));
     if (!*buf)
     {
         ret = -2;
@@ -319,46 +680,256 @@ static int px_cipher(
         goto clean;
     }
 
-    /* Cipher execution */
-    while ((c = msg[i++]) && i <= nmsg) {
-        if (!isalpha(c)) continue;
-        c = ASCII2CARD(c);
-        if((k = px_next(deck)) == INVALID_CARD) {
+    /* Long messages may get their key stream from a second thread. */
+    if (opts->pipeline && nmsg >= PX_PIPEMIN) {
+        ring = px_ringstart(deck, scratch, round);
+        if (!ring) LOG_WRN(("Could not start the key stream thread.\n"));
+    }
+
+    if (opts->stats) t = px_now();
+
+    /* Cipher execution, chunk by chunk */
+    for (;;) {
+        /* Normalize: collect the letters of the message. */
+        n = 0;
+        while (n < PX_CHUNK && i < nmsg && (c = msg[i]) != '\0') {
+            i++;
+            if (isalpha(c)) m[n++] = ASCII2CARD(c);
+        }
+        st.letters += n;
+
+        /* padding with X */
+        if (i == nmsg || msg[i] == '\0') {
+            while ((o + n) % 5 && n < PX_CHUNK) {
+                m[n++] = ASCII2CARD('X');
+                st.padding++;
+            }
+        }
+
+        if (n == 0) break;
+        if (opts->stats) px_tick(&st, PX_PH_NORMALIZE, &t);
+
+        if (ring ? px_ringget(ring, k, n)
+                 : px_ksgen(deck, scratch, round, k, n, &st.skipped)) {
             ret = -3;
             LOG_ERR(("Error on getting next key stream letter [20ba].\n"));
             goto clean;
         }
-        c = px_subst(c, k, decrypt);
-        (*buf)[o++] = CARD2ASCII(c);
+        st.keystream += n;
+        if (opts->stats) px_tick(&st, PX_PH_KEYSTREAM, &t);
+
+        for (j = 0; j < n; j++) {
+            (*buf)[o++] = CARD2ASCII(px_subst(m[j], k[j], decrypt));
+        }
+        if (opts->stats) px_tick(&st, PX_PH_SUBSTITUTE, &t);
     }
 
-    if (i > nmsg + 1) {
+    if (i == nmsg && msg[i] != '\0') {
         LOG_WRN(
             ("The message appears longer than specified."
             " Parts of the message may remain unencrypted!\n"));
     }
 
-    /* padding with X */
-    while (o % 5) {
-        c = ASCII2CARD('X');
-        if((k = px_next(deck)) == INVALID_CARD) {
-            ret = -4;
-            LOG_ERR(("Error on getting next key stream letter. [5138]\n"));
-            goto clean;
-        }
+    (*buf)[o++] = '\0';
+    ret = o;
 
-        c = px_subst(c, k, decrypt);
-        (*buf)[o++] = CARD2ASCII(c);
+    if (ring) {
+        px_ringstop(ring, &st);
+        ring = NULL;
     }
 
-    (*buf)[o++] = '\0';
-    ret = o;
+    if (opts->stats) {
+        st.inbytes = i;
+        px_addstats(opts->stats, &st);
+    }
 
 clean:
+    /* The producer uses the deck until it is stopped. */
+    if (ring) px_ringstop(ring, &st);
+
+    /* Arena slots are wiped on teardown, local memory right now. */
+    if (slot) {
+        px_smput(slot);
+    } else {
+        memset(local, 0, sizeof(local));
+    }
+    PX_TRACE2(cipher_end, ret, decrypt);
+    return ret;
+}
+
+
+/*
+ * Shared state of a segmented cipher run.
+ */
+struct segjob {
+    const card *key;
+    const char *letters; /* segment i at i * (seglen + 1), 0-terminated */
+    int nletters;
+    int seglen;
+    char *out;
+    int nlast; /* length of the last segment, with padding */
+    const struct px_opts *opts;
+    int decrypt;
+    int failed;
+    pthread_mutex_t lock; /* guards failed and opts->stats */
+};
+
+/*
+ * Ciphers the i-th segment of a segjob with its own deck.
+ */
+static void px_segjob(void *ctx, int i) {
+    struct segjob *job = ctx;
+    struct px_opts opts = *job->opts;
+    struct px_stats st;
+    card deck[54];
+    char *res = NULL;
+    int n, ret = -1;
+
+    n = job->nletters - i * job->seglen;
+    if (n > job->seglen) n = job->seglen;
+
+    /* The segments are the parallelism, one thread each. */
+    memset(&st, 0, sizeof(st));
+    opts.segment = 0;
+    opts.pipeline = 0;
+    opts.stats = job->opts->stats ? &st : NULL;
+
+    if (!px_segkey(job->key, i, deck)) {
+        ret = px_cipher(deck, job->letters + i * (job->seglen + 1), n,
+            &res, &opts, job->decrypt);
+    }
     memset(deck, 0, sizeof(deck));
+
+    /* Only the last segment can be padded, the others are multiples
+       of 5 letters. */
+    if (ret > 0) {
+        memcpy(job->out + i * job->seglen, res, ret - 1);
+        if (i == (job->nletters - 1) / job->seglen) job->nlast = ret - 1;
+    }
+    if (res) px_free(res);
+
+    pthread_mutex_lock(&job->lock);
+    if (ret <= 0) job->failed = 1;
+    if (opts.stats) px_addstats(job->opts->stats, &st);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*
+ * Performs the pontifex cipher algorithm on segments of a message,
+ * see px_opts.segment. Parameters and result like px_cipher().
+ */
+static int px_segcipher(
+    const card *key,
+    const char *msg,
+    const int nmsg,
+    char **buf,
+    const struct px_opts *opts,
+    const int decrypt) {
+
+    struct segjob job;
+    char *letters;
+    int i, n = 0, nseg;
+    int ret = -1;
+
+    if (opts->segment % 5) {
+        LOG_ERR(("The segment length must be a multiple of 5.\n"));
+        return -1;
+    }
+    if (opts->segment > PX_SEGMAX) {
+        LOG_ERR(("The segment length must be at most %lu.\n", PX_SEGMAX));
+        return -1;
+    }
+
+    /* Normalize, with a terminator after each segment. */
+    letters = px_malloc(nmsg + nmsg / opts->segment + 1);
+    if (!letters) {
+        LOG_ERR(("No memory. [2b7c]\n"));
+        return -2;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.seglen = opts->segment;
+    for (i = 0; i < nmsg && msg[i] != '\0'; i++) {
+        if (!isalpha(msg[i])) continue;
+        if (job.nletters && job.nletters % job.seglen == 0) letters[n++] = '\0';
+        letters[n++] = msg[i];
+        job.nletters++;
+    }
+    letters[n] = '\0';
+
+    if (job.nletters == 0) {
+        px_free(letters);
+        return px_cipher(key, msg, nmsg, buf, opts, decrypt);
+    }
+
+    /* 4 bytes for 'X' padding and one for a 0-terminator */
+    *buf = px_malloc(job.nletters + 5);
+    if (!*buf) {
+        LOG_ERR(("No memory. [e4d0]\n"));
+        px_free(letters);
+        return -2;
+    }
+
+    nseg = (job.nletters - 1) / job.seglen + 1;
+    job.key = key;
+    job.letters = letters;
+    job.out = *buf;
+    job.opts = opts;
+    job.decrypt = decrypt;
+    pthread_mutex_init(&job.lock, NULL);
+
+    if (px_pfor(nseg, opts->nthreads, px_segjob, &job) || job.failed) {
+        LOG_ERR(("Error on ciphering the segments. [91f3]\n"));
+        px_free(*buf);
+        *buf = NULL;
+    } else {
+        n = (nseg - 1) * job.seglen + job.nlast;
+        (*buf)[n] = '\0';
+        ret = n + 1;
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    memset(letters, 0, job.nletters + nseg);
+    px_free(letters);
     return ret;
 }
 
+/*
+ * Generates the next cards of an open key stream, counting them in
+ * the statistics.
+ */
+static int px_ksfill(struct px_ks *ks, card *k, const int n) {
+    struct px_stats st;
+    double t = 0;
+
+    memset(&st, 0, sizeof(st));
+    if (ks->stats) t = px_now();
+
+    if (px_ksgen(ks->deck, ks->deck + 54, ks->round, k, n, &st.skipped)) {
+        LOG_ERR(("Error on getting next key stream letter. [3de8]\n"));
+        return -1;
+    }
+
+    if (ks->stats) {
+        px_tick(&st, PX_PH_KEYSTREAM, &t);
+        st.keystream = n;
+        px_addstats(ks->stats, &st);
+    }
+
+    return 0;
+}
+
+/*
+ * Bits that a key stream card c yields in px_rand_bytes(), indexed by
+ * c - 1. The value of the bits is c - 1 masked to this width.
+ */
+static const unsigned char rwidth[52] = {
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+    2, 2, 2, 2
+};
+
 
 
 /* Public header implementation */
@@ -374,6 +945,9 @@ int px_encrypt(
     char **buf,
     const struct px_opts *opts) {
 
+    if (opts && opts->segment) {
+        return px_segcipher(key, msg, nmsg, buf, opts, 0);
+    }
     return px_cipher(key, msg, nmsg, buf, opts, 0);
 }
 
@@ -388,6 +962,9 @@ int px_decrypt(
     char **buf,
     const struct px_opts *opts) {
 
+    if (opts && opts->segment) {
+        return px_segcipher(key, msg, nmsg, buf, opts, 1);
+    }
     return px_cipher(key, msg, nmsg, buf, opts, 1);
 }
 
@@ -401,44 +978,179 @@ int px_stream(
     char **buf,
     const struct px_opts *opts) {
 
-    int i;
+    struct px_ks ks;
     int ret = 0;
-    card deck[54];
-    card c;
+
+    PX_TRACE1(stream_begin, count);
 
     /* Input validation */
     if (key == NULL || buf == NULL || opts == NULL) {
         LOG_ERR(("Null pointer found. Whoops. [18b4]\n"));
         ret = -1;
-        goto clean;
+        goto end;
     }
 
-    memcpy(deck, key, sizeof(deck));
-
-    *buf = malloc((count + 1) * sizeof(char));
+    *buf = px_malloc((count + 1) * sizeof(char));
     if (!*buf) {
         LOG_ERR(("Internal malloc error! [6e79]\n"));
         ret = -1;
-        goto clean;
+        goto end;
     }
 
-    for (i = 0; i < count; i++) {
-        if((c = px_next(deck)) == INVALID_CARD) {
-            ret = -2;
-            LOG_ERR(("Error on getting next key stream letter. [3de8]\n"));
-            goto clean;
-        }
+    px_ksopen(&ks, key, opts);
+    if (px_ksread(&ks, *buf, count)) ret = -2;
+    px_ksclose(&ks);
+    (*buf)[count] = '\0';
+
+end:
+    PX_TRACE1(stream_end, ret);
+    return ret;
+}
 
-        (*buf)[i] = CARD2ASCII(c);
+/**
+ * Opens a key stream.
+ * See header.
+ */
+int px_ksopen(struct px_ks *ks, const card *key, const struct px_opts *opts) {
+    if (key == NULL || opts == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [5c21]\n"));
+        return -1;
     }
 
-    (*buf)[count] = '\0';
+    ks->slot = px_smget();
+    ks->deck = ks->slot ? ks->slot : ks->local;
+    ks->round = px_engine(opts);
+    ks->stats = opts->stats;
+    memcpy(ks->deck, key, 54);
 
-clean:
-    memset(deck, 0, sizeof(deck));
+    return 0;
+}
+
+/**
+ * Generates the next letters of an open key stream.
+ * See header.
+ */
+int px_ksread(struct px_ks *ks, char *buf, const int n) {
+    int i;
+
+    /* The key stream is generated in place, then converted to ASCII. */
+    if (px_ksfill(ks, (card *)buf, n)) return -1;
+    for (i = 0; i < n; i++) buf[i] = CARD2ASCII(buf[i]);
+
+    return 0;
+}
+
+/**
+ * Closes a key stream.
+ * See header.
+ */
+void px_ksclose(struct px_ks *ks) {
+    if (ks->slot) {
+        px_smput(ks->slot);
+    } else {
+        memset(ks->local, 0, sizeof(ks->local));
+    }
+    ks->slot = NULL;
+    ks->deck = NULL;
+}
+
+/**
+ * Opens the key stream of a key as a source of bytes.
+ * See header.
+ */
+int px_rand_open(
+    struct px_rand *r,
+    const card *key,
+    const struct px_opts *opts) {
+
+    if (r == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [a05c]\n"));
+        return -1;
+    }
+
+    r->ncards = 0;
+    r->next = 0;
+    r->bits = 0;
+    r->nbits = 0;
+    return px_ksopen(&r->ks, key, opts);
+}
+
+/**
+ * Gets the next bytes of a byte source.
+ * See header.
+ */
+int px_rand_bytes(struct px_rand *r, unsigned char *buf, const size_t n) {
+    unsigned long bits = r->bits;
+    int nbits = r->nbits,
+        ret = 0,
+        c, w;
+    size_t i = 0;
+
+    while (i < n) {
+        if (nbits >= 8) {
+            nbits -= 8;
+            buf[i++] = (unsigned char)(bits >> nbits);
+            continue;
+        }
+
+        if (r->next == r->ncards) {
+            if (px_ksfill(&r->ks, r->cards, PX_RANDBLOCK)) {
+                ret = -1;
+                break;
+            }
+            r->ncards = PX_RANDBLOCK;
+            r->next = 0;
+        }
+
+        /* Only the low bits are used, so older ones may shift out. */
+        c = r->cards[r->next++] - 1;
+        w = rwidth[c];
+        bits = bits << w | (c & ((1 << w) - 1));
+        nbits += w;
+    }
+
+    r->bits = bits & ((1UL << nbits) - 1);
+    r->nbits = nbits;
     return ret;
 }
 
+/**
+ * Closes a byte source.
+ * See header.
+ */
+void px_rand_close(struct px_rand *r) {
+    px_ksclose(&r->ks);
+    memset(r->cards, 0, sizeof(r->cards));
+    r->ncards = 0;
+    r->next = 0;
+    r->bits = 0;
+    r->nbits = 0;
+}
+
+/**
+ * Counts the leading letters of an expected key stream a key reproduces.
+ * See header.
+ */
+int px_ksmatch(const card *key, const card *expect, const int n) {
+    card deck[54], buffer[54];
+    card c;
+    int i = 0;
+
+    /* Candidate keys of a search are no secrets, so the decks
+       are not taken from the arena. */
+    memcpy(deck, key, 54);
+
+    while (i < n) {
+        c = px_round_tab(deck, buffer);
+        if (c == INVALID_CARD) return -1;
+        if (c > 52) continue; /* jokers are skipped */
+        if ((c - 1) % 26 + 1 != expect[i]) break;
+        i++;
+    }
+
+    return i;
+}
+
 /**
  * ("Key-Move-Jokers")
  * Relocate the jokers to the positions given by the last two
@@ -446,8 +1158,8 @@ clean:
  * This is an optional step for key generation.
  */
 static int px_kmovj(card * const key) {
-    int j;
-    char ja_n, jb_n, ja = 0, jb = 0;
+    int j, ja = -1, jb = -1;
+    char ja_n, jb_n;
 
     /* Get the last two cards.
        The +1 offset of the non-zero-based card numbers is
@@ -463,7 +1175,8 @@ static int px_kmovj(card * const key) {
         if (key[j] == 54) jb = j;
     }
 
-    assert(ja != 0 && jb != 0 && ja != jb);
+    /* Either joker may be on top of the deck. */
+    assert(ja >= 0 && jb >= 0 && ja != jb);
 
     /* px_move() puts the card to a new position _after_ removing
        it. However, after removing it, the index may have changed.
@@ -490,6 +1203,27 @@ static int px_kmovj(card * const key) {
     return 0;
 }
 
+/*
+ * Applies one letter of a password to a key.
+ *
+ * \param key       Pointer to the deck, containing numbers 1-54.
+ * \param letter    The letter, 1-26.
+ * \param mvjokers  Boolean flag that defines if the jokers shall be moved.
+ * \param scratch   Pointer to 54 cards of scratch memory.
+ *
+ * \returns 1 on success, 0 on failure.
+ */
+static int px_kgstep(card *key, card letter, int mvjokers, card *scratch) {
+    if (!px_mjokers(key) || !px_tcut(key, scratch)) return 0;
+    px_ccut(key, 0, scratch);
+    px_ccut(key, letter, scratch);
+
+    if (mvjokers) {
+        px_kmovj(key);
+    }
+    return 1;
+}
+
 /**
  * Generates a key for the pontifex key stream algorithm based on a
  * password.
@@ -503,6 +1237,13 @@ int px_keygen(
     int i,
         n = 0; /* counter for characters in password */
     char c; /* current character */
+    card local[54]; /* used if the secure arena is exhausted */
+    card *scratch;
+    void *slot;
+    int ret = 0;
+
+    slot = px_smget();
+    scratch = slot ? slot : local;
 
     /* initialize key */
     for (i = 0; i < 54; i++) key[i] = i+1;
@@ -511,14 +1252,11 @@ int px_keygen(
     while ((c = password[i++])) {
         if (!isalpha(c)) continue;
         n++;
+        PX_TRACE1(keygen_letter, n);
 
-        if (!px_mjokers(key)) return -1;
-        if (!px_tcut(key)) return -1;
-        px_ccut(key, 0);
-        px_ccut(key, ASCII2CARD(c));
-
-        if (mvjokers) {
-            px_kmovj(key);
+        if (!px_kgstep(key, ASCII2CARD(c), mvjokers, scratch)) {
+            ret = -1;
+            goto clean;
         }
     }
 
@@ -528,8 +1266,305 @@ int px_keygen(
             " At least 64 characters are recommended.\n"));
     }
 
-    return 0;
+clean:
+    if (slot) {
+        px_smput(slot);
+    } else {
+        memset(local, 0, sizeof(local));
+    }
+    return ret;
 }
 
-#undef INVALID_CARD
+/**
+ * Derives the deck of a segment from the key.
+ * See header.
+ */
+int px_segkey(const card *key, const unsigned long index, card *segkey) {
+    card digits[PX_SEGDIGITS],
+         scratch[54];
+    unsigned long x = index;
+    int i;
+    int ret = 0;
 
+    for (i = PX_SEGDIGITS - 1; i >= 0; i--) {
+        digits[i] = x % 26 + 1;
+        x /= 26;
+    }
+
+    memcpy(segkey, key, 54);
+    for (i = 0; i < PX_SEGDIGITS; i++) {
+        if (!px_kgstep(segkey, digits[i], 0, scratch)) {
+            ret = -1;
+            break;
+        }
+    }
+
+    memset(scratch, 0, sizeof(scratch));
+    return ret;
+}
+
+/*
+ * Shared state of a px_keygens() run.
+ */
+struct kgjob {
+    const char * const *passwords;
+    int n;
+    int mvjokers;
+    card *keys;
+};
+
+/*
+ * Generates the keys of one group of up to PX_LANES passwords.
+ *
+ * The lanes take turns letter by letter. Their decks do not depend on
+ * each other, so the processor can overlap the steps of several lanes.
+ * Lanes whose password is exhausted are masked out until all are done.
+ */
+static void px_kglanes(void *ctx, int group) {
+    struct kgjob *job = ctx;
+    card scratch[PX_LANES][54];
+    const char *p[PX_LANES]; /* next letter per lane */
+    int n[PX_LANES]; /* letters applied per lane */
+    card *key;
+    int nlanes, active, i, j;
+
+    nlanes = job->n - group * PX_LANES;
+    if (nlanes > PX_LANES) nlanes = PX_LANES;
+
+    for (i = 0; i < nlanes; i++) {
+        p[i] = job->passwords[group * PX_LANES + i];
+        n[i] = 0;
+        key = job->keys + (group * PX_LANES + i) * 54;
+        for (j = 0; j < 54; j++) key[j] = j+1;
+    }
+
+    do {
+        active = 0;
+        for (i = 0; i < nlanes; i++) {
+            while (*p[i] && !isalpha(*p[i])) p[i]++;
+            if (!*p[i]) continue;
+            active++;
+            n[i]++;
+            PX_TRACE1(keygen_letter, n[i]);
+
+            /* Same as px_keygen(): a key stream round, then a count
+               cut by the letter. */
+            key = job->keys + (group * PX_LANES + i) * 54;
+            px_round_tab(key, scratch[i]);
+            px_ccut(key, ASCII2CARD(*p[i]), scratch[i]);
+            if (job->mvjokers) px_kmovj(key);
+            p[i]++;
+        }
+    } while (active);
+
+    memset(scratch, 0, sizeof(scratch));
+}
+
+/**
+ * Generates keys for many passwords at once.
+ * See header.
+ */
+int px_keygens(
+    const char * const *passwords,
+    const int n,
+    const int mvjokers,
+    card *keys,
+    const int nthreads) {
+
+    struct kgjob job;
+
+    if (passwords == NULL || keys == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [5d3a]\n"));
+        return -1;
+    }
+
+    job.passwords = passwords;
+    job.n = n;
+    job.mvjokers = mvjokers;
+    job.keys = keys;
+
+    return px_pfor(
+        (n + PX_LANES - 1) / PX_LANES, nthreads, px_kglanes, &job) ? -1 : 0;
+}
+
+/*
+ * Test vectors of Bruce Schneier: passwords, and the cipher texts of
+ * AAAAA... with their keys, each letter one after the key stream's.
+ */
+static const char * const engvectors[][2] = {
+    { "", "EXKYIZSGEHUNTIQ" },
+    { "F", "XYIUQBMHKKJBEGY" },
+    { "FO", "TUJYMBERLGXNDIW" },
+    { "FOO", "ITHZUJIWGRFARMW" },
+    { "A", "XODALGSCULIQNSC" },
+    { "AA", "OHGWMXXCAIMCIQP" },
+    { "AAA", "DCSQYHBQZNGDRUT" },
+    { "B", "XQEEMOITLZVDSQS" },
+    { "BC", "QNGRKQIHCLGWSCE" },
+    { "BCD", "FMUBYBMAXHNQXCJ" },
+    { "CRYPTONOMICON", "SUGSRSXSWQRMXOHIPBFPXARYQ" }
+};
+
+/* Key stream cards compared with the reference engine per key. */
+#define PX_ENGCHECKN 1000
+
+/* Key stream cards per timing run of the calibration, and runs. */
+#define PX_CALCARDS 20000
+#define PX_CALRUNS 3
+
+/*
+ * Runs the checks of px_engcheck() on an engine.
+ *
+ * \returns 1 if the engine passed, -1 otherwise.
+ */
+static int px_engtest(card (*round)(card *, card *)) {
+    card key[54], deck[54], buffer[54],
+         ks[PX_ENGCHECKN], ref[PX_ENGCHECKN];
+    const char *p;
+    unsigned long skipped = 0;
+    int v, i, n;
+
+    for (v = 0; v <= sizeof(engvectors) / sizeof(*engvectors); v++) {
+        if (v < sizeof(engvectors) / sizeof(*engvectors)) {
+            for (i = 0; i < 54; i++) key[i] = i + 1;
+            for (p = engvectors[v][0]; *p; p++) {
+                if (!px_kgstep(key, ASCII2CARD(*p), 0, buffer)) return -1;
+            }
+        } else {
+            /* jokers on the edges of the deck */
+            for (i = 0; i < 54; i++) key[i] = i + 1;
+            key[0] = 53;
+            key[52] = 1;
+        }
+
+        memcpy(deck, key, 54);
+        if (px_ksgen(deck, buffer, round, ks, PX_ENGCHECKN, &skipped)) {
+            return -1;
+        }
+
+        if (v < sizeof(engvectors) / sizeof(*engvectors)) {
+            p = engvectors[v][1];
+            for (i = 0; p[i]; i++) {
+                if ((ks[i] - 1) % 26 + 1 != (p[i] - 'A' + 25) % 26 + 1) {
+                    return -1;
+                }
+            }
+        }
+
+        memcpy(deck, key, 54);
+        if (px_ksgen(deck, buffer, px_round, ref, PX_ENGCHECKN, &skipped)) {
+            return -1;
+        }
+        for (i = 0, n = 0; i < PX_ENGCHECKN; i++) n += ks[i] != ref[i];
+        if (n) return -1;
+    }
+
+    return 1;
+}
+
+/*
+ * Times an engine on a key stream of PX_CALCARDS cards.
+ *
+ * \returns The shortest of PX_CALRUNS runs in seconds.
+ */
+static double px_engtime(card (*round)(card *, card *)) {
+    card deck[54], buffer[54], ks[PX_CHUNK];
+    unsigned long skipped = 0;
+    double t, best = 0;
+    int r, i;
+
+    for (r = 0; r < PX_CALRUNS; r++) {
+        for (i = 0; i < 54; i++) deck[i] = i + 1;
+        t = px_now();
+        for (i = 0; i < PX_CALCARDS; i += PX_CHUNK) {
+            px_ksgen(deck, buffer, round, ks, PX_CHUNK, &skipped);
+        }
+        t = px_now() - t;
+        if (r == 0 || t < best) best = t;
+    }
+
+    return best;
+}
+
+/**
+ * Gets the name of a key stream engine.
+ * See header.
+ */
+const char *px_engname(const unsigned int engine) {
+    return engine < PX_NENGINES ? engines[engine].name : NULL;
+}
+
+/**
+ * Checks a key stream engine.
+ * See header.
+ */
+int px_engcheck(const unsigned int engine) {
+    int ret;
+
+    if (engine >= PX_NENGINES) return -1;
+
+    pthread_mutex_lock(&englock);
+    if (!engchecked[engine]) {
+        engchecked[engine] = px_engtest(engines[engine].round);
+        if (engchecked[engine] < 0) {
+            LOG_ERR((
+                "Key stream engine '%s' failed the self-check!\n",
+                engines[engine].name));
+        }
+    }
+    ret = engchecked[engine] > 0 ? 0 : -1;
+    pthread_mutex_unlock(&englock);
+
+    return ret;
+}
+
+/**
+ * Selects a key stream engine by name.
+ * See header.
+ */
+int px_engselect(const char *name) {
+    double t, best = 0;
+    int e, pick = -1;
+
+    if (name == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [e61a]\n"));
+        return -1;
+    }
+
+    if (strcmp(name, "auto")) {
+        for (e = 0; e < PX_NENGINES; e++) {
+            if (!strcmp(name, engines[e].name)) {
+                return px_engcheck(e) ? -1 : e;
+            }
+        }
+        LOG_ERR(("Unknown key stream engine '%s'!\n", name));
+        return -1;
+    }
+
+    for (e = 0; e < PX_NENGINES; e++) px_engcheck(e);
+
+    pthread_mutex_lock(&englock);
+    for (e = 0; engauto < 0 && e < PX_NENGINES; e++) {
+        if (engchecked[e] < 0) continue;
+        t = px_engtime(engines[e].round);
+        LOG_DBG((
+            "Engine '%s': %.0f cards/s\n", engines[e].name, PX_CALCARDS / t));
+        if (best == 0 || t < best) {
+            best = t;
+            pick = e;
+        }
+    }
+    if (engauto < 0) engauto = pick;
+    e = engauto;
+    pthread_mutex_unlock(&englock);
+
+    if (e < 0) LOG_ERR(("No key stream engine passed the self-check!\n"));
+    return e;
+}
+
+#undef PX_ENGCHECKN
+#undef PX_CALCARDS
+#undef PX_CALRUNS
+#undef INVALID_CARD
+#undef LOAD_ACQ
+#undef STORE_REL
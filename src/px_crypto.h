@@ -23,6 +23,22 @@
  */
 
 #include "./px_common.h"
+#include "./px_alloc.h"
+#include "./px_stats.h"
+
+/* Key stream engines, see px_opts */
+#define PX_ENG_TABLE 0
+#define PX_ENG_REF 1
+#define PX_ENG_BFREE 2
+
+/** Number of key stream engines, see px_engselect(). */
+#define PX_NENGINES 3
+
+/** Letters of the segment number, see px_segkey(). */
+#define PX_SEGDIGITS 7
+
+/** Longest segment, in letters, see px_opts.segment. */
+#define PX_SEGMAX (0x7fffffffUL / 2)
 
 /**
  * Options for applying the pontifex algorithm.
@@ -34,8 +50,83 @@ struct px_opts {
      * can be increased.
      */
     unsigned int rounds;
+
+    /**
+     * The key stream engine to use. All engines yield the same
+     * key stream, they only differ in speed.
+     * PX_ENG_TABLE (default) uses precomputed step tables,
+     * PX_ENG_REF is the plain reference implementation,
+     * PX_ENG_BFREE computes a round without data-dependent branches.
+     * See px_engselect() for choosing one by name, or the fastest.
+     */
+    unsigned int engine;
+
+    /**
+     * If not NULL, the counters and phase timings of each call are
+     * added to this struct. Not thread-safe, use one per thread.
+     */
+    struct px_stats *stats;
+
+    /**
+     * If not 0, long messages get their key stream from a second
+     * thread, which runs ahead of the substitution through a ring
+     * buffer. The result is the same, only two cores are used.
+     */
+    unsigned int pipeline;
+
+    /**
+     * If not 0, the letters of the message are split into segments of
+     * this many letters, a multiple of 5. Each segment is ciphered with
+     * its own deck, derived from the key and the segment number by
+     * px_segkey(), so the segments are processed in parallel. The
+     * cipher text differs from the one without segments, so the same
+     * length has to be given for decryption.
+     */
+    unsigned long segment;
+
+    /**
+     * Number of threads for the segments, 0 for one per processor.
+     */
+    int nthreads;
 };
 
+/**
+ * Gets the name of a key stream engine, like "table" for
+ * PX_ENG_TABLE.
+ *
+ * \param engine  The engine, PX_ENG_*.
+ *
+ * \returns The name, NULL if there is no such engine.
+ */
+const char *px_engname(const unsigned int engine);
+
+/**
+ * Checks a key stream engine. It has to yield the key streams of Bruce
+ * Schneier's test vectors, and the same cards as the reference engine
+ * for the keys of the test vectors and decks with the jokers at the
+ * edges. Each engine is checked once, later calls return the result of
+ * the first.
+ *
+ * \param engine  The engine, PX_ENG_*.
+ *
+ * \returns 0 if the engine passed, -1 if it failed or does not exist.
+ */
+int px_engcheck(const unsigned int engine);
+
+/**
+ * Selects a key stream engine by name, checked by px_engcheck().
+ *
+ * "auto" picks the fastest engine that passes the check. The engines
+ * are timed on a short key stream on the first call, later calls
+ * return the same engine.
+ *
+ * \param name  The name of the engine, see px_engname(), or "auto".
+ *
+ * \returns The engine, PX_ENG_*, or -1 if there is no engine of that
+ *          name or it failed the check.
+ */
+int px_engselect(const char *name);
+
 /**
  * Encrypts a message using the pontifex algorithm.
  *
@@ -90,6 +181,120 @@ int px_stream(
     char **buf,
     const struct px_opts *opts);
 
+/**
+ * State of an open key stream, see px_ksopen().
+ * The deck may point into the struct, so it must not be copied.
+ */
+struct px_ks {
+    card *deck; /* 54 cards of deck, then 54 of scratch memory */
+    void *slot; /* the secure memory slot, NULL if local is used */
+    card local[2 * 54];
+    card (*round)(card *, card *); /* round function of the engine */
+    struct px_stats *stats;
+};
+
+/**
+ * Opens a key stream, that is read piecewise with px_ksread(), e.g.
+ * for key streams that do not fit into memory.
+ *
+ * \param ks    out: The key stream state.
+ * \param key   Pointer to the 54-element long key.
+ * \param opts  Options for the crypto algorithm.
+ *
+ * \returns     0 on success, -1 on failure.
+ */
+int px_ksopen(struct px_ks *ks, const card *key, const struct px_opts *opts);
+
+/**
+ * Generates the next letters of an open key stream.
+ *
+ * \param ks    The key stream state.
+ * \param buf   out: n ASCII letters, not 0-terminated.
+ * \param n     Number of letters.
+ *
+ * \returns     0 on success, -1 on failure.
+ */
+int px_ksread(struct px_ks *ks, char *buf, const int n);
+
+/**
+ * Closes a key stream and wipes its deck.
+ *
+ * \param ks    The key stream state.
+ */
+void px_ksclose(struct px_ks *ks);
+
+/** Key stream cards generated at once by px_rand_bytes(). */
+#define PX_RANDBLOCK 4096
+
+/**
+ * State of a byte source, see px_rand_open().
+ * Holds a px_ks, so it must not be copied either.
+ */
+struct px_rand {
+    struct px_ks ks;
+    card cards[PX_RANDBLOCK]; /* key stream cards 1-52 */
+    int ncards; /* cards in the block */
+    int next; /* next card to extract bits from */
+    unsigned long bits; /* extracted bits not yet returned */
+    int nbits;
+};
+
+/**
+ * Opens the key stream of a key as a deterministic source of bytes,
+ * e.g. for simulations and test data.
+ *
+ * Each card of the key stream yields some bits, depending on the
+ * range its value v = 1-52 falls into: 5 bits for v = 1-32, 4 bits for
+ * 33-48 and 2 bits for 49-52. If the cards were uniform, so would be
+ * the bits, 4.46 per card on average. Solitaire's key stream is known
+ * to be slightly biased though, so the bytes are not fit for keys.
+ *
+ * \param r     out: The byte source.
+ * \param key   Pointer to the 54-element long key.
+ * \param opts  Options for the crypto algorithm.
+ *
+ * \returns     0 on success, -1 on failure.
+ */
+int px_rand_open(
+    struct px_rand *r,
+    const card *key,
+    const struct px_opts *opts);
+
+/**
+ * Gets the next bytes of a byte source.
+ *
+ * \param r     The byte source.
+ * \param buf   out: n bytes.
+ * \param n     Number of bytes.
+ *
+ * \returns     0 on success, -1 on failure.
+ */
+int px_rand_bytes(struct px_rand *r, unsigned char *buf, const size_t n);
+
+/**
+ * Closes a byte source and wipes its state.
+ *
+ * \param r     The byte source.
+ */
+void px_rand_close(struct px_rand *r);
+
+/**
+ * Counts how many leading letters of an expected key stream a key
+ * reproduces. The key stream is generated only up to the first letter
+ * that differs, so most wrong keys are rejected after a few rounds.
+ *
+ * Since a known plain text and cipher text pair only reveals the key
+ * stream modulo 26, the letters are compared modulo 26.
+ *
+ * \param key     Pointer to the 54-element long key.
+ * \param expect  The expected key stream letters, as numbers 1-26.
+ * \param n       Number of expected letters.
+ *
+ * \returns       The number of matching letters, n if all match,
+ *                -1 on failure.
+ */
+int px_ksmatch(const card *key, const card *expect, const int n);
+
 /**
  * Generates a key for the pontifex key stream algorithm based on a
  * password.
@@ -105,5 +310,43 @@ int px_keygen(
     const int mvjokers,
     card * const key);
 
+/**
+ * Derives the deck of a segment from the key, see px_opts.segment.
+ *
+ * The segment number is written as PX_SEGDIGITS base-26 letters, most
+ * significant first, which are applied to the key like the letters of
+ * a password in px_keygen(), without moving the jokers.
+ *
+ * \param key     Pointer to the 54-element long key.
+ * \param index   The segment number, from 0.
+ * \param segkey  out: The deck of the segment.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_segkey(const card *key, const unsigned long index, card *segkey);
+
+/**
+ * Generates keys for many passwords at once. The keys are the same as
+ * the ones of px_keygen(), but no warnings about weak passwords are
+ * logged.
+ *
+ * Several passwords are processed in interleaved lanes per thread,
+ * and the lanes are spread over a pool of threads.
+ *
+ * \param passwords Pointers to n zero-terminated password strings.
+ * \param n         Number of passwords.
+ * \param mvjokers  Boolean flag that defines if the jokers shall be moved.
+ * \param keys      out: Pointer to n * 54 cards for the generated keys,
+ *                  in the order of the passwords.
+ * \param nthreads  Number of threads, 0 for one per processor.
+ * \returns         0 on success, -1 on failure.
+ */
+int px_keygens(
+    const char * const *passwords,
+    const int n,
+    const int mvjokers,
+    card *keys,
+    const int nthreads);
+
 #endif
 
@@ -0,0 +1,180 @@
+/*
+ *  px_deck.c : Implementation of the compact deck encodings.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "./px_deck.h"
+
+/* Largest product of radices that is processed in one pass, so a
+   byte times the product fits into 32 bits. */
+#define RADIXMAX (1UL << 24)
+
+/*
+ * Counts the set bits of a 32 bit word.
+ */
+static int _popcount(unsigned long x) {
+    x = x - ((x >> 1) & 0x55555555UL);
+    x = (x & 0x33333333UL) + ((x >> 2) & 0x33333333UL);
+    x = (x + (x >> 4)) & 0x0f0f0f0fUL;
+    return ((x * 0x01010101UL) & 0xffffffffUL) >> 24;
+}
+
+/*
+ * Computes the Lehmer code of a deck, digit i in base 54 - i.
+ * The unused cards are tracked as bits of two 27 bit words, so each
+ * digit is the number of bits below the card.
+ *
+ * \returns 0 on success, -1 if the deck is invalid.
+ */
+static int _lehmer(const card *deck, unsigned char *code) {
+    unsigned long left[2] = { 0x7ffffffUL, 0x7ffffffUL }; /* unused */
+    int i, c, w, b;
+
+    for (i = 0; i < 54; i++) {
+        c = deck[i] - 1;
+        if (c < 0 || c > 53) return -1;
+        w = c / 27;
+        b = c % 27;
+        if (!((left[w] >> b) & 1)) return -1;
+        left[w] &= ~(1UL << b);
+
+        /* unused cards below c */
+        code[i] = _popcount(left[w] & ((1UL << b) - 1))
+                + w * _popcount(left[0]);
+    }
+
+    return 0;
+}
+
+/*
+ * Computes the rank of a deck.
+ * See header.
+ */
+int px_rank(const card *deck, unsigned char *rank) {
+    unsigned char code[54];
+    unsigned long m, d, v;
+    int i, j;
+
+    if (_lehmer(deck, code)) return -1;
+
+    /*
+     * Horner: rank = rank * (54 - i) + code[i], with as many digits
+     * at once as fit into RADIXMAX.
+     */
+    memset(rank, 0, PX_RANKLEN);
+    for (i = 0; i < 54;) {
+        for (m = 1, d = 0; i < 54 && m * (54 - i) <= RADIXMAX; i++) {
+            m *= 54 - i;
+            d = d * (54 - i) + code[i];
+        }
+
+        for (j = PX_RANKLEN - 1, v = d; j >= 0; j--) {
+            v += rank[j] * m;
+            rank[j] = v & 0xff;
+            v >>= 8;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Restores a deck from its rank.
+ * See header.
+ */
+int px_unrank(const unsigned char *rank, card *deck) {
+    unsigned char r[PX_RANKLEN], code[54], left[54];
+    unsigned long m, v;
+    int i, j, k,
+        lead = 0; /* leading zero bytes of r */
+
+    /*
+     * The digits are the remainders of dividing by 1, 2, ... 54, as
+     * many at once as fit into RADIXMAX.
+     */
+    memcpy(r, rank, PX_RANKLEN);
+    for (i = 53; i >= 0;) {
+        for (m = 1, k = i; k >= 0 && m * (54 - k) <= RADIXMAX; k--) {
+            m *= 54 - k;
+        }
+
+        for (j = lead, v = 0; j < PX_RANKLEN; j++) {
+            v = (v << 8) | r[j];
+            r[j] = v / m;
+            v %= m;
+        }
+        while (lead < PX_RANKLEN && !r[lead]) lead++;
+
+        for (; i > k; i--) {
+            code[i] = v % (54 - i);
+            v /= 54 - i;
+        }
+    }
+
+    /* Something left means the rank was 54! or above. */
+    if (lead < PX_RANKLEN) return -1;
+
+    for (i = 0; i < 54; i++) left[i] = i + 1;
+    for (i = 0; i < 54; i++) {
+        deck[i] = left[code[i]];
+        memmove(left + code[i], left + code[i] + 1, 53 - i - code[i]);
+    }
+
+    return 0;
+}
+
+/*
+ * Packs a deck to 6 bits per card.
+ * See header.
+ */
+void px_pack6(const card *deck, unsigned char *packed) {
+    int i;
+
+    for (i = 0; i < 52; i += 4, packed += 3) {
+        packed[0] = (deck[i] << 2) | (deck[i + 1] >> 4);
+        packed[1] = (deck[i + 1] << 4) | (deck[i + 2] >> 2);
+        packed[2] = (deck[i + 2] << 6) | deck[i + 3];
+    }
+    packed[0] = (deck[52] << 2) | (deck[53] >> 4);
+    packed[1] = deck[53] << 4;
+}
+
+/*
+ * Unpacks a deck.
+ * See header.
+ */
+int px_unpack6(const unsigned char *packed, card *deck) {
+    unsigned char code[54];
+    int i;
+
+    for (i = 0; i < 52; i += 4, packed += 3) {
+        deck[i] = packed[0] >> 2;
+        deck[i + 1] = ((packed[0] & 0x03) << 4) | (packed[1] >> 4);
+        deck[i + 2] = ((packed[1] & 0x0f) << 2) | (packed[2] >> 6);
+        deck[i + 3] = packed[2] & 0x3f;
+    }
+    deck[52] = packed[0] >> 2;
+    deck[53] = ((packed[0] & 0x03) << 4) | (packed[1] >> 4);
+
+    return (packed[1] & 0x0f) || _lehmer(deck, code) ? -1 : 0;
+}
+
+#undef RADIXMAX
@@ -0,0 +1,80 @@
+#ifndef PX_DECK__H_
+#define PX_DECK__H_
+
+/*
+ *  px_deck.h : declares compact encodings of decks, for keeping many
+ *              deck states in memory.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "./px_common.h"
+
+/** Size of a deck rank, 54! < 2^238. */
+#define PX_RANKLEN 30
+
+/** Size of a deck packed to 6 bits per card. */
+#define PX_PACK6LEN 41
+
+/**
+ * Computes the rank of a deck among all 54! orders of the cards, in
+ * lexicographic order. The identity deck 1, 2, ... 54 has rank 0.
+ *
+ * The rank is built from the Lehmer code of the deck, the number of
+ * smaller cards behind each card, as mixed-radix number. It is written
+ * big-endian, so memcmp() on ranks orders the decks like their cards.
+ *
+ * \param deck  The deck, containing numbers 1-54.
+ * \param rank  out: PX_RANKLEN bytes.
+ *
+ * \returns 0 on success, -1 if the deck holds invalid or duplicate
+ *          cards.
+ */
+int px_rank(const card *deck, unsigned char *rank);
+
+/**
+ * Restores a deck from its rank, see px_rank().
+ *
+ * \param rank  PX_RANKLEN bytes.
+ * \param deck  out: The deck.
+ *
+ * \returns 0 on success, -1 if the rank is not below 54!.
+ */
+int px_unrank(const unsigned char *rank, card *deck);
+
+/**
+ * Packs a deck to 6 bits per card, 4 cards to 3 bytes, most
+ * significant bit first. The last 4 bits are 0.
+ *
+ * \param deck    The deck, containing numbers 1-54.
+ * \param packed  out: PX_PACK6LEN bytes.
+ */
+void px_pack6(const card *deck, unsigned char *packed);
+
+/**
+ * Unpacks a deck packed with px_pack6().
+ *
+ * \param packed  PX_PACK6LEN bytes.
+ * \param deck    out: The deck.
+ *
+ * \returns 0 on success, -1 if the cards are not a valid deck.
+ */
+int px_unpack6(const unsigned char *packed, card *deck);
+
+#endif
+
@@ -0,0 +1,134 @@
+/*
+ *  px_gentab.c : Build-time generator for the keystream step tables.
+ *                Writes the C source of px_steptab (see px_steptab.h)
+ *                to stdout.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The deck is simulated on position labels: Initially, every slot
+ * holds its own index. After performing the joker move and the triple
+ * cut exactly like px_mjokers() and px_tcut() do, slot i holds the
+ * old index of the card that ended up there, which is the gather
+ * index.
+ */
+
+/*
+ * Move a label in the deck to another position, see px_move().
+ */
+static void move(unsigned char *lab, int oldi, int newi) {
+    unsigned char buffer;
+    int i;
+
+    if (oldi == newi) return;
+
+    buffer = lab[oldi];
+
+    if (oldi < newi) {
+        for (i = oldi; i < newi; i++) lab[i] = lab[i+1];
+    } else {
+        for (i = oldi; i > newi; i--) lab[i] = lab[i-1];
+    }
+
+    lab[newi] = buffer;
+}
+
+/*
+ * Returns the position of a label.
+ */
+static int find(const unsigned char *lab, int label) {
+    int i;
+    for (i = 0; i < 54; i++) {
+        if (lab[i] == label) return i;
+    }
+    return -1;
+}
+
+/*
+ * Computes the gather indices for the jokers initially located
+ * at the positions ja and jb.
+ */
+static void gather(int ja, int jb, unsigned char *lab) {
+    unsigned char buffer[54];
+    int i, j, j1, j2, lp1, lp2, lp3;
+
+    for (i = 0; i < 54; i++) lab[i] = i;
+
+    /* Move jokers, see px_mjokers(). */
+    j = find(lab, ja);
+    move(lab, j, (j % 53) + 1);
+
+    j = find(lab, jb);
+    i = (j % 53) + 1;
+    i = (i % 53) + 1;
+    move(lab, j, i);
+
+    /* Triple cut, see px_tcut(). */
+    i = find(lab, ja);
+    j = find(lab, jb);
+    j1 = i < j ? i : j;
+    j2 = i > j ? i : j;
+    lp1 = j1;
+    lp2 = j2-j1+1;
+    lp3 = 53-j2;
+
+    memcpy(buffer, lab+j2+1, lp3);
+    memcpy(buffer+lp3, lab+j1, lp2);
+    memcpy(buffer+lp2+lp3, lab, lp1);
+    memcpy(lab, buffer, sizeof(buffer));
+}
+
+int main(void) {
+    unsigned char lab[54];
+    int ja, jb, i;
+
+    printf(
+        "/*\n"
+        " * px_steptab.c : GENERATED by px_gentab. Do not edit.\n"
+        " */\n\n"
+        "#include \"./px_steptab.h\"\n\n"
+        "const struct px_step px_steptab[54][54] = {\n");
+
+    for (ja = 0; ja < 54; ja++) {
+        printf("  {\n");
+        for (jb = 0; jb < 54; jb++) {
+            if (ja == jb) {
+                memset(lab, 0, sizeof(lab)); /* unused entry */
+            } else {
+                gather(ja, jb, lab);
+            }
+
+            printf("    {{");
+            for (i = 0; i < 54; i++) {
+                if (i % 18 == 0) printf("\n      ");
+                printf("%2i,", lab[i]);
+            }
+            printf("\n    }},\n");
+        }
+        printf("  },\n");
+    }
+
+    printf("};\n");
+
+    return 0;
+}
+
@@ -31,7 +31,97 @@ static const char beg_msgblk[] = "-----BEGIN PONTIFEX MESSAGE-----";
 static const char end_msgblk[] = "-----END PONTIFEX MESSAGE-----";
 static const char beg_keyblk[] = "-----BEGIN PONTIFEX KEY-----";
 static const char end_keyblk[] = "-----END PONTIFEX KEY-----";
+static const char idfield[] = "Key-Id:";
+static const char segfield[] = "Segment-Length:";
 
+/*
+ * Character classes for reading keys: the value of a digit,
+ * S for whitespace and X for anything else.
+ */
+#define X -1
+#define S -2
+static const signed char keychars[256] = {
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  S,  S,  S,  S,  S,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     S,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,
+     X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X,  X
+};
+#undef X
+#undef S
+
+
+/*
+ * Copies the alphabetic characters between start and end to a new
+ * upper case, 0-terminated buffer.
+ *
+ * \returns the length of the buffer, 0-terminator included,
+ *          -1 on failure.
+ */
+static int _rdletters(const char *start, const char *end, char **buf) {
+    char c;
+    int i = 0;
+
+    *buf = px_malloc(sizeof(char) * (end - start + 1)); /* null term */
+    if (!(*buf)) return -1;
+
+    while (start < end) {
+        c = *start;
+        if (isalpha(c)) {
+            (*buf)[i++] = toupper(c);
+        } else if (!c) {
+            break;
+        }
+        start++;
+    }
+
+    (*buf)[i++] = 0;
+
+    return i;
+}
+
+/*
+ * Checks if a frame line starts at p.
+ */
+static int _isframe(const char *p, const char *end, const char *frame) {
+    size_t n = strlen(frame);
+    return (size_t)(end - p) >= n && memcmp(p, frame, n) == 0;
+}
+
+/*
+ * Reads the "Segment-Length:" line at the start of a message block,
+ * if there is one, and moves p behind it.
+ *
+ * \returns The segment length, 0 if there is no such line.
+ */
+static unsigned long _rdseglen(const char **p, const char *end) {
+    const char *q = *p;
+    unsigned long n = 0;
+
+    while (q < end && isspace(*q)) q++;
+    if (!_isframe(q, end, segfield)) return 0;
+    q += sizeof(segfield) - 1;
+
+    while (q < end && *q == ' ') q++;
+    while (q < end && isdigit(*q) && n < 100000000UL) {
+        n = n * 10 + (*q++ - '0');
+    }
+
+    while (q < end && *q != '\n') q++;
+    *p = q;
+    return n;
+}
 
 /*
  * =============  Header API implementation ================
@@ -46,27 +136,363 @@ void px_prcipher(
     FILE *stream,
     const unsigned int flags) {
 
+    char *buf = NULL;
+    int n;
+
+    n = px_fmtcipher(ctext, flags, &buf);
+    if (n < 0) {
+        LOG_ERR(("Internal memory error!\n"));
+        return;
+    }
+
+    fwrite(buf, sizeof(char), n, stream);
+    px_free(buf);
+}
+
+/**
+ * Format the cipher text as groups of 5 characters into a buffer.
+ * See header.
+ */
+int px_fmtcipher(
+    const char * const ctext,
+    const unsigned int flags,
+    char **buf) {
+
+    return px_fmtsegments(ctext, flags, 0, buf);
+}
+
+/**
+ * Format the cipher text of a segmented message.
+ * See header.
+ */
+int px_fmtsegments(
+    const char * const ctext,
+    const unsigned int flags,
+    const unsigned long seglen,
+    char **buf) {
+
     int raw = 0; /* bool flag */
     char c;
-    int i = 0;
+    int i = 0,
+        o = 0; /* write index */
+    size_t n;
 
     raw = (flags & PXO_RAW);
-    if (!raw) fprintf(stream, "\n\n%s\n\n", beg_msgblk);
+
+    /* Each letter is followed by at most one separator. */
+    n = 2 * strlen(ctext) + sizeof(beg_msgblk) + sizeof(end_msgblk)
+        + sizeof(segfield) + 40;
+    *buf = px_malloc(n * sizeof(char));
+    if (!*buf) return -1;
+
+    if (!raw) o += sprintf(*buf + o, "\n\n%s\n\n", beg_msgblk);
+    if (!raw && seglen) o += sprintf(*buf + o, "%s %lu\n\n", segfield, seglen);
 
     while ((c = ctext[i++])) {
-        fputc(c, stream);
+        (*buf)[o++] = c;
 
         /* Grouping and linebreaks */
         if (i % 40 == 0 ) {
-            fputc('\n', stream);
+            (*buf)[o++] = '\n';
         } else if (i % 5 == 0) {
-            fputc(' ', stream);
+            (*buf)[o++] = ' ';
         }
     }
 
-    if (i % 40 != 1) fputc('\n', stream);
+    if (i % 40 != 1) (*buf)[o++] = '\n';
 
-    if (!raw) fprintf(stream, "\n%s\n\n", end_msgblk);
+    if (!raw) o += sprintf(*buf + o, "\n%s\n\n", end_msgblk);
+
+    (*buf)[o] = '\0';
+
+    return o;
+}
+
+/**
+ * Convert letters to card values in place.
+ * See header.
+ */
+int px_tocards(char *text) {
+    int i;
+
+    for (i = 0; text[i]; i++) text[i] = ASCII2CARD(text[i]);
+    return i;
+}
+
+/**
+ * Read card values as letters.
+ * See header.
+ */
+int px_rdcards(const char *data, const int ndata, char **buf) {
+    int i;
+
+    *buf = px_malloc(ndata + 1);
+    if (!*buf) return -1;
+
+    for (i = 0; i < ndata; i++) {
+        if (data[i] < 1 || data[i] > 26) {
+            LOG_ERR(("Invalid card value %i at byte %i.\n", data[i], i));
+            px_free(*buf);
+            *buf = NULL;
+            return -1;
+        }
+        (*buf)[i] = CARD2ASCII(data[i]);
+    }
+    (*buf)[ndata] = '\0';
+
+    return ndata + 1;
+}
+
+/* Header of packed letters: magic "PX5", version, 32 bit length. */
+static const char pkmagic[4] = { 'P', 'X', '5', 1 };
+
+/*
+ * Packs 8 values of 5 bits into 5 bytes.
+ */
+static void _pack8(const unsigned char *v, unsigned char *b) {
+    b[0] = (v[0] << 3) | (v[1] >> 2);
+    b[1] = (v[1] << 6) | (v[2] << 1) | (v[3] >> 4);
+    b[2] = (v[3] << 4) | (v[4] >> 1);
+    b[3] = (v[4] << 7) | (v[5] << 2) | (v[6] >> 3);
+    b[4] = (v[6] << 5) | v[7];
+}
+
+/*
+ * Unpacks 5 bytes into 8 values of 5 bits.
+ */
+static void _unpack8(const unsigned char *b, unsigned char *v) {
+    v[0] = b[0] >> 3;
+    v[1] = ((b[0] << 2) | (b[1] >> 6)) & 0x1f;
+    v[2] = (b[1] >> 1) & 0x1f;
+    v[3] = ((b[1] << 4) | (b[2] >> 4)) & 0x1f;
+    v[4] = ((b[2] << 1) | (b[3] >> 7)) & 0x1f;
+    v[5] = (b[3] >> 2) & 0x1f;
+    v[6] = ((b[3] << 3) | (b[4] >> 5)) & 0x1f;
+    v[7] = b[4] & 0x1f;
+}
+
+/**
+ * Pack letters into 5 bits each.
+ * See header.
+ */
+int px_pack(const char *text, char **buf) {
+    unsigned long n;
+    int nbuf;
+
+    n = strlen(text);
+    if (n > 0x7fffffffUL / 5 - PX_PKHEADER) return -1;
+    nbuf = PX_PKHEADER + (n * 5 + 7) / 8;
+
+    *buf = px_malloc(nbuf);
+    if (!*buf) return -1;
+
+    px_pkhead(n, *buf);
+    px_pkletters(text, n, *buf + PX_PKHEADER);
+
+    return nbuf;
+}
+
+/**
+ * Write the header of packed letters.
+ * See header.
+ */
+void px_pkhead(const unsigned long n, char *buf) {
+    unsigned char *out = (unsigned char *)buf;
+
+    memcpy(out, pkmagic, sizeof(pkmagic));
+    out[4] = (n >> 24) & 0xff;
+    out[5] = (n >> 16) & 0xff;
+    out[6] = (n >> 8) & 0xff;
+    out[7] = n & 0xff;
+}
+
+/**
+ * Pack letters without header.
+ * See header.
+ */
+int px_pkletters(const char *text, const int n, char *buf) {
+    unsigned char v[8], last[5],
+                  *out = (unsigned char *)buf;
+    int i, j;
+
+    /* Whole groups of 8 letters, then the padded rest. */
+    for (i = 0; i + 8 <= n; i += 8, out += 5) {
+        for (j = 0; j < 8; j++) v[j] = text[i + j] - 'A';
+        _pack8(v, out);
+    }
+    if (i < n) {
+        memset(v, 0, sizeof(v));
+        for (j = 0; i + j < n; j++) v[j] = text[i + j] - 'A';
+        _pack8(v, last);
+        memcpy(out, last, (j * 5 + 7) / 8);
+    }
+
+    return (n * 5 + 7) / 8;
+}
+
+/**
+ * Unpack letters from packed data.
+ * See header.
+ */
+int px_unpack(const char *data, const int ndata, char **buf) {
+    const unsigned char *in = (const unsigned char *)data;
+    unsigned char v[8], last[5];
+    unsigned long n;
+    int i, j, bad = 0;
+
+    *buf = NULL;
+    if (ndata < PX_PKHEADER || memcmp(in, pkmagic, sizeof(pkmagic))) {
+        LOG_ERR(("The input is not packed cipher text!\n"));
+        return -1;
+    }
+
+    n = ((unsigned long)in[4] << 24) | ((unsigned long)in[5] << 16)
+      | ((unsigned long)in[6] << 8) | (unsigned long)in[7];
+    if (n > 0x7fffffffUL / 5 - PX_PKHEADER
+            || ndata != PX_PKHEADER + (n * 5 + 7) / 8) {
+        LOG_ERR(("The packed cipher text is truncated or damaged!\n"));
+        return -1;
+    }
+    in += PX_PKHEADER;
+
+    *buf = px_malloc(n + 1);
+    if (!*buf) return -1;
+
+    for (i = 0; i + 8 <= n; i += 8, in += 5) {
+        _unpack8(in, v);
+        for (j = 0; j < 8; j++) {
+            bad |= v[j] > 25;
+            (*buf)[i + j] = v[j] + 'A';
+        }
+    }
+    if (i < n) {
+        memset(last, 0, sizeof(last));
+        memcpy(last, in, ((n - i) * 5 + 7) / 8);
+        _unpack8(last, v);
+        for (j = 0; i + j < n; j++) {
+            bad |= v[j] > 25;
+            (*buf)[i + j] = v[j] + 'A';
+        }
+    }
+    (*buf)[n] = '\0';
+
+    if (bad) {
+        LOG_ERR(("The packed cipher text holds invalid letters!\n"));
+        px_free(*buf);
+        *buf = NULL;
+        return -1;
+    }
+
+    return n + 1;
+}
+
+/* Letters per rest of 0-4 bytes in base-26. */
+static const int b26len[5] = { 0, 2, 4, 6, 7 };
+
+/*
+ * Writes the k lowest base-26 digits of v as letters, most
+ * significant first.
+ */
+static void _b26put(unsigned long v, char *out, int k) {
+    while (k--) {
+        out[k] = 'A' + v % 26;
+        v /= 26;
+    }
+}
+
+/*
+ * Reads k letters as base-26 number.
+ *
+ * \returns 0 on success, -1 if a letter is invalid or the number
+ *          exceeds max.
+ */
+static int _b26get(const char *in, int k, unsigned long max,
+        unsigned long *v) {
+    int i, d;
+
+    *v = 0;
+    for (i = 0; i < k; i++) {
+        d = in[i] - 'A';
+        if (d < 0 || d > 25 || *v > (max - d) / 26) return -1;
+        *v = *v * 26 + d;
+    }
+    return 0;
+}
+
+/**
+ * Transcode bytes to letters.
+ * See header.
+ */
+int px_b26enc(const char *data, const int ndata, char **buf) {
+    const unsigned char *in = (const unsigned char *)data;
+    unsigned long v;
+    int i, j, o, nbuf;
+
+    if (ndata < 0 || ndata / 4 > (0x7fffffff - 16) / 7) return -1;
+    nbuf = 7 + ndata / 4 * 7 + b26len[ndata % 4];
+
+    *buf = px_malloc(nbuf + 1);
+    if (!*buf) return -1;
+
+    _b26put(ndata, *buf, 7);
+    o = 7;
+
+    for (i = 0; i + 4 <= ndata; i += 4, o += 7) {
+        v = ((unsigned long)in[i] << 24) | ((unsigned long)in[i + 1] << 16)
+          | ((unsigned long)in[i + 2] << 8) | (unsigned long)in[i + 3];
+        _b26put(v, *buf + o, 7);
+    }
+    if (i < ndata) {
+        for (v = 0, j = i; j < ndata; j++) v = (v << 8) | in[j];
+        _b26put(v, *buf + o, b26len[ndata - i]);
+    }
+    (*buf)[nbuf] = '\0';
+
+    return nbuf + 1;
+}
+
+/**
+ * Transcode letters to bytes.
+ * See header.
+ */
+int px_b26dec(const char *text, const int ntext, char **buf) {
+    unsigned char *out;
+    unsigned long v, n;
+    int i, j, o, rest;
+
+    *buf = NULL;
+    if (ntext < 7 || _b26get(text, 7, 0xffffffffUL, &n)
+            || n > (unsigned long)(ntext - 7) / 7 * 4 + 3) {
+        goto invalid;
+    }
+    rest = n % 4;
+    if (ntext < 7 + n / 4 * 7 + b26len[rest]) goto invalid;
+
+    *buf = px_malloc(n ? n : 1);
+    if (!*buf) return -1;
+    out = (unsigned char *)*buf;
+
+    for (i = 7, o = 0; o + 4 <= n; i += 7, o += 4) {
+        if (_b26get(text + i, 7, 0xffffffffUL, &v)) goto invalid;
+        out[o] = (v >> 24) & 0xff;
+        out[o + 1] = (v >> 16) & 0xff;
+        out[o + 2] = (v >> 8) & 0xff;
+        out[o + 3] = v & 0xff;
+    }
+    if (rest) {
+        if (_b26get(text + i, b26len[rest], (1UL << (8 * rest)) - 1, &v)) {
+            goto invalid;
+        }
+        for (j = rest - 1; j >= 0; j--, v >>= 8) out[o + j] = v & 0xff;
+    }
+
+    return n;
+
+invalid:
+    LOG_ERR(("The message is no transcoded binary data!\n"));
+    if (*buf) px_free(*buf);
+    *buf = NULL;
+    return -1;
 }
 
 /**
@@ -74,6 +500,19 @@ void px_prcipher(
  * See header.
  */
 void px_prkey(const card * const key, FILE *stream, const unsigned int flags) {
+    px_prdeck(key, 54, stream, flags);
+}
+
+/**
+ * Print a key of any deck size to a file.
+ * See header.
+ */
+void px_prdeck(
+    const card * const key,
+    const int ncards,
+    FILE *stream,
+    const unsigned int flags) {
+
     int i,
         raw; /* bool flag */
 
@@ -81,7 +520,7 @@ void px_prkey(const card * const key, FILE *stream, const unsigned int flags) {
 
     if (!raw) fprintf(stream, "%s\n", beg_keyblk);
 
-    for (i = 0; i < 54; i++) {
+    for (i = 0; i < ncards; i++) {
         fprintf(stream, "%02i", key[i]);
     }
     fputc('\n', stream);
@@ -89,14 +528,25 @@ void px_prkey(const card * const key, FILE *stream, const unsigned int flags) {
     if (!raw) fprintf(stream, "%s\n", end_keyblk);
 }
 
+/**
+ * Print a key with its ID as PONTIFEX KEY block.
+ * See header.
+ */
+void px_prkeyent(const struct px_keyent *key, FILE *stream) {
+    fprintf(stream, "%s\n", beg_keyblk);
+    if (key->id[0]) {
+        fprintf(stream, "%s %.*s\n", idfield, PX_KEYIDLEN, key->id);
+    }
+    px_prkey(key->deck, stream, PXO_RAW);
+    fprintf(stream, "%s\n", end_keyblk);
+}
+
 /**
  * Read a cipher text message.
  * See header.
  */
 int px_rdcipher(const char *ciphert, char **buf) {
-    char *start, *end;
-    char c;
-    int i = 0;
+    const char *start, *end;
 
     *buf = NULL;
 
@@ -105,22 +555,75 @@ int px_rdcipher(const char *ciphert, char **buf) {
     start += strlen(beg_msgblk);
     end = strstr(ciphert, end_msgblk);
     if (end < start) return -1;
-    *buf = malloc(sizeof(char) * (end - start + 1)); /* null term */
-    if (!(*buf)) return -1;
+    _rdseglen(&start, end);
 
-    while (start < end) {
-        c = *start;
-        if (isalpha(c)) {
-            (*buf)[i++] = toupper(c);
-        } else if (!c) {
-            break;
+    return _rdletters(start, end, buf);
+}
+
+/**
+ * Find all PONTIFEX MESSAGE blocks within a text in a single pass.
+ * See header.
+ */
+int px_scanciphers(const char *text, const int ntext, struct px_msgblk **blks) {
+    const char *p = text,
+               *end = text + ntext,
+               *start = NULL; /* content start of the open block */
+    struct px_msgblk *tmp;
+    int n = 0,
+        size = 16;
+
+    *blks = px_malloc(size * sizeof(struct px_msgblk));
+    if (!*blks) return -1;
+
+    /*
+     * Both frame lines start with five dashes, so only the positions
+     * of '-' need to be inspected. memchr() skips the text in between
+     * using wide (SIMD) compares on common libcs.
+     */
+    while ((p = memchr(p, '-', end - p)) != NULL) {
+        if (_isframe(p, end, beg_msgblk)) {
+            if (start) LOG_WRN(("Message block without end. Skipping.\n"));
+            p += sizeof(beg_msgblk) - 1;
+            start = p;
+        } else if (_isframe(p, end, end_msgblk)) {
+            if (start) {
+                if (n == size) {
+                    size *= 2;
+                    tmp = px_realloc(*blks, size * sizeof(struct px_msgblk));
+                    if (!tmp) {
+                        px_free(*blks);
+                        *blks = NULL;
+                        return -1;
+                    }
+                    *blks = tmp;
+                }
+
+                (*blks)[n].end = p;
+                (*blks)[n].seglen = _rdseglen(&start, p);
+                (*blks)[n].start = start;
+                n++;
+                start = NULL;
+            } else {
+                LOG_WRN(("Message end without beginning. Skipping.\n"));
+            }
+            p += sizeof(end_msgblk) - 1;
+        } else {
+            p++;
         }
-        start++;
     }
 
-    (*buf)[i++] = 0;
+    if (start) LOG_WRN(("Message block without end. Skipping.\n"));
 
-    return i;
+    return n;
+}
+
+/**
+ * Read the cipher text of a message block.
+ * See header.
+ */
+int px_rdblock(const struct px_msgblk *blk, char **buf) {
+    *buf = NULL;
+    return _rdletters(blk->start, blk->end, buf);
 }
 
 /**
@@ -128,9 +631,17 @@ int px_rdcipher(const char *ciphert, char **buf) {
  * See header.
  */
 int px_rdkey(const char * keystr, card *key) {
+    return px_rddeck(keystr, 54, key);
+}
+
+/**
+ * Read a key of any deck size from text.
+ * See header.
+ */
+int px_rddeck(const char * keystr, const int ncards, card *key) {
     int i, k;
     char numbuf[3] = { 0, 0, 0 }, /* 2-chars string for next card number */
-         used[54]; /* stores which card was used how many times */
+         used[99]; /* stores which card was used how many times */
     char c;
 
     memset(used, 0, sizeof(used)); /* reset count field */
@@ -140,7 +651,7 @@ int px_rdkey(const char * keystr, card *key) {
         LOG_DBG(("Ignoring whitespace before key...\n"));
     }
 
-    for (i = 0; i < 54; i++) {
+    for (i = 0; i < ncards; i++) {
         numbuf[0] = keystr[i*2];
         if (numbuf[0] == '\0') {
             LOG_ERR(("Key at least one character too short!\n"));
@@ -159,7 +670,7 @@ int px_rdkey(const char * keystr, card *key) {
         k = atoi(numbuf);
 
         /* Validation */
-        if (k < 1 || k > 54) {
+        if (k < 1 || k > ncards) {
             LOG_ERR (("Invalid card number: %i\n", k));
             return -1;
         }
@@ -171,7 +682,7 @@ int px_rdkey(const char * keystr, card *key) {
         key[i] = k;
     }
 
-    i = 54 * 2; /* Set one byte past expected key. */
+    i = ncards * 2; /* Set one byte past expected key. */
     while ((c = keystr[i++]) == ' ' || c == 0x0a || c == 0x0d) {
         LOG_DBG(("Ignoring whitespace after key...\n"));
     }
@@ -185,3 +696,115 @@ int px_rdkey(const char * keystr, card *key) {
     return 0;
 }
 
+/*
+ * Reads the content of a PONTIFEX KEY block, up to and including
+ * its END line.
+ *
+ * \param p     in/out: Start of the block content, past the BEGIN line.
+ *              Set to the end of the block.
+ * \param end   End of the text.
+ * \param key   out: The key.
+ *
+ * \returns 0 on success, -1 if the block is invalid.
+ */
+static int _rdkeyblk(const char **p, const char *end, struct px_keyent *key) {
+    const char *q = *p,
+               *eol;
+    unsigned long used[2] = { 0, 0 }; /* bitmask of cards read so far */
+    int n = 0, /* cards read */
+        d1, d2, k, len;
+
+    memset(key, 0, sizeof(*key));
+
+    while (q < end) {
+        d1 = keychars[(unsigned char)*q];
+
+        if (d1 == -2) {
+            q++;
+        } else if (d1 >= 0) {
+            d2 = q + 1 < end ? keychars[(unsigned char)q[1]] : -1;
+            if (d2 < 0 || n == 54) return -1;
+            k = d1 * 10 + d2;
+            if (k < 1 || k > 54) return -1;
+
+            /* A card that is already in the mask is a duplicate. */
+            k--;
+            if (used[k >> 5] & (1UL << (k & 31))) return -1;
+            used[k >> 5] |= 1UL << (k & 31);
+
+            key->deck[n++] = k + 1;
+            q += 2;
+        } else if (_isframe(q, end, end_keyblk)) {
+            *p = q + sizeof(end_keyblk) - 1;
+            /* 54 distinct cards out of 54 are a permutation. */
+            return n == 54 ? 0 : -1;
+        } else if (!key->id[0] && _isframe(q, end, idfield)) {
+            q += sizeof(idfield) - 1;
+            eol = memchr(q, '\n', end - q);
+            if (!eol) eol = end;
+            while (q < eol && keychars[(unsigned char)*q] == -2) q++;
+            len = eol - q;
+            while (len && keychars[(unsigned char)q[len - 1]] == -2) len--;
+            if (len == 0 || len >= PX_KEYIDLEN) return -1;
+            memcpy(key->id, q, len);
+            q = eol;
+        } else {
+            return -1;
+        }
+    }
+
+    return -1; /* no END line */
+}
+
+/**
+ * Read all PONTIFEX KEY blocks of a text in a single pass.
+ * See header.
+ */
+int px_rdkeys(const char *text, const int ntext, struct px_keyent **keys) {
+    const char *p = text,
+               *end = text + ntext;
+    struct px_keyent *tmp;
+    int n = 0,
+        size = 0;
+
+    *keys = NULL;
+
+    /* Like px_scanciphers(), only the positions of '-' are inspected. */
+    while ((p = memchr(p, '-', end - p)) != NULL) {
+        if (!_isframe(p, end, beg_keyblk)) {
+            p++;
+            continue;
+        }
+        p += sizeof(beg_keyblk) - 1;
+
+        if (n == size) {
+            size = size ? size * 2 : 16;
+            tmp = px_realloc(*keys, size * sizeof(**keys));
+            if (!tmp) {
+                LOG_ERR(("Internal memory error!\n"));
+                goto fail;
+            }
+            *keys = tmp;
+        }
+
+        if (_rdkeyblk(&p, end, &(*keys)[n])) {
+            LOG_ERR(("Key block #%i is invalid!\n", n + 1));
+            goto fail;
+        }
+        n++;
+    }
+
+    if (n == 0 && *keys) {
+        px_free(*keys);
+        *keys = NULL;
+    }
+    return n;
+
+fail:
+    if (*keys) {
+        memset(*keys, 0, size * sizeof(**keys));
+        px_free(*keys);
+        *keys = NULL;
+    }
+    return -1;
+}
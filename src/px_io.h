@@ -25,10 +25,38 @@
 
 #include <stdio.h>
 #include "./px_common.h"
+#include "./px_alloc.h"
 
 /* FLAGS */
 #define PXO_RAW 1
 
+/* Cipher text formats */
+#define PXF_TEXT 0 /* letters in groups of five, optionally framed */
+#define PXF_CARDS 1 /* one byte per letter, with the values 1-26 */
+#define PXF_PACKED 2 /* 5 bits per letter, see px_pack() */
+
+/** Size of a key ID, including the NUL padding. */
+#define PX_KEYIDLEN 32
+
+/**
+ * Location of the content of a PONTIFEX MESSAGE block within a text,
+ * frame lines excluded.
+ */
+struct px_msgblk {
+    const char *start; /* first letter after the BEGIN and header lines */
+    const char *end; /* first character of the END line */
+    unsigned long seglen; /* from the "Segment-Length:" line, 0 if none */
+};
+
+/**
+ * A key read from a PONTIFEX KEY block.
+ */
+struct px_keyent {
+    char id[PX_KEYIDLEN]; /* from the "Key-Id:" line, NUL-padded,
+                             empty if the block has none */
+    card deck[54];
+};
+
 /**
  * Print the cipher text as groups of 5 characters.
  *
@@ -41,6 +69,144 @@ void px_prcipher(
     FILE *stream,
     const unsigned int flags);
 
+/**
+ * Format the cipher text as groups of 5 characters into a buffer,
+ * exactly as px_prcipher() prints it.
+ *
+ * \para ctext  The ciphertext, zero-terminated.
+ * \para flags  Output options.
+ * \para buf    out: Pointer to the allocated, zero-terminated result.
+ *
+ * \returns The length of the result, 0-terminator excluded,
+ *          -1 on failure.
+ */
+int px_fmtcipher(
+    const char * const ctext,
+    const unsigned int flags,
+    char **buf);
+
+/**
+ * Format the cipher text of a segmented message like px_fmtcipher().
+ * Framed output gets a "Segment-Length:" line after the BEGIN line,
+ * which px_scanciphers() reads back.
+ *
+ * \para ctext   The ciphertext, zero-terminated.
+ * \para flags   Output options.
+ * \para seglen  Letters per segment, see px_opts. 0 for no segments.
+ * \para buf     out: Pointer to the allocated, zero-terminated result.
+ *
+ * \returns The length of the result, 0-terminator excluded,
+ *          -1 on failure.
+ */
+int px_fmtsegments(
+    const char * const ctext,
+    const unsigned int flags,
+    const unsigned long seglen,
+    char **buf);
+
+/**
+ * Convert letters to card values in place, for PXF_CARDS output.
+ * The values are 1-26, so the text stays zero-terminated.
+ *
+ * \para text   The letters, zero-terminated.
+ *
+ * \returns The number of card values, 0-terminator excluded.
+ */
+int px_tocards(char *text);
+
+/**
+ * Read card values (PXF_CARDS) as letters.
+ *
+ * \para data   The card values.
+ * \para ndata  Number of card values.
+ * \para buf    out: Pointer to the allocated, zero-terminated letters.
+ *
+ * \returns The number of letters, 0-terminator included,
+ *          -1 if a byte is not a card value from 1 to 26 or on failure.
+ */
+int px_rdcards(const char *data, const int ndata, char **buf);
+
+/**
+ * Pack letters into 5 bits each, for PXF_PACKED output.
+ *
+ * The packed data starts with an 8 byte header, the magic "PX5", the
+ * version 1 and the number of letters as big-endian 32 bit number.
+ * The letters follow as values 0-25, most significant bit first, so
+ * each 8 letters take 5 bytes. The last byte is padded with 0 bits.
+ *
+ * \para text   The letters, zero-terminated.
+ * \para buf    out: Pointer to the allocated packed data.
+ *
+ * \returns The number of bytes, -1 on failure.
+ */
+int px_pack(const char *text, char **buf);
+
+/** Size of the header of packed letters. */
+#define PX_PKHEADER 8
+
+/**
+ * Write the header of packed letters, see px_pack(). Together with
+ * px_pkletters(), letters can be packed piecewise, e.g. for streams.
+ *
+ * \para n      Number of letters that follow.
+ * \para buf    out: PX_PKHEADER bytes.
+ */
+void px_pkhead(const unsigned long n, char *buf);
+
+/**
+ * Pack letters without header, see px_pack(). Pieces of a multiple of
+ * 8 letters can be concatenated.
+ *
+ * \para text   The letters.
+ * \para n      Number of letters.
+ * \para buf    out: (n * 5 + 7) / 8 bytes.
+ *
+ * \returns The number of bytes.
+ */
+int px_pkletters(const char *text, const int n, char *buf);
+
+/**
+ * Unpack letters from packed data (PXF_PACKED).
+ *
+ * \para data   The packed data, see px_pack().
+ * \para ndata  Number of bytes.
+ * \para buf    out: Pointer to the allocated, zero-terminated letters.
+ *
+ * \returns The number of letters, 0-terminator included,
+ *          -1 if the data is not packed letters or on failure.
+ */
+int px_unpack(const char *data, const int ndata, char **buf);
+
+/**
+ * Transcode arbitrary bytes to letters, so binary data survives the
+ * cipher, which drops everything else.
+ *
+ * Each group of 4 bytes is read as big-endian 32 bit number and
+ * written as 7 base-26 digits A-Z, most significant first. A rest of
+ * 1, 2 or 3 bytes takes 2, 4 or 6 letters. The letters are preceded
+ * by the number of bytes, encoded like a group of 4 bytes.
+ *
+ * \para data   The bytes.
+ * \para ndata  Number of bytes.
+ * \para buf    out: Pointer to the allocated, zero-terminated letters.
+ *
+ * \returns The number of letters, 0-terminator included, -1 on failure.
+ */
+int px_b26enc(const char *data, const int ndata, char **buf);
+
+/**
+ * Transcode letters back to bytes, see px_b26enc().
+ * Letters after the encoded bytes, like padding, are ignored.
+ *
+ * \para text   The letters.
+ * \para ntext  Number of letters.
+ * \para buf    out: Pointer to the allocated bytes.
+ *
+ * \returns The number of bytes, -1 if the letters are no valid
+ *          encoding or on failure.
+ */
+int px_b26dec(const char *text, const int ntext, char **buf);
+
 /**
  * Print a key to a file.
  *
@@ -50,6 +216,29 @@ void px_prcipher(
  */
 void px_prkey(const card * const key, FILE *stream, const unsigned int flags);
 
+/**
+ * Print a key of another deck size than 54 cards like px_prkey(), e.g.
+ * of a variant of px_variant.h.
+ *
+ * \para key    Pointer to the key.
+ * \para ncards Number of cards, at most 99.
+ * \para stream Pointer to the output file.
+ * \para flags   Output options.
+ */
+void px_prdeck(
+    const card * const key,
+    const int ncards,
+    FILE *stream,
+    const unsigned int flags);
+
+/**
+ * Print a key with its ID as PONTIFEX KEY block, as read by px_rdkeys().
+ *
+ * \para key    The key. The "Key-Id:" line is omitted if its ID is empty.
+ * \para stream Pointer to the output file.
+ */
+void px_prkeyent(const struct px_keyent *key, FILE *stream);
+
 /**
  * Read a cipher text message.
  *
@@ -61,6 +250,31 @@ void px_prkey(const card * const key, FILE *stream, const unsigned int flags);
  */
 int px_rdcipher(const char *ciphert, char **buf);
 
+/**
+ * Find all PONTIFEX MESSAGE blocks within a text in a single pass.
+ * Unterminated blocks and END lines without a BEGIN line are skipped.
+ * A "Segment-Length:" line at the start of a block is read into the
+ * block and is not part of the cipher text.
+ *
+ * \para text   The text to scan.
+ * \para ntext  Length of the text.
+ * \para blks   out: Pointer to the allocated array of found blocks.
+ *
+ * \returns The number of blocks found, -1 on failure.
+ */
+int px_scanciphers(const char *text, const int ntext, struct px_msgblk **blks);
+
+/**
+ * Read the cipher text of a message block found by px_scanciphers().
+ *
+ * \para blk  The message block.
+ * \para buf  Pointer to buffer to write the cipher text to.
+ *
+ * \returns The length of the cipher text, 0-terminator included,
+ *          if successfull. -1 on failure.
+ */
+int px_rdblock(const struct px_msgblk *blk, char **buf);
+
 /**
  * Read a key from text.
  *
@@ -71,4 +285,32 @@ int px_rdcipher(const char *ciphert, char **buf);
  */
 int px_rdkey(const char *keystr, card *key);
 
+/**
+ * Read a key of another deck size than 54 cards like px_rdkey(), e.g.
+ * of a variant of px_variant.h.
+ *
+ * \para keystr Pointer to key text representation.
+ * \para ncards Number of cards, at most 99.
+ * \para key    Pointer to ncards cards to write the key to.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_rddeck(const char *keystr, const int ncards, card *key);
+
+/**
+ * Read all PONTIFEX KEY blocks of a text in a single pass.
+ *
+ * A block holds an optional "Key-Id:" line and the key as 54 two-digit
+ * card numbers. Whitespace between the card numbers is ignored. Unlike
+ * px_rdkey(), every key must hold each card exactly once.
+ *
+ * \para text   The text to read.
+ * \para ntext  Length of the text.
+ * \para keys   out: Pointer to the allocated array of keys. NULL if
+ *               no key was found or on failure.
+ *
+ * \returns The number of keys, -1 if any block is invalid.
+ */
+int px_rdkeys(const char *text, const int ntext, struct px_keyent **keys);
+
 #endif
@@ -0,0 +1,249 @@
+/*
+ *  px_keyring.c : Implementation of the binary keyring.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./px_keyring.h"
+#include "./logging.h"
+
+static const char magic[8] = { 'P', 'X', 'K', 'E', 'Y', 'R', 'N', 'G' };
+#define KR_VERSION 1
+#define KR_HEADER 16
+
+/*
+ * Reads a big-endian 32 bit number.
+ */
+static unsigned long _rd32(const unsigned char *p) {
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+         | ((unsigned long)p[2] << 8) | (unsigned long)p[3];
+}
+
+/*
+ * Writes a big-endian 32 bit number.
+ */
+static void _wr32(unsigned char *p, unsigned long v) {
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/*
+ * Checks that a deck holds every card exactly once.
+ *
+ * \returns 1 if the deck is valid, 0 otherwise.
+ */
+static int _isdeck(const card *deck) {
+    char used[54];
+    int i;
+
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < 54; i++) {
+        if (deck[i] < 1 || deck[i] > 54 || used[deck[i] - 1]++) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Compares two keys by ID, for qsort().
+ */
+static int _cmpkey(const void *a, const void *b) {
+    return memcmp(
+        ((const struct px_keyent *)a)->id,
+        ((const struct px_keyent *)b)->id,
+        PX_KRIDLEN);
+}
+
+/*
+ * Maps a keyring file into memory and validates its index.
+ * See header.
+ */
+int px_kropen(const char *path, struct px_keyring *kr) {
+    const unsigned char *hdr;
+    struct stat st;
+    unsigned long n;
+    int fd;
+
+    memset(kr, 0, sizeof(*kr));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERR(("Could not open keyring '%s'!\n", path));
+        return -1;
+    }
+
+    if (fstat(fd, &st) || st.st_size < KR_HEADER) {
+        LOG_ERR(("'%s' is not a keyring!\n", path));
+        close(fd);
+        return -1;
+    }
+
+    kr->nmap = st.st_size;
+    kr->map = mmap(NULL, kr->nmap, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (kr->map == MAP_FAILED) {
+        LOG_ERR(("Could not map keyring '%s'!\n", path));
+        kr->map = NULL;
+        return -1;
+    }
+
+    /* Keys stay out of core dumps, and lookups are random access. */
+    madvise(kr->map, kr->nmap, MADV_DONTDUMP);
+    madvise(kr->map, kr->nmap, MADV_RANDOM);
+
+    hdr = kr->map;
+    n = _rd32(hdr + 12);
+    if (memcmp(hdr, magic, sizeof(magic)) || _rd32(hdr + 8) != KR_VERSION
+            || n > 0x7fffffffUL / (PX_KRIDLEN + 54)
+            || kr->nmap != KR_HEADER + n * (PX_KRIDLEN + 54)) {
+        LOG_ERR(("'%s' is not a keyring or damaged!\n", path));
+        goto fail;
+    }
+
+    kr->n = n;
+    kr->ids = (const char *)hdr + KR_HEADER;
+    kr->decks = (const card *)(kr->ids + n * PX_KRIDLEN);
+
+    /*
+     * The IDs are sorted when the keyring is built. Checking the whole
+     * index here would touch all of its pages, so px_krfind() only
+     * checks the order around the ID it finds.
+     */
+
+    return 0;
+
+fail:
+    px_krclose(kr);
+    return -1;
+}
+
+/*
+ * Looks up a key by its ID.
+ * See header.
+ */
+const card *px_krfind(const struct px_keyring *kr, const char *id) {
+    char key[PX_KRIDLEN]; /* the ID, padded like in the index */
+    int lo = 0,
+        hi = kr->n - 1,
+        mid, cmp;
+    size_t len;
+
+    len = strlen(id);
+    if (len == 0 || len >= PX_KRIDLEN) return NULL;
+    memset(key, 0, sizeof(key));
+    memcpy(key, id, len);
+
+    while (lo <= hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = memcmp(key, kr->ids + mid * PX_KRIDLEN, PX_KRIDLEN);
+        if (cmp == 0) {
+            if ((mid > 0 && memcmp(kr->ids + (mid - 1) * PX_KRIDLEN,
+                        key, PX_KRIDLEN) >= 0)
+                    || (mid < kr->n - 1 && memcmp(key,
+                        kr->ids + (mid + 1) * PX_KRIDLEN, PX_KRIDLEN) >= 0)
+                    || !_isdeck(kr->decks + mid * 54)) {
+                LOG_ERR(("Key '%s' in keyring is damaged!\n", id));
+                return NULL;
+            }
+            return kr->decks + mid * 54;
+        }
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Unmaps a keyring.
+ * See header.
+ */
+void px_krclose(struct px_keyring *kr) {
+    if (kr->map) munmap(kr->map, kr->nmap);
+    memset(kr, 0, sizeof(*kr));
+}
+
+/*
+ * Converts PONTIFEX KEY blocks into a keyring file.
+ * See header.
+ */
+int px_krbuild(const char *text, const int ntext, FILE *out) {
+    struct px_keyent *keys = NULL;
+    unsigned char hdr[KR_HEADER];
+    int n, i;
+    int ret = -1;
+
+    n = px_rdkeys(text, ntext, &keys);
+    if (n < 0) goto clean;
+
+    for (i = 0; i < n; i++) {
+        if (!keys[i].id[0]) {
+            LOG_ERR(("Key #%i has no Key-Id!\n", i + 1));
+            goto clean;
+        }
+    }
+
+    qsort(keys, n, sizeof(*keys), _cmpkey);
+    for (i = 1; i < n; i++) {
+        if (!_cmpkey(&keys[i - 1], &keys[i])) {
+            LOG_ERR(("Duplicate Key-Id '%s'!\n", keys[i].id));
+            goto clean;
+        }
+    }
+
+    memcpy(hdr, magic, sizeof(magic));
+    _wr32(hdr + 8, KR_VERSION);
+    _wr32(hdr + 12, n);
+    if (fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr)) goto ioerr;
+    for (i = 0; i < n; i++) {
+        if (fwrite(keys[i].id, 1, PX_KRIDLEN, out) != PX_KRIDLEN) goto ioerr;
+    }
+    for (i = 0; i < n; i++) {
+        if (fwrite(keys[i].deck, 1, 54, out) != 54) goto ioerr;
+    }
+    if (fflush(out)) goto ioerr;
+
+    ret = n;
+    goto clean;
+
+ioerr:
+    LOG_ERR(("Could not write keyring!\n"));
+
+clean:
+    if (keys) {
+        memset(keys, 0, n * sizeof(*keys));
+        px_free(keys);
+    }
+    return ret;
+}
+
+#undef KR_VERSION
+#undef KR_HEADER
@@ -0,0 +1,113 @@
+#ifndef PX_KEYRING__H_
+#define PX_KEYRING__H_
+
+/*
+ *  px_keyring.h : declares the binary keyring, a file of many keys
+ *                 that are looked up by ID.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include "./px_common.h"
+#include "./px_io.h"
+
+/*
+ * File format (all numbers big-endian):
+ *
+ *   offset  size       content
+ *   0       8          magic "PXKEYRNG"
+ *   8       4          version, 1
+ *   12      4          number of keys n
+ *   16      n * 32     IDs, NUL-padded, sorted by memcmp()
+ *   16+n*32 n * 54     decks, in the order of the IDs
+ *
+ * The IDs are stored apart from the decks, so a lookup by binary
+ * search only touches the pages of the index on its path, plus a single
+ * deck. px_krbuild() sorts the IDs, px_kropen() only checks the header
+ * and the size, and px_krfind() checks the order around the ID it finds.
+ */
+
+/** Size of an ID in the keyring, including the NUL padding. */
+#define PX_KRIDLEN PX_KEYIDLEN
+
+/**
+ * A keyring that is mapped into memory.
+ */
+struct px_keyring {
+    void *map; /* the mapped file */
+    size_t nmap;
+    const char *ids; /* n IDs of PX_KRIDLEN bytes */
+    const card *decks; /* n decks of 54 cards */
+    int n; /* number of keys */
+};
+
+/**
+ * Maps a keyring file into memory and validates its header and size.
+ *
+ * \para path  Path of the keyring file.
+ * \para kr    out: The keyring.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_kropen(const char *path, struct px_keyring *kr);
+
+/**
+ * Looks up a key by its ID.
+ *
+ * \para kr  The keyring.
+ * \para id  The ID, at most PX_KRIDLEN - 1 characters.
+ *
+ * \returns Pointer to the 54-card key within the mapped file, NULL if
+ *          the ID is not in the keyring, the IDs around it are out of
+ *          order, or the key is not a valid deck.
+ */
+const card *px_krfind(const struct px_keyring *kr, const char *id);
+
+/**
+ * Unmaps a keyring.
+ *
+ * \para kr  The keyring.
+ */
+void px_krclose(struct px_keyring *kr);
+
+/**
+ * Converts PONTIFEX KEY blocks into a keyring file.
+ *
+ * The blocks are read with px_rdkeys(). Each block needs a "Key-Id:"
+ * line, e.g.
+ *
+ *   -----BEGIN PONTIFEX KEY-----
+ *   Key-Id: tenant-0042
+ *   0102030405...
+ *   -----END PONTIFEX KEY-----
+ *
+ * Text outside of the blocks is ignored.
+ *
+ * \para text   The text holding the key blocks.
+ * \para ntext  Length of the text.
+ * \para out    The file to write the keyring to.
+ *
+ * \returns The number of keys written, -1 on failure. Nothing is
+ *          written if a key block is invalid.
+ */
+int px_krbuild(const char *text, const int ntext, FILE *out);
+
+#endif
+
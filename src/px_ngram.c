@@ -0,0 +1,457 @@
+/*
+ *  px_ngram.c : Implementation of the ranking of passwords by quadgrams.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./px_ngram.h"
+#include "./px_crypto.h"
+#include "./px_par.h"
+#include "./px_stats.h"
+#include "./logging.h"
+
+/* Passwords read from the dictionary at once. */
+#define PX_RANKBATCH 65536
+
+/* Passwords whose keys are generated at once by a thread. */
+#define PX_RANKBLOCK 256
+
+/* Keys whose plain texts are scored side by side. */
+#define PX_RANKLANES 8
+
+/* Quadgrams of the first three letters, 26^3. */
+#define PX_NTRIS 17576
+
+#define LOAD_ACQ(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*
+ * The best passwords of a thread, as a heap with the worst on top.
+ */
+struct heap {
+    struct px_ranked *e;
+    int n;
+};
+
+/*
+ * Shared state of px_rankdict().
+ */
+struct rank {
+    const struct px_ngrams *ng;
+    const card *ct; /* the letters of the cipher text, 1-26 */
+    int nletters;
+    int nbest;
+    int mvjokers; /* bool flag */
+    int nthreads;
+    const char **words; /* the batch of passwords */
+    int nwords;
+    unsigned long base; /* dictionary line of the first word */
+    struct heap *heaps; /* one per thread */
+    int failed; /* set by any thread, LOAD_ACQ/STORE_REL */
+};
+
+/*
+ * Loads a table of quadgram counts.
+ * See header.
+ */
+int px_ngload(const char *path, struct px_ngrams *ng) {
+    FILE *f;
+    char quad[5];
+    double count, total = 0, *counts;
+    long i;
+    int j, idx;
+
+    memset(ng, 0, sizeof(*ng));
+
+    f = fopen(path, "r");
+    if (!f) {
+        LOG_ERR(("Could not open '%s'!\n", path));
+        return -1;
+    }
+
+    counts = calloc(PX_NQUADS, sizeof(double));
+    ng->logp = malloc(PX_NQUADS * sizeof(float));
+    if (!counts || !ng->logp) {
+        LOG_ERR(("Internal memory error!\n"));
+        goto fail;
+    }
+
+    while (fscanf(f, "%4s %lf", quad, &count) == 2) {
+        for (j = idx = 0; j < 4; j++) {
+            if (!isalpha(quad[j])) break;
+            idx = idx * 26 + toupper(quad[j]) - 'A';
+        }
+        if (j < 4 || count < 0) {
+            LOG_ERR(("'%s' is not a table of quadgram counts!\n", path));
+            goto fail;
+        }
+        if (counts[idx] == 0 && count > 0) ng->nquads++;
+        counts[idx] += count;
+        total += count;
+    }
+
+    if (!feof(f) || total <= 0) {
+        LOG_ERR(("'%s' is not a table of quadgram counts!\n", path));
+        goto fail;
+    }
+
+    for (i = 0; i < PX_NQUADS; i++) {
+        ng->logp[i] = log10((counts[i] > 0 ? counts[i] : 0.01) / total);
+    }
+
+    free(counts);
+    fclose(f);
+    return 0;
+
+fail:
+    free(counts);
+    px_ngfree(ng);
+    fclose(f);
+    return -1;
+}
+
+/*
+ * Frees the log probabilities.
+ * See header.
+ */
+void px_ngfree(struct px_ngrams *ng) {
+    free(ng->logp);
+    ng->logp = NULL;
+}
+
+/*
+ * Scores a text by its quadgrams.
+ * See header.
+ */
+double px_ngscore(const struct px_ngrams *ng, const char *text, const int n) {
+    double score = 0;
+    long idx = 0;
+    int i, k = 0;
+
+    for (i = 0; i < n; i++) {
+        if (!isalpha(text[i])) continue;
+        idx = idx % PX_NTRIS * 26 + toupper(text[i]) - 'A';
+        if (++k >= 4) score += ng->logp[idx];
+    }
+
+    return score;
+}
+
+/*
+ * Compares two ranked passwords, the better one first. Of equal
+ * scores, the earlier line comes first.
+ */
+static int _cmpranked(const void *a, const void *b) {
+    const struct px_ranked *x = a, *y = b;
+
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/*
+ * Offers a password to the heap of a thread. Only passwords that make
+ * it into the heap are copied.
+ *
+ * \returns 0 on success, -1 if out of memory.
+ */
+static int _offer(struct heap *h, const int nbest, const double score,
+        const unsigned long index, const char *password) {
+    struct px_ranked e;
+    int i, c;
+
+    e.score = score;
+    e.index = index;
+    if (h->n == nbest && _cmpranked(&e, &h->e[0]) >= 0) return 0;
+
+    e.password = malloc(strlen(password) + 1);
+    if (!e.password) return -1;
+    strcpy(e.password, password);
+
+    if (h->n < nbest) {
+        /* sift up from the end */
+        for (i = h->n++; i > 0 && _cmpranked(&e, &h->e[(i - 1) / 2]) > 0;
+                i = (i - 1) / 2) {
+            h->e[i] = h->e[(i - 1) / 2];
+        }
+        h->e[i] = e;
+        return 0;
+    }
+
+    /* replace the worst, and sift down */
+    free(h->e[0].password);
+    for (i = 0; (c = 2 * i + 1) < h->n; i = c) {
+        if (c + 1 < h->n && _cmpranked(&h->e[c + 1], &h->e[c]) > 0) c++;
+        if (_cmpranked(&h->e[c], &e) <= 0) break;
+        h->e[i] = h->e[c];
+    }
+    h->e[i] = e;
+    return 0;
+}
+
+/*
+ * Scores the plain texts of up to PX_RANKLANES keys.
+ *
+ * The letters of all lanes are decrypted side by side, so the table
+ * lookups of the lanes are independent of each other, and the
+ * processor overlaps their cache misses.
+ *
+ * \param kbuf  Scratch memory for PX_RANKLANES * r->nletters letters.
+ */
+static int _scorelanes(const struct rank *r, const card *keys, const int m,
+        char *kbuf, double *score) {
+    const float *logp = r->ng->logp;
+    struct px_opts opts;
+    struct px_ks ks;
+    char *k[PX_RANKLANES];
+    long idx[PX_RANKLANES];
+    int i, j, p, ret;
+
+    memset(&opts, 0, sizeof(opts));
+
+    for (i = 0; i < m; i++) {
+        k[i] = kbuf + i * r->nletters;
+        if (px_ksopen(&ks, keys + i * 54, &opts)) return -1;
+        ret = px_ksread(&ks, k[i], r->nletters);
+        px_ksclose(&ks);
+        if (ret) return -1;
+        idx[i] = 0;
+        score[i] = 0;
+    }
+
+    for (j = 0; j < r->nletters; j++) {
+        for (i = 0; i < m; i++) {
+            /* p = c - k (mod 26), as 0-25 */
+            p = (r->ct[j] - ASCII2CARD(k[i][j]) + 25) % 26;
+            idx[i] = idx[i] % PX_NTRIS * 26 + p;
+            if (j >= 3) score[i] += logp[idx[i]];
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Ranks the slice of a batch of passwords that belongs to thread t.
+ */
+static void _rankjob(void *ctx, int t) {
+    struct rank *r = ctx;
+    struct heap *h = &r->heaps[t];
+    card keys[PX_RANKBLOCK * 54];
+    double score[PX_RANKLANES];
+    char *kbuf;
+    int lo, hi, i, j, l, m, n;
+
+    lo = (long)r->nwords * t / r->nthreads;
+    hi = (long)r->nwords * (t + 1) / r->nthreads;
+
+    kbuf = malloc((size_t)PX_RANKLANES * r->nletters);
+    if (!kbuf) {
+        LOG_ERR(("Internal memory error!\n"));
+        goto fail;
+    }
+
+    for (i = lo; i < hi && !LOAD_ACQ(&r->failed); i += n) {
+        n = hi - i < PX_RANKBLOCK ? hi - i : PX_RANKBLOCK;
+        if (px_keygens(r->words + i, n, r->mvjokers, keys, 1)) goto fail;
+
+        for (j = 0; j < n; j += m) {
+            m = n - j < PX_RANKLANES ? n - j : PX_RANKLANES;
+            if (_scorelanes(r, keys + j * 54, m, kbuf, score)) goto fail;
+            for (l = 0; l < m; l++) {
+                if (_offer(h, r->nbest, score[l], r->base + i + j + l,
+                        r->words[i + j + l])) {
+                    LOG_ERR(("Internal memory error!\n"));
+                    goto fail;
+                }
+            }
+        }
+    }
+    free(kbuf);
+    return;
+
+fail:
+    free(kbuf);
+    STORE_REL(&r->failed, 1);
+}
+
+/*
+ * Ranks the passwords of a dictionary.
+ * See header.
+ */
+int px_rankdict(
+    const char *dict,
+    const char *ct,
+    const int nletters,
+    const struct px_ngrams *ng,
+    const int nbest,
+    const int mvjokers,
+    const int nthreads,
+    struct px_rankres *res) {
+
+    struct rank r;
+    FILE *f = NULL;
+    char *line = NULL, *text = NULL, *tmp;
+    size_t capline = 0, ntext, captext = 0, *offs = NULL;
+    ssize_t len;
+    card *letters = NULL;
+    double t;
+    int i, n, ret = -1;
+
+    memset(res, 0, sizeof(*res));
+    memset(&r, 0, sizeof(r));
+
+    if (dict == NULL || ct == NULL || ng == NULL || nbest <= 0) {
+        LOG_ERR(("Null pointer found. Whoops. [7e14]\n"));
+        return -1;
+    }
+
+    letters = malloc(strlen(ct) + 1);
+    if (!letters) goto nomem;
+    for (n = 0; *ct; ct++) {
+        if (isalpha(*ct)) letters[n++] = ASCII2CARD(*ct);
+    }
+    if (nletters > 0 && nletters < n) n = nletters;
+    if (n < 4) {
+        LOG_ERR(("At least four letters of cipher text are needed!\n"));
+        goto cleanup;
+    }
+
+    f = fopen(dict, "r");
+    if (!f) {
+        LOG_ERR(("Could not open '%s'!\n", dict));
+        goto cleanup;
+    }
+
+    r.ng = ng;
+    r.ct = letters;
+    r.nletters = n;
+    r.nbest = nbest;
+    r.mvjokers = mvjokers;
+    r.nthreads = nthreads > 0 ? nthreads : px_ncpus();
+    r.words = malloc(PX_RANKBATCH * sizeof(*r.words));
+    offs = malloc(PX_RANKBATCH * sizeof(*offs));
+    r.heaps = calloc(r.nthreads, sizeof(*r.heaps));
+    if (!r.words || !offs || !r.heaps) goto nomem;
+    for (i = 0; i < r.nthreads; i++) {
+        r.heaps[i].e = malloc(nbest * sizeof(struct px_ranked));
+        if (!r.heaps[i].e) goto nomem;
+    }
+
+    t = px_now();
+    for (;;) {
+        /* the next batch of words, without line breaks */
+        for (n = 0, ntext = 0; n < PX_RANKBATCH; n++) {
+            len = getline(&line, &capline, f);
+            if (len < 0) break;
+            while (len > 0
+                    && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+                len--;
+            }
+            if (ntext + len + 1 > captext) {
+                captext = 2 * (ntext + len + 1);
+                tmp = realloc(text, captext);
+                if (!tmp) goto nomem;
+                text = tmp;
+            }
+            memcpy(text + ntext, line, len);
+            offs[n] = ntext;
+            ntext += len;
+            text[ntext++] = '\0';
+        }
+        if (!n) break;
+
+        for (i = 0; i < n; i++) r.words[i] = text + offs[i];
+        r.nwords = n;
+        if (px_pfor(r.nthreads, r.nthreads, _rankjob, &r) || r.failed) {
+            goto cleanup;
+        }
+        r.base += n;
+    }
+    if (ferror(f)) {
+        LOG_ERR(("Could not read '%s'!\n", dict));
+        goto cleanup;
+    }
+
+    /* merge the heaps */
+    for (i = 0, n = 0; i < r.nthreads; i++) n += r.heaps[i].n;
+    res->best = malloc((n ? n : 1) * sizeof(struct px_ranked));
+    if (!res->best) goto nomem;
+    for (i = 0; i < r.nthreads; i++) {
+        memcpy(res->best + res->nbest, r.heaps[i].e,
+            r.heaps[i].n * sizeof(struct px_ranked));
+        res->nbest += r.heaps[i].n;
+        r.heaps[i].n = 0;
+    }
+    qsort(res->best, res->nbest, sizeof(struct px_ranked), _cmpranked);
+    while (res->nbest > nbest) free(res->best[--res->nbest].password);
+
+    res->candidates = r.base;
+    res->seconds = px_now() - t;
+    ret = 0;
+    goto cleanup;
+
+nomem:
+    LOG_ERR(("Internal memory error!\n"));
+
+cleanup:
+    if (r.heaps) {
+        for (i = 0; i < r.nthreads; i++) {
+            while (r.heaps[i].n > 0) {
+                free(r.heaps[i].e[--r.heaps[i].n].password);
+            }
+            free(r.heaps[i].e);
+        }
+        free(r.heaps);
+    }
+    if (f) fclose(f);
+    free(r.words);
+    free(offs);
+    free(line);
+    free(text);
+    free(letters);
+    return ret;
+}
+
+/*
+ * Frees the passwords of a result.
+ * See header.
+ */
+void px_rankfree(struct px_rankres *res) {
+    int i;
+
+    for (i = 0; i < res->nbest; i++) free(res->best[i].password);
+    free(res->best);
+    res->best = NULL;
+    res->nbest = 0;
+}
+
+#undef PX_RANKBATCH
+#undef PX_RANKBLOCK
+#undef PX_RANKLANES
+#undef PX_NTRIS
+#undef LOAD_ACQ
+#undef STORE_REL
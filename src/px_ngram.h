@@ -0,0 +1,137 @@
+#ifndef PX_NGRAM__H_
+#define PX_NGRAM__H_
+
+/*
+ *  px_ngram.h : declares the ranking of passwords by how much their
+ *               decryption of a cipher text looks like English.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "./px_common.h"
+
+/*
+ * Without a crib, a password can only be judged by the plain text it
+ * yields. The plain text is scored by the log probabilities of its
+ * quadgrams, sequences of four letters, which are taken from a table
+ * of quadgram counts of some large English text. The higher the score,
+ * the more English-like the text.
+ */
+
+/** Number of quadgrams, 26^4. */
+#define PX_NQUADS 456976
+
+/**
+ * Log probabilities of the quadgrams.
+ */
+struct px_ngrams {
+    float *logp; /* PX_NQUADS entries, AAAA = 0, AAAB = 1, ... */
+    unsigned long nquads; /* distinct quadgrams of the table file */
+};
+
+/**
+ * A password ranked by px_rankdict().
+ */
+struct px_ranked {
+    double score;
+    unsigned long index; /* line of the password in the dictionary */
+    char *password;
+};
+
+/**
+ * Result of px_rankdict().
+ */
+struct px_rankres {
+    struct px_ranked *best; /* the best passwords, best first */
+    int nbest;
+    unsigned long candidates; /* number of passwords tested */
+    double seconds; /* wall clock time of the ranking */
+};
+
+/**
+ * Loads a table of quadgram counts, one quadgram per line as the four
+ * letters and the count, separated by whitespace, e.g. "TION 13168375".
+ * Quadgrams that are not in the table get the log probability of a
+ * hundredth of a single count.
+ *
+ * \param path  The table file.
+ * \param ng    out: The log probabilities, to be freed by px_ngfree().
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_ngload(const char *path, struct px_ngrams *ng);
+
+/**
+ * Frees the log probabilities of px_ngload().
+ *
+ * \param ng  The log probabilities.
+ */
+void px_ngfree(struct px_ngrams *ng);
+
+/**
+ * Scores a text by its quadgrams. Characters that are not letters are
+ * ignored.
+ *
+ * \param ng    The log probabilities.
+ * \param text  The text.
+ * \param n     Length of the text.
+ *
+ * \returns The sum of the log probabilities of all quadgrams, 0 if the
+ *          text has less than four letters.
+ */
+double px_ngscore(const struct px_ngrams *ng, const char *text, const int n);
+
+/**
+ * Ranks the passwords of a dictionary by the score of the plain text
+ * they yield for the first letters of a cipher text.
+ *
+ * Each thread keeps the best passwords it has seen in a heap of
+ * nbest entries, so a password is only copied when it makes it into
+ * that heap. The heaps are merged at the end.
+ *
+ * \param dict      The dictionary file, one password per line.
+ * \param ct        The cipher text. Characters that are not letters are
+ *                  ignored.
+ * \param nletters  Number of letters to decrypt and score, 0 for all.
+ * \param ng        The log probabilities.
+ * \param nbest     Number of passwords to keep.
+ * \param mvjokers  Boolean flag that defines if the jokers shall be moved
+ *                  on key generation.
+ * \param nthreads  Number of threads, 0 for one per processor.
+ * \param res       out: The result, to be freed by px_rankfree().
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_rankdict(
+    const char *dict,
+    const char *ct,
+    const int nletters,
+    const struct px_ngrams *ng,
+    const int nbest,
+    const int mvjokers,
+    const int nthreads,
+    struct px_rankres *res);
+
+/**
+ * Frees the passwords of a px_rankdict() result.
+ *
+ * \param res  The result.
+ */
+void px_rankfree(struct px_rankres *res);
+
+#endif
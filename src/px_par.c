@@ -0,0 +1,121 @@
+/*
+ *  px_par.c : Implementation of the helpers for running work on
+ *             multiple threads.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "./px_par.h"
+#include "./logging.h"
+
+#define PX_MAXTHREADS 256
+
+/*
+ * Shared state of a px_pfor() run.
+ */
+struct pfor {
+    pthread_mutex_t lock;
+    int next; /* next job index to hand out */
+    int n;
+    void (*fn)(void *ctx, int i);
+    void *ctx;
+};
+
+/*
+ * Thread main function: Fetches and runs jobs until all are taken.
+ */
+static void *px_pfor_worker(void *arg) {
+    struct pfor *p = arg;
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        i = p->next++;
+        pthread_mutex_unlock(&p->lock);
+
+        if (i >= p->n) break;
+        p->fn(p->ctx, i);
+    }
+
+    return NULL;
+}
+
+/**
+ * Gets the number of online processors.
+ * See header.
+ */
+int px_ncpus(void) {
+    long n;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (int)n;
+}
+
+/**
+ * Calls a function for every index in [0, n) on multiple threads.
+ * See header.
+ */
+int px_pfor(
+    const int n,
+    int nthreads,
+    void (*fn)(void *ctx, int i),
+    void *ctx) {
+
+    pthread_t threads[PX_MAXTHREADS];
+    struct pfor p;
+    int i, started = 0;
+
+    if (nthreads <= 0) nthreads = px_ncpus();
+    if (nthreads > n) nthreads = n;
+    if (nthreads > PX_MAXTHREADS) nthreads = PX_MAXTHREADS;
+
+    p.next = 0;
+    p.n = n;
+    p.fn = fn;
+    p.ctx = ctx;
+
+    if (pthread_mutex_init(&p.lock, NULL)) {
+        LOG_ERR(("Could not create mutex. [9c1e]\n"));
+        return -1;
+    }
+
+    for (i = 0; i < nthreads && nthreads > 1; i++) {
+        if (pthread_create(&threads[i], NULL, px_pfor_worker, &p)) {
+            LOG_WRN(("Could only start %i threads.\n", i));
+            break;
+        }
+        started++;
+    }
+
+    /* Without any threads, the caller does the work. */
+    if (!started) px_pfor_worker(&p);
+
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&p.lock);
+    return 0;
+}
+
+#undef PX_MAXTHREADS
+
@@ -0,0 +1,51 @@
+#ifndef PX_PAR__H_
+#define PX_PAR__H_
+
+/*
+ *  px_par.h : declares helpers for running work on multiple threads.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Gets the number of online processors.
+ *
+ * \returns The number of processors, at least 1.
+ */
+int px_ncpus(void);
+
+/**
+ * Calls a function for every index in [0, n), distributed over
+ * multiple threads. The indices are handed out dynamically, so
+ * jobs of varying size are balanced.
+ *
+ * \param n        Number of jobs.
+ * \param nthreads Maximum number of threads, 0 for one per processor.
+ * \param fn       Job function, called with ctx and the job index.
+ * \param ctx      Context pointer passed to fn.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_pfor(
+    const int n,
+    int nthreads,
+    void (*fn)(void *ctx, int i),
+    void *ctx);
+
+#endif
+
@@ -0,0 +1,177 @@
+/*
+ *  px_secmem.c : Implementation of the locked arena for key, deck and
+ *                scratch memory.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "./px_secmem.h"
+#include "./logging.h"
+
+static const int signals[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+#define NSIGNALS (sizeof(signals) / sizeof(signals[0]))
+
+/*
+ * The arena. There is only one per process, so the signal
+ * handlers can reach it.
+ */
+static unsigned char *arena = NULL;
+static size_t narena = 0;
+static int locked = 0; /* bool flag: mlock() succeeded */
+static int *freeslots = NULL; /* stack of free slot indices */
+static int nfree = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction oldactions[NSIGNALS];
+
+/*
+ * Overwrites memory with zeros in a way the compiler may not
+ * optimize away. Async-signal-safe.
+ */
+static void _wipe(void *p, size_t n) {
+    volatile unsigned char *v = p;
+    while (n--) *(v++) = 0;
+}
+
+/*
+ * Signal handler: Wipes the arena, then lets the signal take
+ * its original effect.
+ */
+static void _onsignal(int sig) {
+    size_t i;
+
+    if (arena) _wipe(arena, narena);
+
+    for (i = 0; i < NSIGNALS; i++) {
+        if (signals[i] == sig) sigaction(sig, &oldactions[i], NULL);
+    }
+
+    raise(sig);
+}
+
+/**
+ * Sets up the arena.
+ * See header.
+ */
+int px_sminit(const int nslots) {
+    struct sigaction action;
+    size_t i;
+
+    if (arena) px_smdone();
+    if (nslots <= 0) return -1;
+
+    narena = (size_t)nslots * PX_SMSLOT;
+    arena = mmap(NULL, narena, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        arena = NULL;
+        LOG_ERR(("Could not allocate secure memory. [5d02]\n"));
+        return -1;
+    }
+
+    freeslots = malloc(nslots * sizeof(int));
+    if (!freeslots) {
+        munmap(arena, narena);
+        arena = NULL;
+        LOG_ERR(("Internal memory error!\n"));
+        return -1;
+    }
+    for (nfree = 0; nfree < nslots; nfree++) {
+        freeslots[nfree] = nslots - nfree - 1;
+    }
+
+    locked = mlock(arena, narena) == 0;
+    if (!locked) {
+        LOG_WRN(("Could not lock memory, key material may be swapped.\n"));
+    }
+#ifdef MADV_DONTDUMP
+    madvise(arena, narena, MADV_DONTDUMP);
+#endif
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = _onsignal;
+    sigemptyset(&action.sa_mask);
+    for (i = 0; i < NSIGNALS; i++) {
+        sigaction(signals[i], &action, &oldactions[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Takes a slot from the arena.
+ * See header.
+ */
+void *px_smget(void) {
+    void *slot = NULL;
+
+    pthread_mutex_lock(&lock);
+    if (arena && nfree > 0) {
+        slot = arena + (size_t)freeslots[--nfree] * PX_SMSLOT;
+    }
+    pthread_mutex_unlock(&lock);
+
+    return slot;
+}
+
+/**
+ * Returns a slot to the arena.
+ * See header.
+ */
+void px_smput(void *slot) {
+    if (!slot) return;
+
+    pthread_mutex_lock(&lock);
+    freeslots[nfree++] = ((unsigned char *)slot - arena) / PX_SMSLOT;
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Wipes and releases the arena.
+ * See header.
+ */
+void px_smdone(void) {
+    size_t i;
+
+    if (!arena) return;
+
+    for (i = 0; i < NSIGNALS; i++) {
+        sigaction(signals[i], &oldactions[i], NULL);
+    }
+
+    pthread_mutex_lock(&lock);
+    _wipe(arena, narena);
+    if (locked) munlock(arena, narena);
+    munmap(arena, narena);
+    arena = NULL;
+    narena = 0;
+    free(freeslots);
+    freeslots = NULL;
+    nfree = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+#undef NSIGNALS
+
@@ -0,0 +1,73 @@
+#ifndef PX_SECMEM__H_
+#define PX_SECMEM__H_
+
+/*
+ *  px_secmem.h : declares the locked arena for key, deck and scratch
+ *                memory.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The arena is a single memory region that is locked into RAM, so
+ * that key material never gets swapped out, and excluded from core
+ * dumps. It is split into fixed-size slots, each large enough for a
+ * deck and a scratch deck.
+ *
+ * Slots are NOT wiped when they are returned. Instead, the whole arena
+ * is wiped once on px_smdone() or when the process is terminated by
+ * SIGINT, SIGTERM, SIGHUP or SIGQUIT.
+ */
+
+/** Size of one arena slot in bytes. */
+#define PX_SMSLOT 128
+
+/**
+ * Sets up the arena and installs the signal handlers.
+ *
+ * \param nslots  Number of slots.
+ *
+ * \returns 0 on success, -1 on failure. If the memory could be
+ *          allocated but not be locked, a warning is logged and 0
+ *          is returned.
+ */
+int px_sminit(const int nslots);
+
+/**
+ * Takes a slot from the arena. Thread-safe.
+ *
+ * \returns Pointer to PX_SMSLOT bytes, NULL if the arena is not set up
+ *          or all slots are taken. Callers then need to use and wipe
+ *          memory of their own.
+ */
+void *px_smget(void);
+
+/**
+ * Returns a slot to the arena. Thread-safe.
+ *
+ * \param slot  A slot from px_smget(), or NULL.
+ */
+void px_smput(void *slot);
+
+/**
+ * Wipes, unlocks and releases the whole arena.
+ */
+void px_smdone(void);
+
+#endif
+
@@ -0,0 +1,666 @@
+/*
+ *  px_shard.c : Implementation of the job directory of a sharded
+ *               password search.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./px_shard.h"
+#include "./px_attack.h"
+#include "./px_stats.h"
+#include "./logging.h"
+
+static const char jobmagic[] = "PONTIFEX SEARCH JOB\n";
+
+/* Length of a checkpoint record, see _wrckpt(). */
+#define CKPTLEN 81
+
+/*
+ * The contents of a job file.
+ */
+struct job {
+    char *text; /* the job file, the fields point into it */
+    const char *dict;
+    unsigned long nwords;
+    unsigned long shardsize;
+    unsigned long nshards;
+    card *expect;
+    int nexpect;
+    int mvjokers; /* bool flag */
+    long created;
+    unsigned long *offsets; /* byte offset of each shard in dict */
+};
+
+/*
+ * Checkpoint of a shard.
+ */
+struct ckpt {
+    unsigned long next; /* index of the next word to test */
+    unsigned long tested;
+    double seconds;
+    long updated;
+    int done;
+};
+
+/*
+ * A dictionary mapped into memory.
+ */
+struct dictmap {
+    const char *p;
+    size_t n;
+};
+
+/*
+ * Joins a directory and a file name.
+ *
+ * \returns The allocated path, NULL if out of memory.
+ */
+static char *_path(const char *dir, const char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+
+    if (path) sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+/*
+ * Gets the path of the checkpoint file of a shard.
+ */
+static char *_shardpath(const char *dir, const unsigned long shard) {
+    char name[32];
+
+    sprintf(name, "shard-%06lu", shard);
+    return _path(dir, name);
+}
+
+/*
+ * Maps a file into memory, read-only.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _map(const char *path, struct dictmap *d) {
+    struct stat st;
+    void *p;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERR(("Could not open '%s'!\n", path));
+        return -1;
+    }
+
+    if (fstat(fd, &st) || st.st_size == 0) {
+        LOG_ERR(("'%s' is empty or unreadable!\n", path));
+        close(fd);
+        return -1;
+    }
+
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LOG_ERR(("Could not map '%s'!\n", path));
+        return -1;
+    }
+
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    d->p = p;
+    d->n = st.st_size;
+    return 0;
+}
+
+/*
+ * Unmaps a file of _map().
+ */
+static void _unmap(struct dictmap *d) {
+    if (d->p) munmap((void *)d->p, d->n);
+    d->p = NULL;
+}
+
+/*
+ * Gets the end of the line that starts at p, without '\r'.
+ *
+ * \param next  out: The start of the next line.
+ */
+static const char *_eol(const struct dictmap *d, const char *p,
+        const char **next) {
+    const char *end = d->p + d->n,
+               *nl = memchr(p, '\n', end - p);
+
+    if (nl) {
+        *next = nl + 1;
+        end = nl;
+    } else {
+        *next = end;
+    }
+    if (end > p && end[-1] == '\r') end--;
+    return end;
+}
+
+/*
+ * Reads and parses the job file of a job directory.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _rdjob(const char *dir, struct job *job) {
+    char *path, *line, *next, *val;
+    struct stat st;
+    unsigned long n = 0;
+    int fd, i, ok;
+
+    memset(job, 0, sizeof(*job));
+
+    path = _path(dir, "job");
+    if (!path) return -1;
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0 || fstat(fd, &st)) {
+        LOG_ERR(("'%s' holds no search job!\n", dir));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    job->text = malloc(st.st_size + 1);
+    ok = job->text && read(fd, job->text, st.st_size) == st.st_size;
+    close(fd);
+    if (!ok) goto fail;
+    job->text[st.st_size] = '\0';
+
+    if (strncmp(job->text, jobmagic, sizeof(jobmagic) - 1)) goto fail;
+
+    /* Lines of a name and a value, the shards last. */
+    for (line = job->text + sizeof(jobmagic) - 1; *line; line = next) {
+        next = strchr(line, '\n');
+        val = strchr(line, ' ');
+        if (!next || !val || val > next) goto fail;
+        *next++ = '\0';
+        *val++ = '\0';
+
+        if (!strcmp(line, "dictionary")) {
+            job->dict = val;
+        } else if (!strcmp(line, "words")) {
+            job->nwords = strtoul(val, NULL, 10);
+        } else if (!strcmp(line, "shard-size")) {
+            job->shardsize = strtoul(val, NULL, 10);
+        } else if (!strcmp(line, "created")) {
+            job->created = strtol(val, NULL, 10);
+        } else if (!strcmp(line, "keystream")) {
+            job->nexpect = strlen(val);
+            job->expect = malloc(job->nexpect + 1);
+            if (!job->expect) goto fail;
+            for (i = 0; i < job->nexpect; i++) {
+                if (val[i] < 'A' || val[i] > 'Z') goto fail;
+                job->expect[i] = val[i] - 'A' + 1;
+            }
+        } else if (!strcmp(line, "move-jokers")) {
+            job->mvjokers = strtol(val, NULL, 10) != 0;
+        } else if (!strcmp(line, "shard") && job->nwords && job->shardsize) {
+            if (!job->offsets) {
+                job->nshards = (job->nwords + job->shardsize - 1)
+                    / job->shardsize;
+                job->offsets = malloc(job->nshards * sizeof(*job->offsets));
+                if (!job->offsets) goto fail;
+            }
+            if (n == job->nshards) goto fail;
+            job->offsets[n++] = strtoul(val, NULL, 10);
+        } else {
+            goto fail;
+        }
+    }
+
+    if (job->dict && job->nwords && job->offsets && n == job->nshards
+            && job->expect && job->nexpect) {
+        return 0;
+    }
+
+fail:
+    LOG_ERR(("The job file of '%s' is damaged!\n", dir));
+    free(job->text);
+    free(job->expect);
+    free(job->offsets);
+    memset(job, 0, sizeof(*job));
+    return -1;
+}
+
+/*
+ * Frees a job of _rdjob().
+ */
+static void _freejob(struct job *job) {
+    free(job->text);
+    free(job->expect);
+    free(job->offsets);
+}
+
+/*
+ * Reads the checkpoint of a shard. An empty file is a shard that has
+ * not been started.
+ *
+ * \returns 0 on success, -1 if the checkpoint is damaged.
+ */
+static int _rdckpt(const int fd, const struct job *job,
+        const unsigned long shard, struct ckpt *ck) {
+    char rec[CKPTLEN + 1];
+    ssize_t n;
+
+    memset(ck, 0, sizeof(*ck));
+    ck->next = shard * job->shardsize;
+
+    n = pread(fd, rec, CKPTLEN, 0);
+    if (n == 0) return 0;
+    if (n != CKPTLEN) return -1;
+    rec[CKPTLEN] = '\0';
+
+    if (sscanf(rec, "%lu %lu %lf %ld %d", &ck->next, &ck->tested,
+            &ck->seconds, &ck->updated, &ck->done) != 5
+            || ck->next < shard * job->shardsize
+            || ck->next > job->nwords) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Writes the checkpoint of a shard, a record of fixed length that
+ * replaces the previous one in place.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _wrckpt(const int fd, const struct ckpt *ck) {
+    char rec[CKPTLEN + 1];
+
+    sprintf(rec, "%20lu %20lu %15.3f %20ld %1d\n",
+        ck->next, ck->tested, ck->seconds, ck->updated, ck->done);
+    return pwrite(fd, rec, CKPTLEN, 0) == CKPTLEN ? 0 : -1;
+}
+
+/*
+ * Claims a shard by a write lock on its checkpoint file.
+ *
+ * \returns The file descriptor, -1 if another worker holds the shard,
+ *          -2 on failure.
+ */
+static int _claim(const char *dir, const unsigned long shard) {
+    struct flock fl;
+    char *path;
+    int fd;
+
+    path = _shardpath(dir, shard);
+    if (!path) return -2;
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) LOG_ERR(("Could not open '%s'!\n", path));
+    free(path);
+    if (fd < 0) return -2;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    if (fcntl(fd, F_SETLK, &fl)) {
+        close(fd);
+        return errno == EACCES || errno == EAGAIN ? -1 : -2;
+    }
+
+    return fd;
+}
+
+/*
+ * Appends the matching passwords of a chunk to the found file. Each
+ * line is a single write(), so the lines of workers do not mix.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _wrfound(const int fd, const unsigned long first,
+        const char * const *words, const char *match, const int n) {
+    char *line;
+    int i, len, ok = 1;
+
+    for (i = 0; i < n && ok; i++) {
+        if (!match[i]) continue;
+
+        line = malloc(strlen(words[i]) + 24);
+        if (!line) return -1;
+        len = sprintf(line, "%lu\t%s\n", first + i, words[i]);
+        ok = write(fd, line, len) == len;
+        free(line);
+    }
+
+    return ok ? 0 : -1;
+}
+
+/*
+ * Creates a job directory.
+ * See header.
+ */
+long px_jobcreate(
+    const char *dir,
+    const char *dict,
+    const card *expect,
+    const int nexpect,
+    const int mvjokers,
+    const unsigned long shardsize) {
+
+    struct dictmap d = { NULL, 0 };
+    const char *p, *next;
+    char *path = NULL, *abs = NULL;
+    unsigned long w = 0;
+    long nshards = -1;
+    FILE *f = NULL;
+    int fd, i;
+
+    if (!shardsize || nexpect <= 0) {
+        LOG_ERR(("The shard size and the key stream must not be empty.\n"));
+        return -1;
+    }
+
+    /* Workers may run in other directories. */
+    abs = realpath(dict, NULL);
+    if (!abs || _map(abs, &d)) {
+        if (!abs) LOG_ERR(("Could not open '%s'!\n", dict));
+        goto clean;
+    }
+
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        LOG_ERR(("Could not create '%s'!\n", dir));
+        goto clean;
+    }
+
+    path = _path(dir, "job");
+    if (!path) goto clean;
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || !(f = fdopen(fd, "w"))) {
+        LOG_ERR(("Could not create '%s', is there a job already?\n", path));
+        if (fd >= 0) close(fd);
+        goto clean;
+    }
+
+    for (p = d.p; p < d.p + d.n; p = next, w++) _eol(&d, p, &next);
+
+    fputs(jobmagic, f);
+    fprintf(f, "dictionary %s\n", abs);
+    fprintf(f, "words %lu\n", w);
+    fprintf(f, "shard-size %lu\n", shardsize);
+    fprintf(f, "created %ld\n", (long)time(NULL));
+    fputs("keystream ", f);
+    for (i = 0; i < nexpect; i++) fputc('A' + expect[i] - 1, f);
+    fputc('\n', f);
+    fprintf(f, "move-jokers %i\n", !!mvjokers);
+
+    for (p = d.p, w = 0; p < d.p + d.n; p = next, w++) {
+        if (w % shardsize == 0) {
+            fprintf(f, "shard %lu\n", (unsigned long)(p - d.p));
+        }
+        _eol(&d, p, &next);
+    }
+
+    nshards = (w + shardsize - 1) / shardsize;
+    if (ferror(f)) {
+        LOG_ERR(("Could not write '%s'!\n", path));
+        nshards = -1;
+    }
+
+clean:
+    if (f && fclose(f)) nshards = -1;
+    _unmap(&d);
+    free(path);
+    free(abs);
+    return nshards;
+}
+
+/*
+ * Works on a job directory.
+ * See header.
+ */
+long px_jobwork(
+    const char *dir,
+    const int nthreads,
+    const unsigned long limit,
+    volatile sig_atomic_t *stop) {
+
+    struct job job;
+    struct dictmap d = { NULL, 0 };
+    struct ckpt ck;
+    const char *words[PX_SHCHUNK], *p, *next, *end;
+    size_t offs[PX_SHCHUNK], ntext, captext = 0;
+    char match[PX_SHCHUNK], *text = NULL, *tmp, *path;
+    unsigned long s, last, skip;
+    long total = 0;
+    double t;
+    int fd = -1, foundfd = -1, halt = 0,
+        i, n, m;
+
+    if (_rdjob(dir, &job)) return -1;
+    if (_map(job.dict, &d)) goto fail;
+
+    path = _path(dir, "found");
+    if (path) foundfd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    free(path);
+    if (foundfd < 0) {
+        LOG_ERR(("Could not open the found file of '%s'!\n", dir));
+        goto fail;
+    }
+
+    for (s = 0; s < job.nshards && !halt; s++) {
+        fd = _claim(dir, s);
+        if (fd == -1) continue;
+        if (fd < 0) goto fail;
+
+        if (_rdckpt(fd, &job, s, &ck)) {
+            LOG_ERR(("The checkpoint of shard %lu is damaged!\n", s));
+            goto fail;
+        }
+        if (ck.done) {
+            close(fd);
+            continue;
+        }
+
+        last = (s + 1) * job.shardsize;
+        if (last > job.nwords) last = job.nwords;
+        LOG_INF(("Shard %lu: words %lu to %lu\n", s, ck.next, last - 1));
+
+        /* Skip the words tested before the checkpoint. */
+        p = d.p + job.offsets[s];
+        for (skip = s * job.shardsize; skip < ck.next; skip++) {
+            _eol(&d, p, &p);
+        }
+
+        while (ck.next < last && !halt) {
+            t = px_now();
+            n = last - ck.next < PX_SHCHUNK ? last - ck.next : PX_SHCHUNK;
+
+            for (i = 0, ntext = 0; i < n; i++, p = next) {
+                end = _eol(&d, p, &next);
+                if (ntext + (end - p) + 1 > captext) {
+                    captext = 2 * (ntext + (end - p) + 1);
+                    tmp = realloc(text, captext);
+                    if (!tmp) goto fail;
+                    text = tmp;
+                }
+                memcpy(text + ntext, p, end - p);
+                offs[i] = ntext;
+                ntext += end - p;
+                text[ntext++] = '\0';
+            }
+            for (i = 0; i < n; i++) words[i] = text + offs[i];
+
+            m = px_pwmatch((const char * const *)words, n,
+                job.expect, job.nexpect, job.mvjokers, nthreads, match);
+            if (m < 0 || (m && _wrfound(foundfd, ck.next,
+                    (const char * const *)words, match, n))) {
+                goto fail;
+            }
+
+            ck.next += n;
+            ck.tested += n;
+            ck.seconds += px_now() - t;
+            ck.updated = time(NULL);
+            ck.done = ck.next == last;
+            if (_wrckpt(fd, &ck)) {
+                LOG_ERR(("Could not write the checkpoint of shard %lu!\n", s));
+                goto fail;
+            }
+
+            total += n;
+            halt = (limit && total >= limit) || (stop && *stop);
+        }
+
+        close(fd); /* releases the shard */
+        fd = -1;
+    }
+
+    goto clean;
+
+fail:
+    total = -1;
+
+clean:
+    if (fd >= 0) close(fd);
+    if (foundfd >= 0) close(foundfd);
+    _unmap(&d);
+    _freejob(&job);
+    free(text);
+    return total;
+}
+
+/*
+ * Compares two lines of the found file by their word index.
+ */
+static int _cmpfound(const void *a, const void *b) {
+    unsigned long x = strtoul(*(char * const *)a, NULL, 10),
+                  y = strtoul(*(char * const *)b, NULL, 10);
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Reads the found file and counts, or prints, the distinct matches.
+ * A worker that was killed after writing a match, but before its
+ * checkpoint, writes the match again when the shard is resumed.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _rdfound(const char *dir, struct px_jobstat *st, FILE *out) {
+    struct dictmap d = { NULL, 0 };
+    char *path, *text, **lines = NULL, *tab;
+    const char *p, *next, *end;
+    size_t n = 0, i;
+    struct stat sb;
+    int failed;
+
+    path = _path(dir, "found");
+    if (!path) return -1;
+    if (stat(path, &sb) || sb.st_size == 0) {
+        free(path);
+        return 0;
+    }
+    failed = _map(path, &d);
+    free(path);
+    if (failed) return -1;
+
+    text = malloc(d.n + 1);
+    lines = malloc((d.n + 1) * sizeof(*lines)); /* lines may be empty */
+    if (!text || !lines) {
+        free(text);
+        free(lines);
+        _unmap(&d);
+        return -1;
+    }
+    memcpy(text, d.p, d.n);
+    text[d.n] = '\0';
+
+    for (p = d.p; p < d.p + d.n; p = next) {
+        end = _eol(&d, p, &next);
+        text[end - d.p] = '\0';
+        if (end > p) lines[n++] = text + (p - d.p);
+    }
+
+    qsort(lines, n, sizeof(*lines), _cmpfound);
+    for (i = 0; i < n; i++) {
+        if (i && !_cmpfound(&lines[i - 1], &lines[i])) continue;
+        st->nfound++;
+        tab = strchr(lines[i], '\t');
+        if (out && tab) fprintf(out, "%s\n", tab + 1);
+    }
+
+    free(lines);
+    free(text);
+    _unmap(&d);
+    return 0;
+}
+
+/*
+ * Reads the progress of a job directory.
+ * See header.
+ */
+int px_jobstatus(const char *dir, struct px_jobstat *st, FILE *found) {
+    struct job job;
+    struct ckpt ck;
+    struct flock fl;
+    char *path;
+    long updated = 0;
+    unsigned long s;
+    int fd, ret = 0;
+
+    memset(st, 0, sizeof(*st));
+    if (_rdjob(dir, &job)) return -1;
+
+    st->nwords = job.nwords;
+    st->nshards = job.nshards;
+    st->mvjokers = job.mvjokers;
+
+    for (s = 0; s < job.nshards; s++) {
+        path = _shardpath(dir, s);
+        fd = path ? open(path, O_RDONLY) : -1;
+        free(path);
+        if (fd < 0) continue; /* not started yet */
+
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        if (!fcntl(fd, F_GETLK, &fl) && fl.l_type != F_UNLCK) {
+            st->nactive++;
+        }
+
+        if (_rdckpt(fd, &job, s, &ck)) {
+            LOG_ERR(("The checkpoint of shard %lu is damaged!\n", s));
+            ret = -1;
+        }
+        close(fd);
+
+        st->ndone += ck.done;
+        st->tested += ck.tested;
+        st->seconds += ck.seconds;
+        if (ck.updated > updated) updated = ck.updated;
+    }
+
+    if (updated) st->elapsed = difftime(updated, job.created);
+
+    if (_rdfound(dir, st, found)) ret = -1;
+
+    _freejob(&job);
+    return ret;
+}
+
+#undef CKPTLEN
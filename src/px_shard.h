@@ -0,0 +1,122 @@
+#ifndef PX_SHARD__H_
+#define PX_SHARD__H_
+
+/*
+ *  px_shard.h : declares the job directory of a password search that
+ *               is sharded over many processes.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include "./px_common.h"
+
+/*
+ * A job directory holds a search of a dictionary, one password per
+ * line, for the passwords whose keys reproduce a known key stream:
+ *
+ *   job           the dictionary, the key stream, whether the keys
+ *                 move the jokers and the byte offset of the first
+ *                 word of each shard, written once
+ *   shard-NNNNNN  checkpoint of shard N: next word, words tested,
+ *                 seconds spent, time of the last update, done flag
+ *   found         the matching passwords, one per line as
+ *                 WORD-INDEX<TAB>PASSWORD
+ *
+ * The words are numbered from 0 by their line, and shard N holds the
+ * words N * shard-size up to the next shard. A worker claims a shard
+ * by a write lock (fcntl()) on its checkpoint file. The lock ends with
+ * the worker process, so a shard of a killed worker is free again, and
+ * the next worker resumes it from its checkpoint. All workers need to
+ * run on the same host, or on a file system with working locks.
+ */
+
+/** Words tested between two checkpoints of a shard. */
+#define PX_SHCHUNK 4096
+
+/**
+ * Progress of a job directory, see px_jobstatus().
+ */
+struct px_jobstat {
+    unsigned long nwords; /* words of the dictionary */
+    unsigned long nshards;
+    unsigned long ndone; /* finished shards */
+    unsigned long nactive; /* shards claimed by a running worker */
+    unsigned long tested; /* words tested */
+    unsigned long nfound; /* distinct matching passwords */
+    int mvjokers; /* bool flag: the keys move the jokers */
+    double seconds; /* time of all workers, summed up */
+    double elapsed; /* seconds from creation to the last checkpoint */
+};
+
+/**
+ * Creates a job directory for a password search.
+ *
+ * \para dir        The directory, created if it does not exist. It must
+ *                  not hold a job yet.
+ * \para dict       The dictionary file, one password per line.
+ * \para expect     The expected key stream, see px_crib().
+ * \para nexpect    Length of the expected key stream.
+ * \para mvjokers   Boolean flag that defines if the jokers shall be
+ *                  moved on key generation.
+ * \para shardsize  Words per shard.
+ *
+ * \returns The number of shards, -1 on failure.
+ */
+long px_jobcreate(
+    const char *dir,
+    const char *dict,
+    const card *expect,
+    const int nexpect,
+    const int mvjokers,
+    const unsigned long shardsize);
+
+/**
+ * Works on a job directory: claims one free shard after the other,
+ * resumes it from its checkpoint and tests its words, until every
+ * shard is done or claimed by another worker.
+ *
+ * \para dir       The job directory.
+ * \para nthreads  Number of threads, 0 for one per processor.
+ * \para limit     Stop after the checkpoint that reaches this many
+ *                 tested words, 0 for no limit.
+ * \para stop      If not NULL, the worker stops at the next checkpoint
+ *                 once it is set, e.g. by a signal handler.
+ *
+ * \returns The number of words tested, -1 on failure.
+ */
+long px_jobwork(
+    const char *dir,
+    const int nthreads,
+    const unsigned long limit,
+    volatile sig_atomic_t *stop);
+
+/**
+ * Reads the progress of a job directory.
+ *
+ * \para dir    The job directory.
+ * \para st     out: The progress.
+ * \para found  If not NULL, the matching passwords are printed to it,
+ *              one per line, ordered by their word index.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_jobstatus(const char *dir, struct px_jobstat *st, FILE *found);
+
+#endif
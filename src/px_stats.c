@@ -0,0 +1,86 @@
+/*
+ *  px_stats.c : Implementation of the run statistics.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "./px_stats.h"
+
+static const char *phasenames[PX_NPHASES] = {
+    "read", "normalize", "keystream", "substitute", "format", "write"
+};
+
+/**
+ * Gets a monotonic timestamp.
+ * See header.
+ */
+double px_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Adds statistics to others.
+ * See header.
+ */
+void px_addstats(struct px_stats *sum, const struct px_stats *add) {
+    int i;
+
+    sum->keystream += add->keystream;
+    sum->skipped += add->skipped;
+    sum->inbytes += add->inbytes;
+    sum->letters += add->letters;
+    sum->padding += add->padding;
+
+    for (i = 0; i < PX_NPHASES; i++) sum->time[i] += add->time[i];
+}
+
+/**
+ * Prints statistics as JSON.
+ * See header.
+ */
+void px_prstats(const struct px_stats *stats, FILE *stream) {
+    struct rusage usage;
+    int i;
+
+    if (getrusage(RUSAGE_SELF, &usage)) usage.ru_maxrss = 0;
+
+    fprintf(stream,
+        "{\"keystream_letters\": %lu, \"joker_skips\": %lu, "
+        "\"input_bytes\": %lu, \"letters_used\": %lu, "
+        "\"padding_letters\": %lu, \"time_s\": {",
+        stats->keystream, stats->skipped,
+        stats->inbytes, stats->letters, stats->padding);
+
+    for (i = 0; i < PX_NPHASES; i++) {
+        fprintf(stream, "%s\"%s\": %.6f",
+            i ? ", " : "", phasenames[i], stats->time[i]);
+    }
+
+    /* ru_maxrss is in kilobytes on Linux */
+    fprintf(stream, "}, \"peak_rss_kb\": %li}\n", (long)usage.ru_maxrss);
+}
+
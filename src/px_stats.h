@@ -0,0 +1,79 @@
+#ifndef PX_STATS__H_
+#define PX_STATS__H_
+
+/*
+ *  px_stats.h : declares the run statistics (counters and phase
+ *               timings).
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+
+/* Phases of a run, see px_stats.time */
+#define PX_PH_READ 0
+#define PX_PH_NORMALIZE 1
+#define PX_PH_KEYSTREAM 2
+#define PX_PH_SUBSTITUTE 3
+#define PX_PH_FORMAT 4
+#define PX_PH_WRITE 5
+#define PX_NPHASES 6
+
+/**
+ * Statistics of a run. Collected only if a px_stats struct is
+ * passed in the px_opts, see px_crypto.h.
+ */
+struct px_stats {
+    unsigned long keystream; /* key stream letters generated */
+    unsigned long skipped; /* joker outputs skipped */
+    unsigned long inbytes; /* input bytes */
+    unsigned long letters; /* input letters used */
+    unsigned long padding; /* padding letters added */
+
+    /**
+     * Seconds spent per phase (PX_PH_*). When work runs on multiple
+     * threads, the times of all threads are summed up.
+     */
+    double time[PX_NPHASES];
+};
+
+/**
+ * Gets a monotonic timestamp.
+ *
+ * \returns The timestamp in seconds.
+ */
+double px_now(void);
+
+/**
+ * Adds statistics to others.
+ *
+ * \param sum   The statistics to add to.
+ * \param add   The statistics to add.
+ */
+void px_addstats(struct px_stats *sum, const struct px_stats *add);
+
+/**
+ * Prints statistics and the peak memory usage as JSON.
+ *
+ * \param stats   The statistics.
+ * \param stream  Pointer to the output file.
+ */
+void px_prstats(const struct px_stats *stats, FILE *stream);
+
+#endif
+
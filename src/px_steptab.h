@@ -0,0 +1,52 @@
+#ifndef PX_STEPTAB__H_
+#define PX_STEPTAB__H_
+
+/*
+ *  px_steptab.h : declares the precomputed keystream step tables.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The joker move and the triple cut only depend on the positions of
+ * the two jokers. Their combined effect is a fixed permutation of the
+ * deck positions, which is stored here for every possible pair of
+ * joker positions.
+ *
+ * The table is generated at build time by px_gentab (see Makefile).
+ */
+
+/**
+ * Combined joker move and triple cut for one pair of joker positions.
+ */
+struct px_step {
+    /**
+     * gather[i] is the index in the old deck of the card that lands
+     * on position i after moving the jokers and the triple cut.
+     */
+    unsigned char gather[54];
+};
+
+/**
+ * Step table, indexed by the old positions of joker A and joker B.
+ * Entries with equal indices are unused.
+ */
+extern const struct px_step px_steptab[54][54];
+
+#endif
+
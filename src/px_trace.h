@@ -0,0 +1,62 @@
+#ifndef PX_TRACE__H_
+#define PX_TRACE__H_
+
+/*
+ *  px_trace.h : Statically defined tracepoints (USDT) for tracing with
+ *               bpftrace, perf or SystemTap.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * The tracepoints are compiled in with `make USDT=1`, which requires
+ * <sys/sdt.h> (systemtap-sdt-dev). Each one is a single nop in the
+ * binary plus a note in the ELF file, until a tracer attaches to it.
+ * Without USDT=1, they expand to nothing.
+ *
+ * All probes belong to the provider "enoch". See scripts/ for
+ * examples and README.md for the list of probes.
+ *
+ * Note that some probes expose key stream and message letters. Only
+ * attach to them on machines you trust with the plain text.
+ */
+
+#ifdef PX_USDT
+
+#include <sys/sdt.h>
+
+#define PX_TRACE0(name) \
+    DTRACE_PROBE(enoch, name)
+#define PX_TRACE1(name, a) \
+    DTRACE_PROBE1(enoch, name, a)
+#define PX_TRACE2(name, a, b) \
+    DTRACE_PROBE2(enoch, name, a, b)
+#define PX_TRACE3(name, a, b, c) \
+    DTRACE_PROBE3(enoch, name, a, b, c)
+
+#else
+
+#define PX_TRACE0(name) ((void)0)
+#define PX_TRACE1(name, a) ((void)0)
+#define PX_TRACE2(name, a, b) ((void)0)
+#define PX_TRACE3(name, a, b, c) ((void)0)
+
+#endif
+
+#endif
+
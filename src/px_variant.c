@@ -0,0 +1,237 @@
+/*
+ *  px_variant.c : Implementation of the cipher variants with other deck
+ *                 sizes and alphabets.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./px_variant.h"
+#include "./logging.h"
+
+#define INVALID_CARD (card)254
+
+/* One round function per deck size, see px_vround.h. */
+#define VN 28
+#define VFN(f) px_v28_##f
+#include "./px_vround.h"
+#undef VFN
+#undef VN
+
+#define VN 54
+#define VFN(f) px_v54_##f
+#include "./px_vround.h"
+#undef VFN
+#undef VN
+
+#define VN 82
+#define VFN(f) px_v82_##f
+#include "./px_vround.h"
+#undef VFN
+#undef VN
+
+static const struct px_variant variants[] = {
+    { "std", 54, "ABCDEFGHIJKLMNOPQRSTUVWXYZ", 26,
+        px_v54_round, px_v54_ccut },
+    { "small", 28, "ABCDEFGHIJKLMNOPQRSTUVWXYZ", 26,
+        px_v28_round, px_v28_ccut },
+    { "ext", 82, "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.,?-", 40,
+        px_v82_round, px_v82_ccut }
+};
+
+/*
+ * Gets the index of a character in the alphabet.
+ *
+ * \returns 0 to nletters - 1, or -1 if the character is not part of
+ *          the alphabet.
+ */
+static int _vindex(const struct px_variant *v, char c) {
+    const char *p;
+
+    if (c == '\0') return -1;
+    p = strchr(v->alphabet, toupper(c));
+    return p ? p - v->alphabet : -1;
+}
+
+/*
+ * Performs the cipher on a message, both for encrypting and decrypting.
+ */
+static int _vcipher(
+    const struct px_variant *v,
+    const card *key,
+    const char *msg,
+    char **buf,
+    const int decrypt) {
+
+    card deck[2 * PX_MAXCARDS], /* copy of the key, scratch memory */
+         k; /* key stream card */
+    const char *p = msg;
+    int m,
+        n = 0, /* letters written */
+        pad = _vindex(v, 'X');
+    int ret = -1;
+
+    if (v == NULL || key == NULL || msg == NULL || buf == NULL) {
+        LOG_ERR(("Null pointer found. Whoops. [7d1e]\n"));
+        return -1;
+    }
+
+    /* 4 bytes for 'X' padding and one for a 0-terminator */
+    *buf = px_malloc(strlen(msg) + 5);
+    if (!*buf) {
+        LOG_ERR(("No memory. [c92b]\n"));
+        return -1;
+    }
+
+    memcpy(deck, key, v->ncards);
+
+    for (;;) {
+        if (*p != '\0') {
+            m = _vindex(v, *p++);
+            if (m < 0) continue;
+        } else if (n % 5) {
+            m = pad;
+        } else {
+            break;
+        }
+
+        do {
+            k = v->round(deck, deck + PX_MAXCARDS);
+            if (k == INVALID_CARD) {
+                LOG_ERR(("Could not locate jokers!\n"));
+                px_free(*buf);
+                *buf = NULL;
+                goto clean;
+            }
+        } while (k >= v->ncards - 1);
+
+        k %= v->nletters;
+        m = decrypt ? m - k + v->nletters : m + k;
+        (*buf)[n++] = v->alphabet[m % v->nletters];
+    }
+
+    (*buf)[n++] = '\0';
+    ret = n;
+
+clean:
+    memset(deck, 0, sizeof(deck));
+    return ret;
+}
+
+/*
+ * Looks up a variant by name.
+ * See header.
+ */
+const struct px_variant *px_variant(const char *name) {
+    int i;
+
+    for (i = 0; i < (int)(sizeof(variants) / sizeof(*variants)); i++) {
+        if (!strcmp(variants[i].name, name)) return &variants[i];
+    }
+    return NULL;
+}
+
+/*
+ * Generates a key from a password.
+ * See header.
+ */
+int px_vkeygen(
+    const struct px_variant *v,
+    const char *password,
+    card *key) {
+
+    card scratch[PX_MAXCARDS];
+    int i, c;
+    int ret = 0;
+
+    for (i = 0; i < v->ncards; i++) key[i] = i + 1;
+
+    for (i = 0; password[i] != '\0'; i++) {
+        c = _vindex(v, password[i]);
+        if (c < 0) continue;
+
+        if (v->round(key, scratch) == INVALID_CARD) {
+            ret = -1;
+            break;
+        }
+        v->ccut(key, c + 1, scratch);
+    }
+
+    memset(scratch, 0, sizeof(scratch));
+    return ret;
+}
+
+/*
+ * Generates key stream letters.
+ * See header.
+ */
+int px_vstream(
+    const struct px_variant *v,
+    card *deck,
+    char *buf,
+    const int n) {
+
+    card scratch[PX_MAXCARDS];
+    card c;
+    int i = 0;
+    int ret = 0;
+
+    while (i < n) {
+        c = v->round(deck, scratch);
+        if (c == INVALID_CARD) {
+            LOG_ERR(("Could not locate jokers!\n"));
+            ret = -1;
+            break;
+        }
+        if (c < v->ncards - 1) {
+            buf[i++] = v->alphabet[(c - 1) % v->nletters];
+        }
+    }
+
+    memset(scratch, 0, sizeof(scratch));
+    return ret;
+}
+
+/*
+ * Encrypts a message.
+ * See header.
+ */
+int px_vencrypt(
+    const struct px_variant *v,
+    const card *key,
+    const char *msg,
+    char **buf) {
+    return _vcipher(v, key, msg, buf, 0);
+}
+
+/*
+ * Decrypts a message.
+ * See header.
+ */
+int px_vdecrypt(
+    const struct px_variant *v,
+    const card *key,
+    const char *msg,
+    char **buf) {
+    return _vcipher(v, key, msg, buf, 1);
+}
+
+#undef INVALID_CARD
@@ -0,0 +1,135 @@
+#ifndef PX_VARIANT__H_
+#define PX_VARIANT__H_
+
+/*
+ *  px_variant.h : declares variants of the cipher with other deck
+ *                 sizes and alphabets.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "./px_common.h"
+#include "./px_alloc.h"
+
+/*
+ * A variant plays the same algorithm with a deck of n cards, the
+ * jokers being n - 1 and n. Each of the other cards stands for a
+ * letter of the alphabet, card c for letter (c - 1) % nletters.
+ *
+ * The variants are fixed at compile time, each with a round function
+ * specialized for its deck size. The standard 54-card cipher of
+ * px_crypto.h is not routed through here and keeps its own engines.
+ */
+
+/** Largest deck of all variants. */
+#define PX_MAXCARDS 82
+
+/**
+ * A deck size and alphabet.
+ */
+struct px_variant {
+    const char *name;
+    int ncards; /* including the two jokers */
+    const char *alphabet; /* upper case, ncards - 2 is a multiple of
+                             its length, contains 'X' for padding */
+    int nletters;
+    card (*round)(card *deck, card *buffer); /* see px_round() */
+    void (*ccut)(card *deck, int count, card *buffer); /* see px_ccut() */
+};
+
+/**
+ * Looks up a variant by name:
+ *
+ *   "std"    54 cards, A-Z, the standard cipher
+ *   "small"  28 cards, A-Z, for research on the structure of the cipher
+ *   "ext"    82 cards, A-Z, 0-9 and . , ? -
+ *
+ * \param name  The name of the variant.
+ *
+ * \returns The variant, NULL if there is none of that name.
+ */
+const struct px_variant *px_variant(const char *name);
+
+/**
+ * Generates a key from a password, like px_keygen() without moving the
+ * jokers. Characters outside of the alphabet are ignored.
+ *
+ * \param v         The variant.
+ * \param password  The password, 0-terminated.
+ * \param key       out: v->ncards cards.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+int px_vkeygen(
+    const struct px_variant *v,
+    const char *password,
+    card *key);
+
+/**
+ * Generates key stream letters, advancing the deck.
+ *
+ * \param v     The variant.
+ * \param deck  The deck, v->ncards cards.
+ * \param buf   out: n letters of the alphabet, no 0-terminator.
+ * \param n     Number of letters.
+ *
+ * \returns 0 on success, -1 if the deck is not valid.
+ */
+int px_vstream(
+    const struct px_variant *v,
+    card *deck,
+    char *buf,
+    const int n);
+
+/**
+ * Encrypts a message, like px_encrypt(). Characters outside of the
+ * alphabet are ignored, lower case letters count as upper case. The
+ * result is padded with 'X' to a multiple of 5 letters.
+ *
+ * \param v     The variant.
+ * \param key   The key, v->ncards cards.
+ * \param msg   The message, 0-terminated.
+ * \param buf   out: The allocated cipher text, 0-terminated.
+ *
+ * \returns The length of the cipher text including the 0-terminator,
+ *          -1 on failure.
+ */
+int px_vencrypt(
+    const struct px_variant *v,
+    const card *key,
+    const char *msg,
+    char **buf);
+
+/**
+ * Decrypts a message encrypted with px_vencrypt().
+ *
+ * \param v     The variant.
+ * \param key   The key, v->ncards cards.
+ * \param msg   The cipher text, 0-terminated.
+ * \param buf   out: The allocated plain text, 0-terminated.
+ *
+ * \returns The length of the plain text including the 0-terminator,
+ *          -1 on failure.
+ */
+int px_vdecrypt(
+    const struct px_variant *v,
+    const card *key,
+    const char *msg,
+    char **buf);
+
+#endif
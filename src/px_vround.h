@@ -0,0 +1,99 @@
+/*
+ *  px_vround.h : Key stream round for a deck of VN cards.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * This file has no include guard. px_variant.c includes it once per
+ * deck size, with
+ *
+ *   VN       the number of cards, the jokers being VN - 1 and VN,
+ *   VFN(f)   the name of function f for this deck size.
+ *
+ * As VN is a constant, the compiler sees fixed lengths and offsets for
+ * each size, like for the hard-coded 54 cards of px_crypto.c.
+ */
+
+/*
+ * Moves the card at j to k, shifting the cards in between.
+ */
+static void VFN(move)(card *deck, int j, int k) {
+    card c = deck[j];
+
+    if (j < k) {
+        memmove(deck + j, deck + j + 1, k - j);
+    } else {
+        memmove(deck + k + 1, deck + k, j - k);
+    }
+    deck[k] = c;
+}
+
+/*
+ * Performs the count cut, see px_ccut(). Both jokers count as VN - 1.
+ */
+static void VFN(ccut)(card *deck, int count, card *buffer) {
+    if (count > VN - 1) count = VN - 1;
+
+    memcpy(buffer + VN - 1 - count, deck, count);
+    memcpy(buffer, deck + count, VN - 1 - count);
+    memcpy(deck, buffer, VN - 1);
+}
+
+/*
+ * Performs one round of the key stream algorithm, see px_round().
+ *
+ * \param deck    Pointer to the deck, containing numbers 1-VN.
+ * \param buffer  Pointer to VN cards of scratch memory.
+ *
+ * \returns values 1-VN normally, INVALID_CARD on error.
+ */
+static card VFN(round)(card *deck, card *buffer) {
+    const card *p;
+    int j, k, j1, j2;
+
+    /* Joker A moves 1, joker B 2, wrapping around below the top card. */
+    p = memchr(deck, VN - 1, VN);
+    if (p == NULL) return INVALID_CARD;
+    j = p - deck;
+    VFN(move)(deck, j, j % (VN - 1) + 1);
+
+    p = memchr(deck, VN, VN);
+    if (p == NULL) return INVALID_CARD;
+    j = p - deck;
+    k = j % (VN - 1) + 1;
+    VFN(move)(deck, j, k % (VN - 1) + 1);
+
+    /* triple cut */
+    j1 = (const card *)memchr(deck, VN - 1, VN) - deck;
+    j2 = (const card *)memchr(deck, VN, VN) - deck;
+    if (j1 > j2) {
+        k = j1;
+        j1 = j2;
+        j2 = k;
+    }
+    memcpy(buffer, deck + j2 + 1, VN - 1 - j2);
+    memcpy(buffer + VN - 1 - j2, deck + j1, j2 - j1 + 1);
+    memcpy(buffer + VN - j1, deck, j1);
+    memcpy(deck, buffer, VN);
+
+    /* The bottom card stays in place during the count cut. */
+    VFN(ccut)(deck, deck[VN - 1], buffer);
+
+    return deck[deck[0] < VN - 1 ? deck[0] : VN - 1];
+}
@@ -0,0 +1,473 @@
+/*
+ *  pxcrack.c : Main entry of the key search tool, which completes
+ *              partially known keys with a known plain text.
+ *
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <argp.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./logging.h"
+#include "./px_common.h"
+#include "./px_attack.h"
+#include "./px_io.h"
+#include "./px_ngram.h"
+#include "./px_par.h"
+#include "./px_shard.h"
+#include "./px_stats.h"
+
+int loglevel = LOGLEVEL_WRN;
+
+/* ****************************************************************************
+ * ARGP declarations and configuration
+ */
+const char *argp_program_version = "1.0";
+const char *argp_program_bug_adrress = "<turysaz@posteo.org>";
+static char doc[] =
+    "Searches the completions of a partially known pontifex key that"
+    " turn a known plain text into its cipher text."
+    "\vThe DECK consists of 54 two-digit card numbers like the keys of"
+    " enoch, with ?? for every unknown card. Whitespace is ignored."
+    " Matching keys are printed as PONTIFEX KEY blocks, the statistics"
+    " of the search to stderr."
+    "\n\nA dictionary search is split into shards of a job directory"
+    " for any number of worker processes.";
+
+static struct argp_option opts[] = {
+    /* name      key      arg flags    doc                              group */
+    { "deck",    'k',  "DECK", 0, "The partially known key.",               0 },
+    { "plain",   'p',  "TEXT", 0, "Known plain text."                         },
+    { "cipher",  'c',  "TEXT", 0, "Cipher text of the known plain text."      },
+    { "mkjob",    1 ,   "DIR", 0, "Create a dictionary search job in DIR."   },
+    { "dict",     2 ,  "FILE", 0, "Dictionary, one password per line."       },
+    {
+        "shard-size",
+        3,
+        "N",
+        0,
+        "Words per shard of a new job. Default: 1000000"
+    },
+    {
+        "work",
+        4,
+        "DIR",
+        0,
+        "Work on the job in DIR, resuming the shards of killed workers."
+    },
+    {
+        "status",
+        5,
+        "DIR",
+        0,
+        "Print the passwords found in DIR, and the progress to stderr."
+    },
+    {
+        "solve",
+        6,
+        0,
+        0,
+        "Instead of testing every completion, play the crib on the"
+        " partial deck and print the partial decks that reproduce it,"
+        " one per line, with ?? for the cards that do not matter."
+    },
+    { "max",      7 ,     "N", 0, "Stop --solve after N decks. Default: 100" },
+    {
+        "ngrams",
+        8,
+        "FILE",
+        0,
+        "Without a known plain text, rank the passwords of --dict by how"
+        " English-like they decrypt --cipher, by the quadgram counts in"
+        " FILE (lines like TION 13168375)."
+    },
+    { "top",      9 ,     "K", 0, "Print the K best passwords. Default: 10"  },
+    {
+        "letters",
+        10,
+        "N",
+        0,
+        "Decrypt and score the first N letters. Default: 100"
+    },
+    {
+        "move-jokers",
+        'j',
+        0,
+        0,
+        "Move jokers for key generation, like enoch. (--mkjob or"
+        " --ngrams only)"
+    },
+    { "threads", 't',     "N", 0, "Use N threads. Default: all CPUs",       1 },
+    { "verbose", 'v',       0, 0, "Increases verbosity (up to '-vv')"         },
+    { "quiet",   'q',       0, 0, "Reduces all log output except errors"      },
+    { 0 }
+};
+
+/*
+ *  Collected CLI options.
+ */
+struct crackargs {
+    card deck[54];
+    int hasdeck; /* bool flag */
+    char *pt;
+    char *ct;
+    int nthreads;
+    char *mkjob; /* job directory of the mode, at most one is set */
+    char *work;
+    char *status;
+    char *dict;
+    unsigned long shardsize;
+    int solve; /* bool flag */
+    int maxdecks;
+    char *ngrams;
+    int top;
+    int nletters;
+    int mvjokers; /* bool flag: move jokers on key generation */
+};
+
+/* Set by SIGINT and SIGTERM, so workers stop at their next checkpoint. */
+static volatile sig_atomic_t stop;
+
+static void _onsignal(int sig) {
+    stop = 1;
+}
+
+/*
+ * Parses a partial key, with ?? for unknown cards.
+ *
+ * \returns 0 on success, -1 on failure.
+ */
+static int _rddeck(const char *str, card *deck) {
+    int n = 0;
+
+    while (*str) {
+        if (isspace(*str)) {
+            str++;
+            continue;
+        }
+
+        if (n == 54 || !str[1]) break;
+
+        if (str[0] == '?' && str[1] == '?') {
+            deck[n++] = 0;
+        } else if (isdigit(str[0]) && isdigit(str[1])) {
+            deck[n] = (str[0] - '0') * 10 + str[1] - '0';
+            if (deck[n] < 1 || deck[n] > 54) break;
+            n++;
+        } else {
+            break;
+        }
+        str += 2;
+    }
+
+    if (*str || n != 54) {
+        LOG_ERR(("The deck needs 54 card numbers or ??.\n"));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ *  Collects the arguments.
+ */
+static error_t parseargs(
+        int key,
+        char *arg,
+        struct argp_state *state) {
+    struct crackargs *args = state->input;
+
+    switch (key) {
+        case 'k': /* --deck=DECK */
+            if (_rddeck(arg, args->deck)) return EINVAL;
+            args->hasdeck = 1;
+            break;
+        case 'p': /* --plain=TEXT */
+            args->pt = arg;
+            break;
+        case 'c': /* --cipher=TEXT */
+            args->ct = arg;
+            break;
+        case   1: /* --mkjob=DIR */
+            args->mkjob = arg;
+            break;
+        case   2: /* --dict=FILE */
+            args->dict = arg;
+            break;
+        case   3: /* --shard-size=N */
+            args->shardsize = strtoul(arg, NULL, 10);
+            if (!args->shardsize) return EINVAL;
+            break;
+        case   4: /* --work=DIR */
+            args->work = arg;
+            break;
+        case   5: /* --status=DIR */
+            args->status = arg;
+            break;
+        case   6: /* --solve */
+            args->solve = 1;
+            break;
+        case   7: /* --max=N */
+            args->maxdecks = atoi(arg);
+            if (args->maxdecks < 0) return EINVAL;
+            break;
+        case   8: /* --ngrams=FILE */
+            args->ngrams = arg;
+            break;
+        case   9: /* --top=K */
+            args->top = atoi(arg);
+            if (args->top <= 0) return EINVAL;
+            break;
+        case  10: /* --letters=N */
+            args->nletters = atoi(arg);
+            if (args->nletters < 4) return EINVAL;
+            break;
+        case 'j': /* --move-jokers */
+            args->mvjokers = 1;
+            break;
+        case 't': /* --threads=N */
+            args->nthreads = atoi(arg);
+            break;
+        case 'v': /* --verbose */
+            loglevel++;
+            break;
+        case 'q': /* --quiet */
+            loglevel = LOGLEVEL_ERR;
+            break;
+        case ARGP_KEY_END:
+            if (!!args->mkjob + !!args->work + !!args->status
+                    + !!args->ngrams > 1) {
+                LOG_ERR(("Use only one of --mkjob, --work, --status and"
+                    " --ngrams.\n"));
+                return EINVAL;
+            }
+            if (args->work || args->status) break;
+            if (args->ngrams && (!args->dict || !args->ct)) {
+                LOG_ERR(("--ngrams needs --dict and --cipher.\n"));
+                return EINVAL;
+            }
+            if (args->ngrams) break;
+            if (args->mkjob && (!args->dict || !args->pt || !args->ct)) {
+                LOG_ERR(("--mkjob needs --dict, --plain and --cipher.\n"));
+                return EINVAL;
+            }
+            if (!args->mkjob && (!args->hasdeck || !args->pt || !args->ct)) {
+                LOG_ERR(("--deck, --plain and --cipher are required.\n"));
+                return EINVAL;
+            }
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+/*
+ * Works on a job directory until it is done or the worker is stopped.
+ */
+static int _work(const struct crackargs *args) {
+    struct px_jobstat st;
+    double t = px_now();
+    long n;
+
+    signal(SIGINT, _onsignal);
+    signal(SIGTERM, _onsignal);
+
+    n = px_jobwork(args->work, args->nthreads, 0, &stop);
+    if (n < 0) return EIO;
+
+    t = px_now() - t;
+    fprintf(stderr, "%ld words in %.3f s (%.0f/s) on %i threads\n",
+        n, t, t > 0 ? n / t : 0.0,
+        args->nthreads > 0 ? args->nthreads : px_ncpus());
+
+    if (!stop && !px_jobstatus(args->work, &st, NULL)
+            && st.ndone < st.nshards) {
+        LOG_INF(("%lu shards are claimed by other workers.\n",
+            st.nshards - st.ndone));
+    }
+    return 0;
+}
+
+/*
+ * Prints the progress of a job directory, and the passwords found.
+ */
+static int _status(const struct crackargs *args) {
+    struct px_jobstat st;
+
+    if (px_jobstatus(args->status, &st, stdout)) return EIO;
+
+    fprintf(stderr,
+        "%lu of %lu shards done, %lu in progress\n"
+        "%lu of %lu words tested (%.1f%%), %lu found\n",
+        st.ndone, st.nshards, st.nactive,
+        st.tested, st.nwords, 100.0 * st.tested / st.nwords, st.nfound);
+    if (st.mvjokers) fputs("The keys move the jokers.\n", stderr);
+    if (st.seconds > 0) {
+        fprintf(stderr, "%.0f words/s per worker over %.3f s of work\n",
+            st.tested / st.seconds, st.seconds);
+    }
+    if (st.elapsed > 0) {
+        fprintf(stderr, "%.0f words/s of all workers over %.0f s since"
+            " the job was created\n", st.tested / st.elapsed, st.elapsed);
+    }
+
+    return st.nfound ? 0 : 1;
+}
+
+/*
+ * Finds the partial decks that reproduce the crib, and prints them.
+ */
+static int _solve(const struct crackargs *args, const card *expect,
+        const int nexpect) {
+    struct px_solveres res;
+    const card *d;
+    int i, j;
+
+    if (px_solve(args->deck, expect, nexpect, args->nthreads,
+            args->maxdecks, &res)) {
+        return EINVAL;
+    }
+
+    for (i = 0; i < res.ndecks; i++) {
+        d = res.decks + i * 54;
+        for (j = 0; j < 54; j++) {
+            if (d[j]) printf("%02i", d[j]);
+            else fputs("??", stdout);
+        }
+        putchar('\n');
+    }
+
+    fprintf(stderr,
+        "%lu nodes in %.3f s (%.0f/s) on %i threads, %lu stolen\n"
+        "%i decks found%s\n",
+        res.nodes, res.seconds,
+        res.seconds > 0 ? res.nodes / res.seconds : 0.0,
+        args->nthreads > 0 ? args->nthreads : px_ncpus(),
+        res.steals, res.ndecks,
+        res.complete ? "" : ", stopped early");
+
+    px_free(res.decks);
+    return res.ndecks ? 0 : 1;
+}
+
+/*
+ * Ranks the passwords of a dictionary by the plain text they yield.
+ */
+static int _rank(const struct crackargs *args) {
+    struct px_ngrams ng;
+    struct px_rankres res;
+    int i;
+
+    if (px_ngload(args->ngrams, &ng)) return EIO;
+
+    if (px_rankdict(args->dict, args->ct, args->nletters, &ng, args->top,
+            args->mvjokers, args->nthreads, &res)) {
+        px_ngfree(&ng);
+        return EIO;
+    }
+    px_ngfree(&ng);
+
+    for (i = 0; i < res.nbest; i++) {
+        printf("%.2f\t%s\n", res.best[i].score, res.best[i].password);
+    }
+
+    fprintf(stderr,
+        "%lu passwords in %.3f s (%.0f/s) on %i threads, %i letters\n",
+        res.candidates, res.seconds,
+        res.seconds > 0 ? res.candidates / res.seconds : 0.0,
+        args->nthreads > 0 ? args->nthreads : px_ncpus(),
+        args->nletters);
+
+    i = res.nbest ? 0 : 1;
+    px_rankfree(&res);
+    return i;
+}
+
+/* Parser struct for argp. */
+static struct argp parser = { opts, parseargs, 0, doc };
+
+int main(int argc, char **argv) {
+    struct crackargs args;
+    struct px_searchres res;
+    card *expect = NULL;
+    int nexpect, i;
+    long n;
+    error_t failure;
+
+    memset(&args, 0, sizeof(args));
+    args.shardsize = 1000000;
+    args.maxdecks = 100;
+    args.top = 10;
+    args.nletters = 100;
+
+    failure = argp_parse(&parser, argc, argv, 0, 0, &args);
+    if (failure) {
+        LOG_ERR(("%s\n", strerror(failure)));
+        return failure;
+    }
+
+    if (args.work) return _work(&args);
+    if (args.status) return _status(&args);
+    if (args.ngrams) return _rank(&args);
+
+    nexpect = px_crib(args.pt, args.ct, &expect);
+    if (nexpect < 0) return EINVAL;
+
+    if (args.mkjob) {
+        n = px_jobcreate(
+            args.mkjob, args.dict, expect, nexpect, args.mvjokers,
+            args.shardsize);
+        px_free(expect);
+        if (n < 0) return EIO;
+        LOG_INF(("Created a job of %ld shards.\n", n));
+        return 0;
+    }
+
+    if (args.solve) {
+        i = _solve(&args, expect, nexpect);
+        px_free(expect);
+        return i;
+    }
+
+    if (px_search(args.deck, expect, nexpect, args.nthreads, &res)) {
+        px_free(expect);
+        return EINVAL;
+    }
+
+    for (i = 0; i < res.nkeys; i++) {
+        px_prkey(res.keys + i * 54, stdout, 0);
+    }
+
+    fprintf(stderr,
+        "%lu candidates in %.3f s (%.0f/s) on %i threads, %i found\n",
+        res.candidates, res.seconds,
+        res.seconds > 0 ? res.candidates / res.seconds : 0.0,
+        args.nthreads > 0 ? args.nthreads : px_ncpus(),
+        res.nkeys);
+
+    px_free(res.keys);
+    px_free(expect);
+    return res.nkeys ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_alloc_tests.h"
+#include "../src/px_alloc.h"
+#include "../src/px_crypto.h"
+
+static void arena_blocks(void) {
+    struct px_arena a;
+    char *p, *q, *r;
+    int i;
+
+    px_arinit(&a);
+
+    /* blocks are aligned and do not overlap */
+    p = px_aralloc(&a, 3);
+    q = px_aralloc(&a, 5);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(p);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(q);
+    CU_ASSERT_EQUAL((size_t)p % sizeof(double), 0);
+    CU_ASSERT_EQUAL((size_t)q % sizeof(double), 0);
+    CU_ASSERT(q >= p + 3);
+    memcpy(p, "ab", 3);
+    memcpy(q, "cdef", 5);
+
+    /* the latest block grows and is released in place */
+    r = a.hooks.resize(a.hooks.ctx, q, 1000);
+    CU_ASSERT_PTR_EQUAL(r, q);
+    CU_ASSERT_STRING_EQUAL(r, "cdef");
+    a.hooks.release(a.hooks.ctx, r);
+    CU_ASSERT_PTR_EQUAL(px_aralloc(&a, 10), q);
+
+    /* others are copied */
+    r = a.hooks.resize(a.hooks.ctx, p, 100);
+    CU_ASSERT(r != p);
+    CU_ASSERT_STRING_EQUAL(r, "ab");
+
+    /* the arena grows beyond its first chunk */
+    for (i = 0; i < 100; i++) {
+        r = px_aralloc(&a, 4000);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(r);
+        memset(r, i, 4000);
+    }
+    CU_ASSERT(a.total >= 100 * 4000);
+
+    /* after a reset, the chunks are merged and reused */
+    px_arreset(&a);
+    p = px_aralloc(&a, 100 * 4000);
+    CU_ASSERT_PTR_NOT_NULL(p);
+    CU_ASSERT_PTR_EQUAL(p, (char *)a.last);
+    CU_ASSERT(a.total >= 100 * 4000 + 100);
+    i = a.total;
+    px_arreset(&a);
+    CU_ASSERT_PTR_EQUAL(px_aralloc(&a, 100 * 4000), p);
+    CU_ASSERT_EQUAL((int)a.total, i);
+
+    px_ardone(&a);
+    CU_ASSERT_EQUAL(a.total, 0);
+}
+
+static void allocator_hooks(void) {
+    const char *msg = "Solitaire is a pen and paper cipher";
+    struct px_opts opts = { 1 };
+    struct px_arena a;
+    card key[54];
+    char *buf, *ref, *p;
+    int n;
+
+    px_keygen("CRYPTONOMICON", 0, key);
+    n = px_encrypt(key, msg, strlen(msg), &ref, &opts);
+    CU_ASSERT_FATAL(n > 0);
+
+    px_arinit(&a);
+    CU_ASSERT_PTR_NULL(px_set_allocator(&a.hooks));
+
+    /* results come from the arena */
+    p = px_aralloc(&a, 1);
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, strlen(msg), &buf, &opts), n);
+    CU_ASSERT_STRING_EQUAL(buf, ref);
+    CU_ASSERT(buf > p && buf < p + PX_ARCHUNK);
+    px_free(buf);
+
+    CU_ASSERT_PTR_EQUAL(px_set_allocator(NULL), &a.hooks);
+    px_ardone(&a);
+
+    /* back to malloc() */
+    buf = px_malloc(10);
+    CU_ASSERT_PTR_NOT_NULL(buf);
+    px_free(buf);
+    free(ref);
+}
+
+static int initsuite_px_alloc(void) {
+    return 0;
+}
+
+static int cleansuite_px_alloc(void) {
+    return 0;
+}
+
+int addsuite_px_alloc(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex allocator tests",
+        initsuite_px_alloc, cleansuite_px_alloc);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Allocator: arena blocks, growth and reset",
+        arena_blocks);
+    CU_add_test(
+        suite,
+        "Allocator: results from an arena",
+        allocator_hooks);
+
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_attack_tests.h"
+#include "../src/px_attack.h"
+#include "../src/px_crypto.h"
+
+static void crib_matches_key(void) {
+    card key[54], *expect = NULL;
+    int n;
+
+    px_keygen("cryptonomicon", 0, key);
+
+    n = px_crib("solitaire x", "KIRAK SFJAN", &expect);
+    CU_ASSERT_EQUAL_FATAL(n, 10);
+    CU_ASSERT_EQUAL(px_ksmatch(key, expect, n), 10);
+
+    /* a wrong key diverges early */
+    px_keygen("foo", 0, key);
+    CU_ASSERT(px_ksmatch(key, expect, n) < 10);
+    px_free(expect);
+
+    CU_ASSERT_EQUAL(px_crib("abc", "ab", &expect), -1);
+    CU_ASSERT_PTR_NULL(expect);
+}
+
+static void search_completes_deck(void) {
+    const int slots[] = { 0, 3, 17, 30, 52, 53 }; /* 720 candidates */
+    struct px_searchres res;
+    card key[54], partial[54], *expect = NULL;
+    char *ct = NULL;
+    const char *pt = "ATTACKATDAWNXXXXXXXX";
+    struct px_opts opts = { 1 };
+    int i, n, found = 0;
+
+    px_keygen("foo", 0, key);
+    px_encrypt(key, pt, strlen(pt), &ct, &opts);
+    n = px_crib(pt, ct, &expect);
+
+    memcpy(partial, key, 54);
+    for (i = 0; i < 6; i++) partial[slots[i]] = 0;
+
+    CU_ASSERT_EQUAL(px_search(partial, expect, n, 3, &res), 0);
+    CU_ASSERT_EQUAL(res.candidates, 720);
+    CU_ASSERT(res.nkeys >= 1);
+    for (i = 0; i < res.nkeys; i++) {
+        if (!memcmp(res.keys + i * 54, key, 54)) found++;
+    }
+    CU_ASSERT_EQUAL(found, 1);
+
+    px_free(res.keys);
+    px_free(expect);
+    px_free(ct);
+}
+
+static void search_invalid_deck(void) {
+    struct px_searchres res;
+    card partial[54], expect[1] = { 1 };
+    int i;
+
+    for (i = 0; i < 54; i++) partial[i] = i + 1;
+    partial[5] = 1; /* duplicate */
+    CU_ASSERT_EQUAL(px_search(partial, expect, 1, 1, &res), -1);
+}
+
+static void passwords_match_crib(void) {
+    const char *pws[] = {
+        "solitaire", "cryptonomicon", "cryptonomico", "Crypto Nomicon", ""
+    };
+    struct px_opts opts;
+    char match[5], *ct = NULL;
+    card key[54], *expect = NULL;
+    int n;
+
+    n = px_crib("solitaire x", "KIRAK SFJAN", &expect);
+    CU_ASSERT_EQUAL(px_pwmatch(pws, 5, expect, n, 0, 2, match), 2);
+    CU_ASSERT_EQUAL(match[0], 0);
+    CU_ASSERT_EQUAL(match[1], 1);
+    CU_ASSERT_EQUAL(match[2], 0);
+    CU_ASSERT_EQUAL(match[3], 1);
+    CU_ASSERT_EQUAL(match[4], 0);
+    px_free(expect);
+
+    /* the same password, with moved jokers */
+    memset(&opts, 0, sizeof(opts));
+    px_keygen("cryptonomicon", 1, key);
+    CU_ASSERT_FATAL(px_encrypt(key, "SOLITAIREX", 10, &ct, &opts) > 0);
+    n = px_crib("SOLITAIREX", ct, &expect);
+    CU_ASSERT_EQUAL(px_pwmatch(pws, 5, expect, n, 0, 2, match), 0);
+    CU_ASSERT_EQUAL(px_pwmatch(pws, 5, expect, n, 1, 2, match), 2);
+    CU_ASSERT_EQUAL(match[1], 1);
+    CU_ASSERT_EQUAL(match[3], 1);
+    px_free(expect);
+    px_free(ct);
+}
+
+/*
+ * Tells if a full deck is a completion of a partial deck, and counts
+ * the unknown cards of the partial deck.
+ */
+static int completes(const card *partial, const card *deck, int *k) {
+    int i, ok = 1;
+
+    for (i = *k = 0; i < 54; i++) {
+        if (!partial[i]) (*k)++;
+        else if (partial[i] != deck[i]) ok = 0;
+    }
+    return ok;
+}
+
+static void solve_recovers_deck(void) {
+    const int slots[] = { 0, 3, 17, 30, 45, 52, 53, 9 }; /* 40320 */
+    struct px_searchres sres;
+    struct px_solveres res;
+    card key[54], partial[54], full[54], *expect = NULL;
+    card missing[54];
+    char *ct = NULL, used[55];
+    const char *pt = "ATTACKATDAWNXXXXXXXXATTACKATDUSKXXXXXXXX";
+    struct px_opts opts = { 1 };
+    unsigned long total = 0, f;
+    int i, j, k, n, m, found = 0, valid = 1;
+
+    px_keygen("foo", 0, key);
+    px_encrypt(key, pt, strlen(pt), &ct, &opts);
+    n = px_crib(pt, ct, &expect);
+
+    /* all completions, as px_search() finds them */
+    memcpy(partial, key, 54);
+    for (i = 0; i < 8; i++) partial[slots[i]] = 0;
+    CU_ASSERT_EQUAL_FATAL(px_search(partial, expect, n, 2, &sres), 0);
+    CU_ASSERT_EQUAL_FATAL(px_solve(partial, expect, n, 3, 0, &res), 0);
+    CU_ASSERT_EQUAL(res.complete, 1);
+    CU_ASSERT(res.nodes > 0);
+    for (i = 0; i < res.ndecks; i++) {
+        completes(res.decks + i * 54, key, &k);
+        for (f = 1; k > 1; k--) f *= k;
+        total += f;
+    }
+    CU_ASSERT_EQUAL(total, (unsigned long)sres.nkeys);
+    px_free(sres.keys);
+    px_free(res.decks);
+
+    /* a third of the deck unknown, too much for px_search() */
+    memcpy(partial, key, 54);
+    for (i = 0; i < 54; i += 3) partial[i] = 0;
+    CU_ASSERT_EQUAL_FATAL(px_solve(partial, expect, n, 3, 0, &res), 0);
+    CU_ASSERT_EQUAL(res.complete, 1);
+    CU_ASSERT(res.ndecks >= 1);
+    for (i = 0; i < res.ndecks; i++) {
+        if (completes(res.decks + i * 54, key, &k)) found++;
+
+        /* any completion reproduces the key stream */
+        memset(used, 0, sizeof(used));
+        memcpy(full, res.decks + i * 54, 54);
+        for (j = 0; j < 54; j++) used[(int)full[j]] = 1;
+        for (j = 1, m = 0; j <= 54; j++) {
+            if (!used[j]) missing[m++] = j;
+        }
+        for (j = 0; j < 54; j++) {
+            if (!full[j]) full[j] = missing[--m];
+        }
+        if (px_ksmatch(full, expect, n) != n) valid = 0;
+    }
+    CU_ASSERT_EQUAL(found, 1);
+    CU_ASSERT_EQUAL(valid, 1);
+
+    /* sorted */
+    for (i = 1; i < res.ndecks; i++) {
+        CU_ASSERT(memcmp(res.decks + (i - 1) * 54, res.decks + i * 54, 54) < 0);
+    }
+    px_free(res.decks);
+
+    /* stopped early */
+    CU_ASSERT_EQUAL(px_solve(partial, expect, n, 2, 1, &res), 0);
+    CU_ASSERT_EQUAL(res.ndecks, 1);
+    px_free(res.decks);
+
+    partial[1] = partial[2]; /* duplicate */
+    CU_ASSERT_EQUAL(px_solve(partial, expect, n, 2, 0, &res), -1);
+
+    px_free(expect);
+    px_free(ct);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_attack(void) {
+    return 0;
+}
+
+static int cleansuite_px_attack(void) {
+    return 0;
+}
+
+int addsuite_px_attack(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex key search tests",
+        initsuite_px_attack, cleansuite_px_attack);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Search: crib reproduces the key stream",
+        crib_matches_key);
+    CU_add_test(
+        suite,
+        "Search: complete a partial deck",
+        search_completes_deck);
+    CU_add_test(
+        suite,
+        "Search: invalid partial deck",
+        search_invalid_deck);
+    CU_add_test(
+        suite,
+        "Search: passwords against a crib",
+        passwords_match_crib);
+    CU_add_test(
+        suite,
+        "Search: deck states from a crib",
+        solve_recovers_deck);
+
+    return 0;
+}
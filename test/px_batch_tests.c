@@ -0,0 +1,174 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_batch_tests.h"
+#include "../src/px_batch.h"
+
+#define NFILES 40
+
+static char *inpaths[NFILES];
+static char *outpaths[NFILES];
+
+/* Upper-cases the input, fails for inputs starting with '!'. */
+static int upcase(void *ctx, const char *in, int nin, char **out) {
+    int i;
+
+    if (nin && in[0] == '!') return -1;
+
+    *out = px_malloc(nin + 1);
+    for (i = 0; i < nin; i++) (*out)[i] = toupper(in[i]);
+    return nin;
+}
+
+/* Writes the test inputs. File i holds i times "abc". */
+static void write_inputs(void) {
+    FILE *f;
+    int i, j;
+
+    for (i = 0; i < NFILES; i++) {
+        f = fopen(inpaths[i], "w");
+        for (j = 0; j < i; j++) fputs("abc", f);
+        fclose(f);
+    }
+}
+
+/* Checks that output i holds i times "ABC". */
+static int check_output(int i) {
+    char buf[3 * NFILES + 1];
+    FILE *f;
+    size_t n;
+
+    f = fopen(outpaths[i], "r");
+    if (!f) return 0;
+    n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    if (n != 3 * i) return 0;
+    while (n) {
+        n -= 3;
+        if (memcmp(buf + n, "ABC", 3)) return 0;
+    }
+    return 1;
+}
+
+static void run_backend(int backend) {
+    int i, result;
+
+    write_inputs();
+
+    result = px_batch(inpaths, outpaths, NFILES, 3, backend, upcase, NULL);
+
+    CU_ASSERT_EQUAL(result, 0);
+    for (i = 0; i < NFILES; i++) {
+        CU_ASSERT(check_output(i));
+        remove(outpaths[i]);
+    }
+}
+
+void batch_with_threads(void) {
+    run_backend(PX_BIO_THREADS);
+}
+
+void batch_with_auto_backend(void) {
+    run_backend(PX_BIO_AUTO);
+}
+
+void batch_with_failures(void) {
+    int result;
+    FILE *f;
+    char *ins[3];
+
+    write_inputs();
+    f = fopen(inpaths[1], "w");
+    fputs("!fail", f);
+    fclose(f);
+
+    /* one failing transformation, one missing input file */
+    ins[0] = inpaths[0];
+    ins[1] = inpaths[1];
+    ins[2] = "batch_test_missing.tmp";
+
+    result = px_batch(ins, outpaths, 3, 2, PX_BIO_AUTO, upcase, NULL);
+    CU_ASSERT_EQUAL(result, 2);
+    CU_ASSERT(check_output(0));
+
+    remove(outpaths[0]);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_batch(void) {
+    int i;
+
+    for (i = 0; i < NFILES; i++) {
+        inpaths[i] = malloc(32);
+        outpaths[i] = malloc(32);
+        if (!inpaths[i] || !outpaths[i]) return -1;
+        sprintf(inpaths[i], "batch_test_in_%i.tmp", i);
+        sprintf(outpaths[i], "batch_test_out_%i.tmp", i);
+    }
+
+    return 0;
+}
+
+static int cleansuite_px_batch(void) {
+    int i;
+
+    for (i = 0; i < NFILES; i++) {
+        remove(inpaths[i]);
+        free(inpaths[i]);
+        free(outpaths[i]);
+    }
+
+    return 0;
+}
+
+int addsuite_px_batch(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex batch processing tests",
+        initsuite_px_batch, cleansuite_px_batch);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Batch: thread backend",
+        batch_with_threads);
+    CU_add_test(
+        suite,
+        "Batch: automatic backend selection",
+        batch_with_auto_backend);
+    CU_add_test(
+        suite,
+        "Batch: failing files are counted",
+        batch_with_failures);
+
+    return 0;
+}
+
+#undef NFILES
+
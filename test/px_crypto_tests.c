@@ -213,6 +213,327 @@ static void keygen_with_move_jokers() {
     CU_ASSERT_EQUAL(result, 0);
 }
 
+static void table_engine_matches_reference() {
+    int i;
+    struct px_opts ref = { 1, PX_ENG_REF },
+                   tab = { 1, PX_ENG_TABLE };
+    char *buf_ref = NULL,
+         *buf_tab = NULL;
+    card key[54];
+    const char *passwords[] = { "", "a", "foo", "bcd", "zzzzzz" };
+
+    /* jokers on the edges of the deck */
+    const card edges [] =
+        {53,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12,
+         13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+         25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
+         37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48,
+         49, 50, 51, 52,  1, 54 };
+
+    /* every password with and without moving the jokers, then the edges */
+    for (i = 0; i < 11; i++) {
+        if (i < 10) {
+            px_keygen(passwords[i / 2], i % 2, key);
+        } else {
+            memcpy(key, edges, sizeof(key));
+        }
+
+        CU_ASSERT_EQUAL(px_stream(key, 5000, &buf_ref, &ref), 0);
+        CU_ASSERT_EQUAL(px_stream(key, 5000, &buf_tab, &tab), 0);
+        CU_ASSERT_STRING_EQUAL(buf_tab, buf_ref);
+
+        if (buf_ref) free(buf_ref);
+        if (buf_tab) free(buf_tab);
+    }
+}
+
+static void branchfree_engine_matches_reference() {
+    int ja, jb, i, c;
+    struct px_opts ref = { 1, PX_ENG_REF },
+                   bf = { 1, PX_ENG_BFREE };
+    char *buf_ref = NULL,
+         *buf_bf = NULL;
+    card key[54];
+
+    /* every pair of joker positions */
+    for (ja = 0; ja < 54; ja++) {
+        for (jb = 0; jb < 54; jb++) {
+            if (ja == jb) continue;
+
+            for (i = 0, c = 1; i < 54; i++) {
+                if (i == ja) key[i] = 53;
+                else if (i == jb) key[i] = 54;
+                else key[i] = c++;
+            }
+
+            CU_ASSERT_EQUAL(px_stream(key, 20, &buf_ref, &ref), 0);
+            CU_ASSERT_EQUAL(px_stream(key, 20, &buf_bf, &bf), 0);
+            CU_ASSERT_STRING_EQUAL(buf_bf, buf_ref);
+
+            if (buf_ref) free(buf_ref);
+            if (buf_bf) free(buf_bf);
+        }
+    }
+
+    /* a long key stream of a password */
+    px_keygen("cryptonomicon", 0, key);
+    CU_ASSERT_EQUAL(px_stream(key, 5000, &buf_ref, &ref), 0);
+    CU_ASSERT_EQUAL(px_stream(key, 5000, &buf_bf, &bf), 0);
+    CU_ASSERT_STRING_EQUAL(buf_bf, buf_ref);
+    if (buf_ref) free(buf_ref);
+    if (buf_bf) free(buf_bf);
+}
+
+static void engine_registry() {
+    int e;
+
+    for (e = 0; e < PX_NENGINES; e++) {
+        CU_ASSERT_PTR_NOT_NULL(px_engname(e));
+        CU_ASSERT_EQUAL(px_engcheck(e), 0);
+        CU_ASSERT_EQUAL(px_engselect(px_engname(e)), e);
+    }
+    CU_ASSERT_STRING_EQUAL(px_engname(PX_ENG_REF), "reference");
+    CU_ASSERT_PTR_NULL(px_engname(PX_NENGINES));
+    CU_ASSERT_EQUAL(px_engcheck(PX_NENGINES), -1);
+    CU_ASSERT_EQUAL(px_engselect("bogus"), -1);
+
+    /* The calibration picks a checked engine, and keeps it. */
+    e = px_engselect("auto");
+    CU_ASSERT(e >= 0 && e < PX_NENGINES);
+    CU_ASSERT_EQUAL(px_engselect("auto"), e);
+}
+
+static void stats_are_counted() {
+    struct px_stats stats;
+    struct px_opts opts = { 1 };
+    char *buf = NULL;
+    card key[54];
+
+    memset(&stats, 0, sizeof(stats));
+    opts.stats = &stats;
+
+    px_keygen("cryptonomicon", 0, key);
+    CU_ASSERT_EQUAL(px_encrypt(key, "Solitaire!", 10, &buf, &opts), 11);
+    CU_ASSERT_STRING_EQUAL(buf, "KIRAKSFJAN");
+    CU_ASSERT_EQUAL(stats.inbytes, 10);
+    CU_ASSERT_EQUAL(stats.letters, 9);
+    CU_ASSERT_EQUAL(stats.padding, 1);
+    CU_ASSERT_EQUAL(stats.keystream, 10);
+    if (buf) free(buf);
+
+    /* "foo" skips two jokers within the first 20 letters */
+    memset(&stats, 0, sizeof(stats));
+    px_keygen("foo", 0, key);
+    CU_ASSERT_EQUAL(px_stream(key, 20, &buf, &opts), 0);
+    CU_ASSERT_EQUAL(stats.keystream, 20);
+    CU_ASSERT_EQUAL(stats.skipped, 2);
+    CU_ASSERT_EQUAL(stats.letters, 0);
+    if (buf) free(buf);
+}
+
+static void stream_in_pieces() {
+    struct px_opts opts = { 1 };
+    struct px_ks ks;
+    card key[54];
+    char *whole = NULL,
+         piece[1000];
+    int i, n;
+
+    px_keygen("cryptonomicon", 0, key);
+    CU_ASSERT_EQUAL(px_stream(key, 1000, &whole, &opts), 0);
+
+    /* Pieces of all sizes continue the same key stream. */
+    CU_ASSERT_EQUAL(px_ksopen(&ks, key, &opts), 0);
+    for (i = 0, n = 1; i < 1000; i += n, n++) {
+        if (i + n > 1000) n = 1000 - i;
+        CU_ASSERT_EQUAL(px_ksread(&ks, piece, n), 0);
+        CU_ASSERT_EQUAL(memcmp(piece, whole + i, n), 0);
+    }
+    px_ksclose(&ks);
+    CU_ASSERT_PTR_NULL(ks.deck);
+
+    if (whole) free(whole);
+}
+
+static void pipeline_matches_inline() {
+    struct px_opts inl = { 1 },
+                   pip = { 1 };
+    struct px_stats si, sp;
+    card key[54];
+    char *msg, *ref = NULL, *buf = NULL, *dec = NULL;
+    int i, n;
+
+    /* Long enough for the key stream thread, and not a whole chunk. */
+    n = 20000 + 77;
+    msg = malloc(n + 1);
+    for (i = 0; i < n; i++) msg[i] = 'a' + (i * 7) % 26;
+    msg[n] = '\0';
+
+    memset(&si, 0, sizeof(si));
+    memset(&sp, 0, sizeof(sp));
+    inl.stats = &si;
+    pip.stats = &sp;
+    pip.pipeline = 1;
+
+    px_keygen("cryptonomicon", 0, key);
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, n, &ref, &inl), n + 4);
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, n, &buf, &pip), n + 4);
+    CU_ASSERT_STRING_EQUAL(buf, ref);
+    CU_ASSERT_EQUAL(sp.keystream, si.keystream);
+    CU_ASSERT(sp.skipped >= si.skipped);
+
+    CU_ASSERT_EQUAL(px_decrypt(key, buf, n + 3, &dec, &pip), n + 4);
+    for (i = 0; i < n; i++) {
+        if (dec[i] != msg[i] - 'a' + 'A') break;
+    }
+    CU_ASSERT_EQUAL(i, n);
+
+    free(msg);
+    if (ref) free(ref);
+    if (buf) free(buf);
+    if (dec) free(dec);
+}
+
+static void segments_roundtrip() {
+    struct px_opts plain = { 1 },
+                   seg = { 1 };
+    card key[54], segkey[54];
+    char msg[200], norm[200],
+         *ref = NULL, *buf = NULL, *dec = NULL, *again = NULL;
+    int i, n = 0;
+
+    /* 176 letters with spaces in between, 180 with padding */
+    for (i = 0; i < 199; i++) {
+        msg[i] = i % 9 ? 'a' + (i * 7) % 26 : ' ';
+        if (i % 9) norm[n++] = msg[i] - 'a' + 'A';
+    }
+    msg[199] = '\0';
+    while (n % 5) norm[n++] = 'X';
+    norm[n] = '\0';
+
+    px_keygen("cryptonomicon", 0, key);
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, 199, &ref, &plain), 180 + 1);
+
+    /* Same length as without segments, but another cipher text. */
+    seg.segment = 20;
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, 199, &buf, &seg), 180 + 1);
+    CU_ASSERT_NOT_EQUAL(strcmp(buf, ref), 0);
+    px_free(ref);
+
+    /* Each segment is ciphered with its own deck, here the third. */
+    CU_ASSERT_EQUAL(px_segkey(key, 2, segkey), 0);
+    CU_ASSERT_EQUAL(px_decrypt(segkey, buf + 40, 20, &dec, &plain), 21);
+    CU_ASSERT_EQUAL(strncmp(dec, norm + 40, 20), 0);
+    px_free(dec);
+
+    /* Round trip, on one thread and on all */
+    seg.nthreads = 1;
+    CU_ASSERT_EQUAL(px_decrypt(key, buf, 180, &dec, &seg), 180 + 1);
+    CU_ASSERT_STRING_EQUAL(dec, norm);
+    seg.nthreads = 0;
+    CU_ASSERT_EQUAL(px_encrypt(key, dec, 180, &again, &seg), 180 + 1);
+    CU_ASSERT_STRING_EQUAL(again, buf);
+    px_free(again);
+
+    /* Segments have a multiple of 5 letters. */
+    seg.segment = 12;
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, 199, &again, &seg), -1);
+    seg.segment = PX_SEGMAX / 5 * 5 + 5;
+    CU_ASSERT_EQUAL(px_encrypt(key, msg, 199, &again, &seg), -1);
+
+    px_free(buf);
+    px_free(dec);
+}
+
+static void rand_bytes() {
+    /* First bytes for "cryptonomicon", to keep the extraction stable */
+    const unsigned char expect[] = {
+        0xbd, 0xfc, 0x61, 0x1b, 0x5d, 0x66, 0x97, 0x66
+    };
+    struct px_opts opts = { 1 };
+    struct px_rand r;
+    static unsigned char whole[20000], piece[20000];
+    card key[54];
+    int i, n, ones = 0;
+
+    px_keygen("cryptonomicon", 0, key);
+
+    CU_ASSERT_EQUAL(px_rand_open(&r, key, &opts), 0);
+    CU_ASSERT_EQUAL(px_rand_bytes(&r, whole, sizeof(whole)), 0);
+    px_rand_close(&r);
+    CU_ASSERT_EQUAL(memcmp(whole, expect, sizeof(expect)), 0);
+
+    /* Pieces of any size continue where the last one stopped, across
+       blocks of key stream cards. */
+    CU_ASSERT_EQUAL(px_rand_open(&r, key, &opts), 0);
+    for (i = 0, n = 1; i < sizeof(piece); i += n, n = n * 3 % 4099) {
+        if (n > sizeof(piece) - i) n = sizeof(piece) - i;
+        CU_ASSERT_EQUAL(px_rand_bytes(&r, piece + i, n), 0);
+    }
+    px_rand_close(&r);
+    CU_ASSERT_EQUAL(memcmp(whole, piece, sizeof(whole)), 0);
+
+    /* Roughly as many ones as zeros */
+    for (i = 0; i < sizeof(whole); i++) {
+        for (n = whole[i]; n; n >>= 1) ones += n & 1;
+    }
+    CU_ASSERT(ones > 8 * sizeof(whole) * 49 / 100);
+    CU_ASSERT(ones < 8 * sizeof(whole) * 51 / 100);
+
+    /* Another key, other bytes */
+    px_keygen("enoch", 0, key);
+    CU_ASSERT_EQUAL(px_rand_open(&r, key, &opts), 0);
+    CU_ASSERT_EQUAL(px_rand_bytes(&r, piece, sizeof(expect)), 0);
+    px_rand_close(&r);
+    CU_ASSERT_NOT_EQUAL(memcmp(piece, expect, sizeof(expect)), 0);
+}
+
+static void batch_keygen_matches_keygen() {
+    const char *passwords[] = {
+        "", "a", "aa", "aaa", "foo", "bcd", "Hello, World!", "123", "f",
+        "fo", "b", "bc", "PONTIFEX", "solitaire", "NeilStephenson", "enoch",
+        "cryptonomicon", "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz",
+        "thequickbrownfoxjumpsoverthelazydog", "x y z"
+    };
+    const int n = sizeof(passwords) / sizeof(passwords[0]);
+    card keys[sizeof(passwords) / sizeof(passwords[0])][54],
+         key[54];
+    int i, mvjokers;
+
+    for (mvjokers = 0; mvjokers < 2; mvjokers++) {
+        CU_ASSERT_EQUAL(
+            px_keygens(passwords, n, mvjokers, keys[0], 3), 0);
+        for (i = 0; i < n; i++) {
+            px_keygen(passwords[i], mvjokers, key);
+            CU_ASSERT_NSTRING_EQUAL(keys[i], key, 54);
+        }
+    }
+}
+
+static void batch_keygen_moves_jokers() {
+    /* Many passwords put a joker on top of the deck on the way. */
+    char words[500][16];
+    const char *passwords[500];
+    card keys[500][54],
+         key[54];
+    unsigned long x = 1;
+    int i, j;
+
+    for (i = 0; i < 500; i++) {
+        for (j = 0; j < 1 + i % 15; j++) {
+            x = x * 1103515245UL + 12345UL;
+            words[i][j] = 'a' + (x >> 16) % 26;
+        }
+        words[i][j] = '\0';
+        passwords[i] = words[i];
+    }
+
+    CU_ASSERT_EQUAL_FATAL(px_keygens(passwords, 500, 1, keys[0], 4), 0);
+    for (i = 0; i < 500; i++) {
+        px_keygen(passwords[i], 1, key);
+        CU_ASSERT_NSTRING_EQUAL(keys[i], key, 54);
+    }
+}
 
 /* ========================================================= */
 
@@ -258,6 +579,46 @@ int addsuite_px_crypto(void) {
         suite,
         "Keygen: Move jokers results in expected key",
         keygen_with_move_jokers);
+    CU_add_test(
+        suite,
+        "Stream: table engine matches reference engine",
+        table_engine_matches_reference);
+    CU_add_test(
+        suite,
+        "Stream: branch-free engine matches reference engine",
+        branchfree_engine_matches_reference);
+    CU_add_test(
+        suite,
+        "Stream: engine registry, self-check and selection",
+        engine_registry);
+    CU_add_test(
+        suite,
+        "Stats: letters and key stream are counted",
+        stats_are_counted);
+    CU_add_test(
+        suite,
+        "Keygen: batch keygen matches keygen",
+        batch_keygen_matches_keygen);
+    CU_add_test(
+        suite,
+        "Keygen: batch keygen moves jokers on top",
+        batch_keygen_moves_jokers);
+    CU_add_test(
+        suite,
+        "Stream: key stream read in pieces",
+        stream_in_pieces);
+    CU_add_test(
+        suite,
+        "Pipeline: same cipher text as inline key stream",
+        pipeline_matches_inline);
+    CU_add_test(
+        suite,
+        "Segments: parallel segments with their own decks",
+        segments_roundtrip);
+    CU_add_test(
+        suite,
+        "Random bytes: extracted from the key stream",
+        rand_bytes);
 
     return 0;
 }
@@ -0,0 +1,173 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_deck_tests.h"
+#include "../src/px_crypto.h"
+#include "../src/px_deck.h"
+
+/* 54! - 1 */
+static const unsigned char maxrank[PX_RANKLEN] = {
+    0x21, 0x72, 0x77, 0xf7, 0x7e, 0x01, 0x58, 0x0c, 0xd3, 0x27,
+    0x88, 0x18, 0x6c, 0x96, 0x06, 0x6a, 0x07, 0x11, 0xc7, 0x2a,
+    0x98, 0xd8, 0x91, 0xfb, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static void rank_edges(void) {
+    unsigned char rank[PX_RANKLEN], zero[PX_RANKLEN];
+    card deck[54], back[54];
+    int i;
+
+    memset(zero, 0, sizeof(zero));
+
+    /* identity, rank 0 */
+    for (i = 0; i < 54; i++) deck[i] = i + 1;
+    CU_ASSERT_EQUAL(px_rank(deck, rank), 0);
+    CU_ASSERT_EQUAL(memcmp(rank, zero, PX_RANKLEN), 0);
+    CU_ASSERT_EQUAL(px_unrank(rank, back), 0);
+    CU_ASSERT_EQUAL(memcmp(back, deck, 54), 0);
+
+    /* reversed, the last rank */
+    for (i = 0; i < 54; i++) deck[i] = 54 - i;
+    CU_ASSERT_EQUAL(px_rank(deck, rank), 0);
+    CU_ASSERT_EQUAL(memcmp(rank, maxrank, PX_RANKLEN), 0);
+    CU_ASSERT_EQUAL(px_unrank(rank, back), 0);
+    CU_ASSERT_EQUAL(memcmp(back, deck, 54), 0);
+
+    /* 54! is out of range */
+    memcpy(rank, maxrank, PX_RANKLEN);
+    for (i = PX_RANKLEN - 1; i >= 0 && ++rank[i] == 0; i--);
+    CU_ASSERT_EQUAL(px_unrank(rank, back), -1);
+}
+
+/*
+ * Sign of a memcmp() result.
+ */
+static int _sign(int cmp) {
+    return (cmp > 0) - (cmp < 0);
+}
+
+static void rank_roundtrip(void) {
+    unsigned char rank[PX_RANKLEN], prev[PX_RANKLEN];
+    card deck[54], back[54], prevdeck[54];
+    char password[3];
+    int i;
+
+    /* The ranks are ordered like the decks. */
+    password[2] = '\0';
+    for (i = 0; i < 26 * 26; i++) {
+        password[0] = 'a' + i / 26;
+        password[1] = 'a' + i % 26;
+        px_keygen(password, 0, deck);
+
+        CU_ASSERT_EQUAL(px_rank(deck, rank), 0);
+        CU_ASSERT_EQUAL(px_unrank(rank, back), 0);
+        CU_ASSERT_EQUAL(memcmp(back, deck, 54), 0);
+
+        if (i > 0) {
+            CU_ASSERT_EQUAL(
+                _sign(memcmp(rank, prev, PX_RANKLEN)),
+                _sign(memcmp(deck, prevdeck, 54)));
+        }
+        memcpy(prev, rank, PX_RANKLEN);
+        memcpy(prevdeck, deck, 54);
+    }
+}
+
+static void rank_invalid(void) {
+    unsigned char rank[PX_RANKLEN];
+    card deck[54];
+    int i;
+
+    for (i = 0; i < 54; i++) deck[i] = i + 1;
+    deck[10] = 12; /* duplicate */
+    CU_ASSERT_EQUAL(px_rank(deck, rank), -1);
+    deck[10] = 0;
+    CU_ASSERT_EQUAL(px_rank(deck, rank), -1);
+    deck[10] = 55;
+    CU_ASSERT_EQUAL(px_rank(deck, rank), -1);
+}
+
+static void pack6_roundtrip(void) {
+    unsigned char packed[PX_PACK6LEN];
+    card deck[54], back[54];
+    const char *passwords[] = { "", "foo", "cryptonomicon" };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        px_keygen(passwords[i], 0, deck);
+        px_pack6(deck, packed);
+        CU_ASSERT_EQUAL(packed[PX_PACK6LEN - 1] & 0x0f, 0);
+        CU_ASSERT_EQUAL(px_unpack6(packed, back), 0);
+        CU_ASSERT_EQUAL(memcmp(back, deck, 54), 0);
+    }
+
+    /* 1 2 3 4 -> 000001 000010 000011 000100 */
+    for (i = 0; i < 54; i++) deck[i] = i + 1;
+    px_pack6(deck, packed);
+    CU_ASSERT_EQUAL(packed[0], 0x04);
+    CU_ASSERT_EQUAL(packed[1], 0x20);
+    CU_ASSERT_EQUAL(packed[2], 0xc4);
+
+    /* duplicate card */
+    packed[2] = 0xc3;
+    CU_ASSERT_EQUAL(px_unpack6(packed, back), -1);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_deck(void) {
+    return 0;
+}
+
+static int cleansuite_px_deck(void) {
+    return 0;
+}
+
+int addsuite_px_deck(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex deck encoding tests",
+        initsuite_px_deck, cleansuite_px_deck);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Deck: rank of the first and last deck",
+        rank_edges);
+    CU_add_test(
+        suite,
+        "Deck: rank and unrank decks",
+        rank_roundtrip);
+    CU_add_test(
+        suite,
+        "Deck: invalid decks have no rank",
+        rank_invalid);
+    CU_add_test(
+        suite,
+        "Deck: pack to 6 bits and back",
+        pack6_roundtrip);
+
+    return 0;
+}
@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <CUnit/CUnit.h>
 #include "./px_io_tests.h"
 #include "../src/px_common.h"
@@ -91,6 +92,32 @@ void read_key_with_invalid_characters(void) {
 }
 
 
+void read_deck_of_other_size(void) {
+    card deck[82], key[82];
+    char keystr[2 * 82 + 16];
+    FILE *f;
+    int i, n;
+
+    /* 82 cards in reverse order, printed and read back */
+    for (i = 0; i < 82; i++) deck[i] = 82 - i;
+    f = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    px_prdeck(deck, 82, f, PXO_RAW);
+    rewind(f);
+    n = fread(keystr, 1, sizeof(keystr) - 1, f);
+    keystr[n] = '\0';
+    fclose(f);
+    CU_ASSERT_EQUAL(n, 2 * 82 + 1);
+
+    CU_ASSERT_EQUAL(px_rddeck(keystr, 82, key), 0);
+    CU_ASSERT_NSTRING_EQUAL(key, deck, 82);
+
+    /* card 82 is not part of a deck of 28 cards */
+    CU_ASSERT_EQUAL(px_rddeck(keystr, 28, key), -1);
+    /* nor are 82 cards enough for a deck of 83 */
+    keystr[2 * 82] = '\0';
+    CU_ASSERT_EQUAL(px_rddeck(keystr, 83, key), -1);
+}
 
 void read_happy_cipher_message(void) {
     int result;
@@ -205,6 +232,299 @@ void read_empty_cipher_message(void) {
     if(buf) free(buf);
 }
 
+void scan_multiple_cipher_messages(void) {
+    int result;
+    struct px_msgblk *blks = NULL;
+    char *buf = NULL;
+
+    const char *message =
+        "noise"
+        "-----BEGIN PONTIFEX MESSAGE-----\n"
+        "ABCDE ABCDE\n"
+        "-----END PONTIFEX MESSAGE-----\n"
+        "-----END PONTIFEX MESSAGE-----\n" /* stray end */
+        "more - noise -- in between ---\n"
+        "-----BEGIN PONTIFEX MESSAGE-----\n"
+        "FGHIJ\n"
+        "-----END PONTIFEX MESSAGE-----\n"
+        "-----BEGIN PONTIFEX MESSAGE-----\n"
+        "KLMNO\n"; /* unterminated */
+
+    result = px_scanciphers(message, strlen(message), &blks);
+    CU_ASSERT_EQUAL_FATAL(result, 2);
+
+    result = px_rdblock(&blks[0], &buf);
+    CU_ASSERT_EQUAL(result, 11);
+    CU_ASSERT_STRING_EQUAL(buf, "ABCDEABCDE");
+    if (buf) free(buf);
+
+    result = px_rdblock(&blks[1], &buf);
+    CU_ASSERT_EQUAL(result, 6);
+    CU_ASSERT_STRING_EQUAL(buf, "FGHIJ");
+    if (buf) free(buf);
+
+    free(blks);
+}
+
+void scan_many_cipher_messages(void) {
+    const char *block =
+        "-----BEGIN PONTIFEX MESSAGE-----\n"
+        "ABCDE\n"
+        "-----END PONTIFEX MESSAGE-----\n";
+    struct px_msgblk *blks = NULL;
+    char *text;
+    int i, result;
+    size_t n = strlen(block);
+
+    text = malloc(100 * n + 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+    for (i = 0; i < 100; i++) memcpy(text + i * n, block, n);
+    text[100 * n] = '\0';
+
+    result = px_scanciphers(text, 100 * n, &blks);
+    CU_ASSERT_EQUAL(result, 100);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(blks);
+    CU_ASSERT_EQUAL(blks[99].end - blks[99].start, 7);
+
+    free(blks);
+    free(text);
+}
+
+void segment_length_header(void) {
+    struct px_msgblk *blks = NULL;
+    char *text = NULL, *buf = NULL;
+    int result;
+
+    result = px_fmtsegments("ABCDEFGHIJ", 0, 5, &text);
+    CU_ASSERT_STRING_EQUAL(text,
+        "\n\n-----BEGIN PONTIFEX MESSAGE-----\n\n"
+        "Segment-Length: 5\n\n"
+        "ABCDE FGHIJ \n"
+        "\n-----END PONTIFEX MESSAGE-----\n\n");
+
+    /* The header is read into the block, not into the letters. */
+    result = px_scanciphers(text, strlen(text), &blks);
+    CU_ASSERT_EQUAL_FATAL(result, 1);
+    CU_ASSERT_EQUAL(blks[0].seglen, 5);
+    result = px_rdblock(&blks[0], &buf);
+    CU_ASSERT_STRING_EQUAL(buf, "ABCDEFGHIJ");
+    if (buf) free(buf);
+    free(blks);
+
+    result = px_rdcipher(text, &buf);
+    CU_ASSERT_STRING_EQUAL(buf, "ABCDEFGHIJ");
+    if (buf) free(buf);
+    free(text);
+
+    /* raw output has no header */
+    result = px_fmtsegments("ABCDE", PXO_RAW, 5, &text);
+    CU_ASSERT_STRING_EQUAL(text, "ABCDE \n");
+    free(text);
+}
+
+void format_cipher_message(void) {
+    int result;
+    char *buf = NULL;
+
+    result = px_fmtcipher("ABCDEFGHIJ", PXO_RAW, &buf);
+    CU_ASSERT_EQUAL(result, 13);
+    CU_ASSERT_STRING_EQUAL(buf, "ABCDE FGHIJ \n");
+    if (buf) free(buf);
+
+    result = px_fmtcipher("ABCDE", 0, &buf);
+    CU_ASSERT_STRING_EQUAL(buf,
+        "\n\n-----BEGIN PONTIFEX MESSAGE-----\n\n"
+        "ABCDE \n"
+        "\n-----END PONTIFEX MESSAGE-----\n\n");
+    CU_ASSERT_EQUAL(result, strlen(buf));
+    if (buf) free(buf);
+}
+
+#define KEYBEG "-----BEGIN PONTIFEX KEY-----\n"
+#define KEYEND "-----END PONTIFEX KEY-----\n"
+#define KEY01 \
+    "010203040506070809101112131415161718192021222324252627" \
+    "282930313233343536373839404142434445464748495051525354\n"
+
+void read_many_keys(void) {
+    struct px_keyent *keys = NULL;
+    const char *text =
+        "noise - and more noise\n"
+        KEYBEG KEY01 KEYEND
+        KEYBEG "Key-Id: second\n"
+        "54 53 52 51 50 49 48 47 46 45 44 43 42 41 40 39 38 37\n"
+        "36 35 34 33 32 31 30 29 28 27 26 25 24 23 22 21 20 19\n"
+        "18 17 16 15 14 13 12 11 10 09 08 07 06 05 04 03 02 01\n"
+        KEYEND;
+    int result;
+
+    result = px_rdkeys(text, strlen(text), &keys);
+    CU_ASSERT_EQUAL(result, 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(keys);
+    CU_ASSERT_STRING_EQUAL(keys[0].id, "");
+    CU_ASSERT_EQUAL(keys[0].deck[0], 1);
+    CU_ASSERT_EQUAL(keys[0].deck[53], 54);
+    CU_ASSERT_STRING_EQUAL(keys[1].id, "second");
+    CU_ASSERT_EQUAL(keys[1].deck[0], 54);
+    CU_ASSERT_EQUAL(keys[1].deck[53], 1);
+    free(keys);
+
+    result = px_rdkeys("no keys here", 12, &keys);
+    CU_ASSERT_EQUAL(result, 0);
+    CU_ASSERT_PTR_NULL(keys);
+}
+
+void read_many_keys_invalid(void) {
+    struct px_keyent *keys = NULL;
+    const char *texts[] = {
+        /* card 01 twice */
+        KEYBEG "01" KEY01 KEYEND,
+        /* card 55 */
+        KEYBEG
+        "550203040506070809101112131415161718192021222324252627"
+        "282930313233343536373839404142434445464748495051525354\n"
+        KEYEND,
+        /* card 00 instead of 01 */
+        KEYBEG
+        "000203040506070809101112131415161718192021222324252627"
+        "282930313233343536373839404142434445464748495051525354\n"
+        KEYEND,
+        /* split card number */
+        KEYBEG
+        "0 10203040506070809101112131415161718192021222324252627"
+        "282930313233343536373839404142434445464748495051525354\n"
+        KEYEND,
+        /* one card missing */
+        KEYBEG "0102" KEYEND,
+        /* no end */
+        KEYBEG KEY01,
+        /* other characters */
+        KEYBEG "Key: x\n" KEY01 KEYEND
+    };
+    int i;
+
+    for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        CU_ASSERT_EQUAL(px_rdkeys(texts[i], strlen(texts[i]), &keys), -1);
+        CU_ASSERT_PTR_NULL(keys);
+    }
+}
+
+#undef KEYBEG
+#undef KEYEND
+#undef KEY01
+
+void card_values_roundtrip(void) {
+    char text[] = "AMZ";
+    const char bad[] = { 1, 27 };
+    char *buf = NULL;
+
+    CU_ASSERT_EQUAL(px_tocards(text), 3);
+    CU_ASSERT_EQUAL(text[0], 1);
+    CU_ASSERT_EQUAL(text[1], 13);
+    CU_ASSERT_EQUAL(text[2], 26);
+    CU_ASSERT_EQUAL(text[3], 0);
+
+    CU_ASSERT_EQUAL(px_rdcards(text, 3, &buf), 4);
+    CU_ASSERT_STRING_EQUAL(buf, "AMZ");
+    free(buf);
+    buf = NULL;
+
+    CU_ASSERT_EQUAL(px_rdcards(bad, 2, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    CU_ASSERT_EQUAL(px_rdcards(text, 4, &buf), -1); /* 0 */
+    CU_ASSERT_PTR_NULL(buf);
+}
+
+void packed_letters_roundtrip(void) {
+    const char *text = "ABCDEFGHIJKLMNOPQRSTUVWXYZZYXWVU";
+    char letters[33], *packed = NULL, *buf = NULL;
+    int n;
+
+    /* Every length up to 4 full groups of 8. */
+    for (n = 0; n <= 32; n++) {
+        memcpy(letters, text, n);
+        letters[n] = '\0';
+        CU_ASSERT_EQUAL(px_pack(letters, &packed), 8 + (n * 5 + 7) / 8);
+        CU_ASSERT_EQUAL(
+            px_unpack(packed, 8 + (n * 5 + 7) / 8, &buf), n + 1);
+        CU_ASSERT_STRING_EQUAL(buf, letters);
+        free(packed);
+        free(buf);
+    }
+
+    /* A = 00000, B = 00001, Z = 11001 */
+    CU_ASSERT_EQUAL(px_pack("BZA", &packed), 10);
+    CU_ASSERT_EQUAL(memcmp(packed, "PX5\1\0\0\0\3", 8), 0);
+    CU_ASSERT_EQUAL((unsigned char)packed[8], 0x0e);
+    CU_ASSERT_EQUAL((unsigned char)packed[9], 0x40);
+    free(packed);
+}
+
+void packed_letters_invalid(void) {
+    char *buf = NULL;
+
+    /* wrong magic */
+    CU_ASSERT_EQUAL(px_unpack("PX6\1\0\0\0\1\0", 9, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    /* truncated header and data */
+    CU_ASSERT_EQUAL(px_unpack("PX5\1\0\0", 6, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    CU_ASSERT_EQUAL(px_unpack("PX5\1\0\0\0\2\0", 9, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    /* value 31 is no letter */
+    CU_ASSERT_EQUAL(px_unpack("PX5\1\0\0\0\1\370", 9, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+}
+
+void binary_transcoding_roundtrip(void) {
+    char data[256], *letters = NULL, *buf = NULL;
+    int i, n;
+
+    for (i = 0; i < 256; i++) data[i] = 255 - i;
+
+    /* Every rest of a group, and all byte values. */
+    for (n = 0; n <= 9; n++) {
+        CU_ASSERT_EQUAL(px_b26enc(data, n, &letters),
+            7 + n / 4 * 7 + (n % 4) * 2 + 1);
+        CU_ASSERT_EQUAL(px_b26dec(letters, strlen(letters), &buf), n);
+        CU_ASSERT_EQUAL(memcmp(buf, data, n), 0);
+        free(letters);
+        free(buf);
+    }
+    CU_ASSERT_EQUAL(px_b26enc(data, 256, &letters), 7 + 64 * 7 + 1);
+    CU_ASSERT_EQUAL(px_b26dec(letters, strlen(letters), &buf), 256);
+    CU_ASSERT_EQUAL(memcmp(buf, data, 256), 0);
+    free(letters);
+    free(buf);
+
+    /* length 2, then 0xffff = 3 * 26^3 + 18 * 26^2 + 24 * 26 + 15 */
+    CU_ASSERT_EQUAL(px_b26enc("\377\377", 2, &letters), 12);
+    CU_ASSERT_STRING_EQUAL(letters, "AAAAAACDSYP");
+    free(letters);
+
+    /* padding is ignored */
+    CU_ASSERT_EQUAL(px_b26dec("AAAAAACDSYPXXXX", 15, &buf), 2);
+    CU_ASSERT_EQUAL(memcmp(buf, "\377\377", 2), 0);
+    free(buf);
+}
+
+void binary_transcoding_invalid(void) {
+    char *buf = NULL;
+
+    /* too short */
+    CU_ASSERT_EQUAL(px_b26dec("AAAAAAC", 7, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    /* 0x10000 in 2 bytes */
+    CU_ASSERT_EQUAL(px_b26dec("AAAAAACDSYQ", 11, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    /* length above 2^32 - 1 */
+    CU_ASSERT_EQUAL(px_b26dec("ZZZZZZZ", 7, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+    /* no letter */
+    CU_ASSERT_EQUAL(px_b26dec("AAAAAAB4A", 9, &buf), -1);
+    CU_ASSERT_PTR_NULL(buf);
+}
+
 /* ========================================================= */
 
 static int initsuite_px_io(void) {
@@ -237,6 +557,10 @@ int addsuite_px_io(void) {
         suite,
         "Read key with invalid characters",
         read_key_with_invalid_characters);
+    CU_add_test(
+        suite,
+        "Read key of another deck size",
+        read_deck_of_other_size);
 
     CU_add_test(
         suite,
@@ -262,6 +586,50 @@ int addsuite_px_io(void) {
         suite,
         "Read empty cipher message",
         read_empty_cipher_message);
+    CU_add_test(
+        suite,
+        "Scan multiple cipher messages from noise",
+        scan_multiple_cipher_messages);
+    CU_add_test(
+        suite,
+        "Scan many cipher messages",
+        scan_many_cipher_messages);
+    CU_add_test(
+        suite,
+        "Format cipher message",
+        format_cipher_message);
+    CU_add_test(
+        suite,
+        "Read many keys",
+        read_many_keys);
+    CU_add_test(
+        suite,
+        "Read many keys with invalid blocks",
+        read_many_keys_invalid);
+    CU_add_test(
+        suite,
+        "Convert letters to card values and back",
+        card_values_roundtrip);
+    CU_add_test(
+        suite,
+        "Pack letters to 5 bits and back",
+        packed_letters_roundtrip);
+    CU_add_test(
+        suite,
+        "Unpack invalid packed letters",
+        packed_letters_invalid);
+    CU_add_test(
+        suite,
+        "Segment length header of framed messages",
+        segment_length_header);
+    CU_add_test(
+        suite,
+        "Transcode bytes to letters and back",
+        binary_transcoding_roundtrip);
+    CU_add_test(
+        suite,
+        "Transcode invalid letters to bytes",
+        binary_transcoding_invalid);
 
     return 0;
 }
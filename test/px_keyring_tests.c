@@ -0,0 +1,219 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_keyring_tests.h"
+#include "../src/px_keyring.h"
+
+#define KRPATH "keyring_test.tmp"
+
+/* 01 02 ... 54 */
+#define SORTED \
+    "010203040506070809101112131415161718192021222324252627" \
+    "282930313233343536373839404142434445464748495051525354\n"
+
+/* 54 53 ... 01 */
+#define REVERSED \
+    "545352515049484746454443424140393837363534333231302928" \
+    "272625242322212019181716151413121110090807060504030201\n"
+
+/* concatenated by the test */
+static const char *keys[] = {
+    "Some text before the keys.\n"
+    "-----BEGIN PONTIFEX KEY-----\n"
+    "Key-Id: zulu\n"
+    SORTED
+    "-----END PONTIFEX KEY-----\n",
+
+    "-----BEGIN PONTIFEX KEY-----\r\n"
+    "Key-Id:   alpha  \r\n"
+    REVERSED
+    "-----END PONTIFEX KEY-----\r\n",
+
+    "-----BEGIN PONTIFEX KEY-----\n"
+    "Key-Id: mike\n"
+    "01020304050607080910111213141516171819202122232425262728\n"
+    "   29303132333435363738394041424344454647484950515253 54\n"
+    "-----END PONTIFEX KEY-----\n"
+};
+
+/* Builds a keyring from text and opens it. */
+static int build(const char *text, struct px_keyring *kr) {
+    FILE *f;
+    int n;
+
+    f = fopen(KRPATH, "wb");
+    if (!f) return -2;
+    n = px_krbuild(text, strlen(text), f);
+    fclose(f);
+
+    if (n >= 0 && px_kropen(KRPATH, kr)) return -2;
+    return n;
+}
+
+static void keyring_lookup(void) {
+    struct px_keyring kr;
+    const card *key;
+    char text[1024], ids[2 * PX_KRIDLEN];
+    FILE *f;
+
+    strcpy(text, keys[0]);
+    strcat(text, keys[1]);
+    strcat(text, keys[2]);
+
+    CU_ASSERT_EQUAL(build(text, &kr), 3);
+    CU_ASSERT_EQUAL(kr.n, 3);
+
+    key = px_krfind(&kr, "alpha");
+    CU_ASSERT_PTR_NOT_NULL(key);
+    if (key) CU_ASSERT(key[0] == 54 && key[53] == 1);
+
+    key = px_krfind(&kr, "mike");
+    CU_ASSERT_PTR_NOT_NULL(key);
+    if (key) CU_ASSERT(key[0] == 1 && key[53] == 54);
+
+    CU_ASSERT_PTR_NOT_NULL(px_krfind(&kr, "zulu"));
+    CU_ASSERT_PTR_NULL(px_krfind(&kr, "mik"));
+    CU_ASSERT_PTR_NULL(px_krfind(&kr, "november"));
+    CU_ASSERT_PTR_NULL(px_krfind(&kr, ""));
+
+    px_krclose(&kr);
+
+    /* swap the first two IDs: the keyring opens, the lookups fail */
+    f = fopen(KRPATH, "r+b");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fseek(f, 16, SEEK_SET);
+    fread(ids, 1, sizeof(ids), f);
+    fseek(f, 16, SEEK_SET);
+    fwrite(ids + PX_KRIDLEN, 1, PX_KRIDLEN, f);
+    fwrite(ids, 1, PX_KRIDLEN, f);
+    fclose(f);
+
+    CU_ASSERT_EQUAL_FATAL(px_kropen(KRPATH, &kr), 0);
+    CU_ASSERT_PTR_NULL(px_krfind(&kr, "alpha"));
+    CU_ASSERT_PTR_NULL(px_krfind(&kr, "mike"));
+    px_krclose(&kr);
+}
+
+static void keyring_many_keys(void) {
+    struct px_keyring kr;
+    char *text, id[16];
+    int i, n = 0, found = 0;
+
+    text = malloc(1000 * 200);
+    if (!text) return;
+
+    for (i = 999; i >= 0; i--) {
+        n += sprintf(
+            text + n,
+            "-----BEGIN PONTIFEX KEY-----\n"
+            "Key-Id: tenant-%i\n%s"
+            "-----END PONTIFEX KEY-----\n",
+            i, i % 2 ? SORTED : REVERSED);
+    }
+
+    CU_ASSERT_EQUAL(build(text, &kr), 1000);
+    for (i = 0; i < 1000; i++) {
+        sprintf(id, "tenant-%i", i);
+        if (px_krfind(&kr, id)) found++;
+    }
+    CU_ASSERT_EQUAL(found, 1000);
+
+    px_krclose(&kr);
+    free(text);
+}
+
+static void keyring_invalid_keys(void) {
+    struct px_keyring kr;
+
+    /* duplicate ID */
+    CU_ASSERT_EQUAL(build(
+        "-----BEGIN PONTIFEX KEY-----\nKey-Id: a\n" SORTED
+        "-----END PONTIFEX KEY-----\n"
+        "-----BEGIN PONTIFEX KEY-----\nKey-Id: a\n" REVERSED
+        "-----END PONTIFEX KEY-----\n", &kr), -1);
+
+    /* missing ID */
+    CU_ASSERT_EQUAL(build(
+        "-----BEGIN PONTIFEX KEY-----\n" SORTED
+        "-----END PONTIFEX KEY-----\n", &kr), -1);
+
+    /* card 01 twice, card 02 missing */
+    CU_ASSERT_EQUAL(build(
+        "-----BEGIN PONTIFEX KEY-----\nKey-Id: a\n"
+        "010103040506070809101112131415161718192021222324252627"
+        "282930313233343536373839404142434445464748495051525354\n"
+        "-----END PONTIFEX KEY-----\n", &kr), -1);
+
+    /* too short */
+    CU_ASSERT_EQUAL(build(
+        "-----BEGIN PONTIFEX KEY-----\nKey-Id: a\n0102\n"
+        "-----END PONTIFEX KEY-----\n", &kr), -1);
+
+    /* unterminated */
+    CU_ASSERT_EQUAL(build(
+        "-----BEGIN PONTIFEX KEY-----\nKey-Id: a\n" SORTED, &kr), -1);
+
+    /* not a keyring */
+    CU_ASSERT_EQUAL(px_kropen("keyring_test_missing.tmp", &kr), -1);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_keyring(void) {
+    return 0;
+}
+
+static int cleansuite_px_keyring(void) {
+    remove(KRPATH);
+    return 0;
+}
+
+int addsuite_px_keyring(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex keyring tests",
+        initsuite_px_keyring, cleansuite_px_keyring);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Keyring: convert and look up keys",
+        keyring_lookup);
+    CU_add_test(
+        suite,
+        "Keyring: many keys",
+        keyring_many_keys);
+    CU_add_test(
+        suite,
+        "Keyring: invalid keys are rejected",
+        keyring_invalid_keys);
+
+    return 0;
+}
+
+#undef KRPATH
+#undef SORTED
+#undef REVERSED
@@ -0,0 +1,203 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_ngram_tests.h"
+#include "../src/px_crypto.h"
+#include "../src/px_ngram.h"
+
+#define QUADPATH "quadgrams_test.tmp"
+#define DICTPATH "rankdict_test.tmp"
+
+/* 300 words, "cryptonomicon" at line 123 */
+#define NWORDS 300
+#define MATCH 123
+
+static const char english[] =
+    "It was the best of times, it was the worst of times, it was the age"
+    " of wisdom, it was the age of foolishness, it was the epoch of"
+    " belief, it was the epoch of incredulity, it was the season of Light,"
+    " it was the season of Darkness, it was the spring of hope, it was the"
+    " winter of despair, we had everything before us, we had nothing"
+    " before us, we were all going direct to Heaven, we were all going"
+    " direct the other way.";
+
+/*
+ * Writes the quadgram counts of the english text.
+ */
+static int mkquads(void) {
+    static unsigned short counts[PX_NQUADS];
+    const char *p;
+    FILE *f;
+    long idx = 0, i;
+    int k = 0;
+
+    memset(counts, 0, sizeof(counts));
+    for (p = english; *p; p++) {
+        if (!isalpha(*p)) continue;
+        idx = idx % 17576 * 26 + toupper(*p) - 'A';
+        if (++k >= 4) counts[idx]++;
+    }
+
+    f = fopen(QUADPATH, "w");
+    if (!f) return -1;
+    for (i = 0; i < PX_NQUADS; i++) {
+        if (!counts[i]) continue;
+        fprintf(f, "%c%c%c%c %u\n",
+            (int)('A' + i / 17576), (int)('A' + i / 676 % 26),
+            (int)('A' + i / 26 % 26), (int)('A' + i % 26), counts[i]);
+    }
+    return fclose(f) ? -1 : 0;
+}
+
+static int mkdict(void) {
+    FILE *f;
+    int i;
+
+    f = fopen(DICTPATH, "w");
+    if (!f) return -1;
+
+    for (i = 0; i < NWORDS; i++) {
+        if (i == MATCH) fputs("cryptonomicon\r\n", f);
+        else fprintf(f, "word%c%c%i\n", 'a' + i % 26, 'z' - i % 7, i);
+    }
+
+    return fclose(f) ? -1 : 0;
+}
+
+static void quadgrams_score_english(void) {
+    struct px_ngrams ng;
+    const char *good = "it was the age of wisdom",
+               *bad = "qx zvj kwp fgu yb mzhoqd";
+    FILE *f;
+
+    CU_ASSERT_EQUAL_FATAL(mkquads(), 0);
+    CU_ASSERT_EQUAL_FATAL(px_ngload(QUADPATH, &ng), 0);
+    CU_ASSERT(ng.nquads > 100);
+    CU_ASSERT(px_ngscore(&ng, good, strlen(good))
+        > px_ngscore(&ng, bad, strlen(bad)));
+    CU_ASSERT(px_ngscore(&ng, bad, strlen(bad)) < 0);
+    CU_ASSERT_EQUAL(px_ngscore(&ng, "the", 3), 0);
+    px_ngfree(&ng);
+
+    CU_ASSERT_EQUAL(px_ngload("noquads_test.tmp", &ng), -1);
+
+    f = fopen(QUADPATH, "w");
+    fputs("TION 100\nTH3N 5\n", f);
+    fclose(f);
+    CU_ASSERT_EQUAL(px_ngload(QUADPATH, &ng), -1);
+    CU_ASSERT_PTR_NULL(ng.logp);
+}
+
+static void dictionary_ranked(void) {
+    const char *pt = "It was the best of times, it was the worst of times";
+    struct px_ngrams ng;
+    struct px_rankres res;
+    struct px_opts opts;
+    card key[54];
+    char *ct = NULL;
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(mkquads(), 0);
+    CU_ASSERT_EQUAL_FATAL(mkdict(), 0);
+    CU_ASSERT_EQUAL_FATAL(px_ngload(QUADPATH, &ng), 0);
+
+    memset(&opts, 0, sizeof(opts));
+    px_keygen("cryptonomicon", 0, key);
+    CU_ASSERT_FATAL(px_encrypt(key, pt, strlen(pt), &ct, &opts) > 0);
+
+    CU_ASSERT_EQUAL_FATAL(
+        px_rankdict(DICTPATH, ct, 0, &ng, 5, 0, 3, &res), 0);
+    CU_ASSERT_EQUAL(res.candidates, NWORDS);
+    CU_ASSERT_EQUAL(res.nbest, 5);
+    CU_ASSERT_STRING_EQUAL(res.best[0].password, "cryptonomicon");
+    CU_ASSERT_EQUAL(res.best[0].index, MATCH);
+    for (i = 1; i < res.nbest; i++) {
+        CU_ASSERT(res.best[i - 1].score >= res.best[i].score);
+    }
+    px_rankfree(&res);
+
+    /* the same ranking from the first 20 letters, on one thread */
+    CU_ASSERT_EQUAL_FATAL(
+        px_rankdict(DICTPATH, ct, 20, &ng, NWORDS + 1, 0, 1, &res), 0);
+    CU_ASSERT_EQUAL(res.nbest, NWORDS);
+    CU_ASSERT_EQUAL(res.best[0].index, MATCH);
+    px_rankfree(&res);
+
+    CU_ASSERT_EQUAL(
+        px_rankdict(DICTPATH, "ABC", 0, &ng, 5, 0, 1, &res), -1);
+    CU_ASSERT_EQUAL(
+        px_rankdict("nodict_test.tmp", ct, 0, &ng, 5, 0, 1, &res), -1);
+    px_free(ct);
+    ct = NULL;
+
+    /* a key with moved jokers */
+    px_keygen("cryptonomicon", 1, key);
+    CU_ASSERT_FATAL(px_encrypt(key, pt, strlen(pt), &ct, &opts) > 0);
+    CU_ASSERT_EQUAL_FATAL(
+        px_rankdict(DICTPATH, ct, 0, &ng, 5, 1, 3, &res), 0);
+    CU_ASSERT_EQUAL(res.best[0].index, MATCH);
+    px_rankfree(&res);
+
+    px_ngfree(&ng);
+    px_free(ct);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_ngram(void) {
+    return 0;
+}
+
+static int cleansuite_px_ngram(void) {
+    remove(QUADPATH);
+    remove(DICTPATH);
+    return 0;
+}
+
+int addsuite_px_ngram(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex quadgram ranking tests",
+        initsuite_px_ngram, cleansuite_px_ngram);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Quadgrams: English scores higher",
+        quadgrams_score_english);
+    CU_add_test(
+        suite,
+        "Quadgrams: dictionary ranked by the plain text",
+        dictionary_ranked);
+
+    return 0;
+}
+
+#undef QUADPATH
+#undef DICTPATH
+#undef NWORDS
+#undef MATCH
@@ -0,0 +1,81 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_par_tests.h"
+#include "../src/px_par.h"
+
+static void square(void *ctx, int i) {
+    ((int *)ctx)[i] = i * i;
+}
+
+void pfor_runs_every_job_once(void) {
+    int results[1000];
+    int i, n;
+
+    for (n = 1; n <= 4; n++) {
+        memset(results, -1, sizeof(results));
+
+        CU_ASSERT_EQUAL(px_pfor(1000, n, square, results), 0);
+
+        for (i = 0; i < 1000; i++) {
+            if (results[i] != i * i) break;
+        }
+        CU_ASSERT_EQUAL(i, 1000);
+    }
+}
+
+void pfor_without_jobs(void) {
+    CU_ASSERT_EQUAL(px_pfor(0, 4, square, NULL), 0);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_par(void) {
+    return 0;
+}
+
+static int cleansuite_px_par(void) {
+    return 0;
+}
+
+int addsuite_px_par(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex multithreading helper tests",
+        initsuite_px_par, cleansuite_px_par);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Parallel for: runs every job once",
+        pfor_runs_every_job_once);
+    CU_add_test(
+        suite,
+        "Parallel for: no jobs",
+        pfor_without_jobs);
+
+    return 0;
+}
+
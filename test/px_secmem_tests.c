@@ -0,0 +1,134 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_secmem_tests.h"
+#include "../src/px_common.h"
+#include "../src/px_crypto.h"
+#include "../src/px_secmem.h"
+
+void smget_without_arena(void) {
+    CU_ASSERT_PTR_NULL(px_smget());
+}
+
+void smget_until_exhausted(void) {
+    unsigned char *a, *b, *c;
+
+    CU_ASSERT_EQUAL_FATAL(px_sminit(2), 0);
+
+    a = px_smget();
+    b = px_smget();
+    c = px_smget();
+    CU_ASSERT_PTR_NOT_NULL(a);
+    CU_ASSERT_PTR_NOT_NULL(b);
+    CU_ASSERT_PTR_NULL(c);
+    CU_ASSERT(a != b);
+
+    /* slots are usable and come back */
+    memset(a, 0xff, PX_SMSLOT);
+    memset(b, 0xff, PX_SMSLOT);
+    px_smput(a);
+    c = px_smget();
+    CU_ASSERT_PTR_EQUAL(c, a);
+
+    px_smput(b);
+    px_smput(c);
+    px_smdone();
+
+    CU_ASSERT_PTR_NULL(px_smget());
+}
+
+void returned_slots_are_reused_unwiped(void) {
+    unsigned char *a;
+
+    CU_ASSERT_EQUAL_FATAL(px_sminit(1), 0);
+
+    a = px_smget();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(a);
+    a[0] = 42;
+    px_smput(a);
+
+    /* no per-use wiping, only on teardown */
+    a = px_smget();
+    CU_ASSERT_EQUAL(a[0], 42);
+    px_smput(a);
+
+    px_smdone();
+}
+
+void encrypt_with_arena(void) {
+    struct px_opts opts = { 1 };
+    char *buf = NULL;
+    card key[54];
+    int result;
+
+    CU_ASSERT_EQUAL_FATAL(px_sminit(4), 0);
+
+    px_keygen("cryptonomicon", 0, key);
+    result = px_encrypt(key, "SOLITAIRE", 9, &buf, &opts);
+    CU_ASSERT_EQUAL(result, 11);
+    CU_ASSERT_STRING_EQUAL(buf, "KIRAKSFJAN");
+    if (buf) free(buf);
+
+    px_smdone();
+}
+
+/* ========================================================= */
+
+static int initsuite_px_secmem(void) {
+    return 0;
+}
+
+static int cleansuite_px_secmem(void) {
+    px_smdone();
+    return 0;
+}
+
+int addsuite_px_secmem(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex secure memory tests",
+        initsuite_px_secmem, cleansuite_px_secmem);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Secure memory: no slots without arena",
+        smget_without_arena);
+    CU_add_test(
+        suite,
+        "Secure memory: take slots until exhausted",
+        smget_until_exhausted);
+    CU_add_test(
+        suite,
+        "Secure memory: slots are wiped on teardown only",
+        returned_slots_are_reused_unwiped);
+    CU_add_test(
+        suite,
+        "Secure memory: encryption with the arena",
+        encrypt_with_arena);
+
+    return 0;
+}
+
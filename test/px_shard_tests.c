@@ -0,0 +1,238 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <CUnit/CUnit.h>
+#include "./px_shard_tests.h"
+#include "../src/px_attack.h"
+#include "../src/px_crypto.h"
+#include "../src/px_shard.h"
+
+#define JOBDIR "shardjob_test.tmp"
+#define JOBDIR2 "shardjob2_test.tmp"
+#define DICTPATH "sharddict_test.tmp"
+
+/* 20000 words in shards of 9000, 9000 and 2000 */
+#define NWORDS 20000
+#define SHARDSIZE 9000
+
+/*
+ * Writes a dictionary with "cryptonomicon" at 1234, 9500 and the last
+ * line, each written differently.
+ */
+static int mkdict(void) {
+    FILE *f;
+    int i;
+
+    f = fopen(DICTPATH, "w");
+    if (!f) return -1;
+
+    for (i = 0; i < NWORDS; i++) {
+        if (i == 1234) {
+            fputs("cryptonomicon\n", f);
+        } else if (i == 9500) {
+            fputs("Crypto-Nomicon\r\n", f);
+        } else if (i == NWORDS - 1) {
+            fputs("CRYPTONOMICON", f); /* no line break */
+        } else {
+            fprintf(f, "w%05i\n", i);
+        }
+    }
+
+    return fclose(f) ? -1 : 0;
+}
+
+static void jobdir_resumes_shards(void) {
+    struct px_jobstat st;
+    card *expect = NULL;
+    char found[256];
+    FILE *out;
+    int fd, pipefd[2];
+    struct flock fl;
+    pid_t child;
+    char c;
+    int n;
+
+    CU_ASSERT_EQUAL_FATAL(mkdict(), 0);
+    n = px_crib("solitaire x", "KIRAK SFJAN", &expect);
+    CU_ASSERT_EQUAL(
+        px_jobcreate(JOBDIR, DICTPATH, expect, n, 0, SHARDSIZE), 3);
+    CU_ASSERT_EQUAL(
+        px_jobcreate(JOBDIR, DICTPATH, expect, n, 0, SHARDSIZE), -1);
+    px_free(expect);
+
+    /* A worker that stops after two checkpoints in the first shard */
+    CU_ASSERT_EQUAL(px_jobwork(JOBDIR, 2, 5000, NULL), 2 * PX_SHCHUNK);
+    CU_ASSERT_EQUAL(px_jobstatus(JOBDIR, &st, NULL), 0);
+    CU_ASSERT_EQUAL(st.nwords, NWORDS);
+    CU_ASSERT_EQUAL(st.nshards, 3);
+    CU_ASSERT_EQUAL(st.mvjokers, 0);
+    CU_ASSERT_EQUAL(st.ndone, 0);
+    CU_ASSERT_EQUAL(st.nactive, 0);
+    CU_ASSERT_EQUAL(st.tested, 2 * PX_SHCHUNK);
+    CU_ASSERT_EQUAL(st.nfound, 1);
+
+    /* Another process holds the second shard. */
+    CU_ASSERT_EQUAL_FATAL(pipe(pipefd), 0);
+    child = fork();
+    if (child == 0) {
+        fd = open(JOBDIR "/shard-000001", O_RDWR | O_CREAT, 0644);
+        memset(&fl, 0, sizeof(fl));
+        fl.l_type = F_WRLCK;
+        fl.l_whence = SEEK_SET;
+        c = fd >= 0 && !fcntl(fd, F_SETLK, &fl);
+        if (write(pipefd[1], &c, 1) != 1) _exit(1);
+        pause();
+        _exit(0);
+    }
+    CU_ASSERT_EQUAL(read(pipefd[0], &c, 1), 1);
+    CU_ASSERT_EQUAL(c, 1);
+
+    /* The rest of the first shard, and the third */
+    CU_ASSERT_EQUAL(
+        px_jobwork(JOBDIR, 2, 0, NULL), SHARDSIZE - 2 * PX_SHCHUNK + 2000);
+    CU_ASSERT_EQUAL(px_jobstatus(JOBDIR, &st, NULL), 0);
+    CU_ASSERT_EQUAL(st.ndone, 2);
+    CU_ASSERT_EQUAL(st.nactive, 1);
+
+    /* The holder is killed, so its shard is free again. */
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    CU_ASSERT_EQUAL(px_jobwork(JOBDIR, 0, 0, NULL), SHARDSIZE);
+    CU_ASSERT_EQUAL(px_jobwork(JOBDIR, 0, 0, NULL), 0);
+
+    out = tmpfile();
+    CU_ASSERT_EQUAL(px_jobstatus(JOBDIR, &st, out), 0);
+    CU_ASSERT_EQUAL(st.ndone, 3);
+    CU_ASSERT_EQUAL(st.nactive, 0);
+    CU_ASSERT_EQUAL(st.tested, NWORDS);
+    CU_ASSERT_EQUAL(st.nfound, 3);
+    CU_ASSERT(st.seconds > 0);
+
+    /* ordered by the word index */
+    rewind(out);
+    n = fread(found, 1, sizeof(found) - 1, out);
+    found[n] = '\0';
+    CU_ASSERT_STRING_EQUAL(
+        found, "cryptonomicon\nCrypto-Nomicon\nCRYPTONOMICON\n");
+    fclose(out);
+
+    /* empty lines in the found file are no matches */
+    out = fopen(JOBDIR "/found", "a");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(out);
+    for (n = 0; n < 200; n++) fputc('\n', out);
+    fclose(out);
+    CU_ASSERT_EQUAL(px_jobstatus(JOBDIR, &st, NULL), 0);
+    CU_ASSERT_EQUAL(st.nfound, 3);
+}
+
+static void jobdir_moves_jokers(void) {
+    struct px_jobstat st;
+    struct px_opts opts;
+    card key[54], *expect = NULL;
+    char *ct = NULL;
+    int n;
+
+    CU_ASSERT_EQUAL_FATAL(mkdict(), 0);
+    memset(&opts, 0, sizeof(opts));
+    px_keygen("cryptonomicon", 1, key);
+    CU_ASSERT_FATAL(px_encrypt(key, "SOLITAIREX", 10, &ct, &opts) > 0);
+    n = px_crib("SOLITAIREX", ct, &expect);
+    px_free(ct);
+
+    /* one shard, its keys with moved jokers */
+    CU_ASSERT_EQUAL(
+        px_jobcreate(JOBDIR2, DICTPATH, expect, n, 1, NWORDS), 1);
+    px_free(expect);
+    CU_ASSERT_EQUAL(px_jobwork(JOBDIR2, 2, 0, NULL), NWORDS);
+    CU_ASSERT_EQUAL(px_jobstatus(JOBDIR2, &st, NULL), 0);
+    CU_ASSERT_EQUAL(st.mvjokers, 1);
+    CU_ASSERT_EQUAL(st.nfound, 3);
+}
+
+static void jobdir_missing(void) {
+    struct px_jobstat st;
+
+    CU_ASSERT_EQUAL(px_jobwork("nojob_test.tmp", 1, 0, NULL), -1);
+    CU_ASSERT_EQUAL(px_jobstatus("nojob_test.tmp", &st, NULL), -1);
+}
+
+/* ========================================================= */
+
+static int initsuite_px_shard(void) {
+    return 0;
+}
+
+static int cleansuite_px_shard(void) {
+    remove(JOBDIR "/job");
+    remove(JOBDIR "/found");
+    remove(JOBDIR "/shard-000000");
+    remove(JOBDIR "/shard-000001");
+    remove(JOBDIR "/shard-000002");
+    remove(JOBDIR);
+    remove(JOBDIR2 "/job");
+    remove(JOBDIR2 "/found");
+    remove(JOBDIR2 "/shard-000000");
+    remove(JOBDIR2);
+    remove(DICTPATH);
+    return 0;
+}
+
+int addsuite_px_shard(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex sharded search tests",
+        initsuite_px_shard, cleansuite_px_shard);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Shards: claimed, checkpointed and resumed",
+        jobdir_resumes_shards);
+    CU_add_test(
+        suite,
+        "Shards: keys with moved jokers",
+        jobdir_moves_jokers);
+    CU_add_test(
+        suite,
+        "Shards: missing job directory",
+        jobdir_missing);
+
+    return 0;
+}
+
+#undef JOBDIR
+#undef JOBDIR2
+#undef DICTPATH
+#undef NWORDS
+#undef SHARDSIZE
@@ -0,0 +1,144 @@
+/*
+ *  Implementation of Bruce Schneier's Pontifex/Solitaire cryptosystem.
+ *  Copyright (C) 2021 Turysaz
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include "./px_variant_tests.h"
+#include "../src/px_crypto.h"
+#include "../src/px_variant.h"
+
+static const char *passwords[] = {
+    "CRYPTONOMICON",
+    "foo",
+    "The quick brown fox jumps over the lazy dog, 42 times.",
+    ""
+};
+
+static void std_matches_standard(void) {
+    const struct px_variant *v = px_variant("std");
+    struct px_opts opts;
+    card key[54], vkey[54];
+    char *buf, *vbuf, vks[100];
+    int i, n, vn;
+
+    memset(&opts, 0, sizeof(opts));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(v);
+
+    for (i = 0; i < 4; i++) {
+        px_keygen(passwords[i], 0, key);
+        CU_ASSERT_EQUAL(px_vkeygen(v, passwords[i], vkey), 0);
+        CU_ASSERT_EQUAL(memcmp(key, vkey, 54), 0);
+
+        n = px_encrypt(key, passwords[2], strlen(passwords[2]), &buf, &opts);
+        vn = px_vencrypt(v, vkey, passwords[2], &vbuf);
+        CU_ASSERT_EQUAL(vn, n);
+        CU_ASSERT_STRING_EQUAL(vbuf, buf);
+        free(buf);
+        free(vbuf);
+
+        px_stream(key, 100, &buf, &opts);
+        CU_ASSERT_EQUAL(px_vstream(v, vkey, vks, 100), 0);
+        CU_ASSERT_EQUAL(memcmp(vks, buf, 100), 0);
+        free(buf);
+    }
+}
+
+static void variants_roundtrip(void) {
+    const char *names[] = { "std", "small", "ext" };
+    const char *msg = "Meet me at 10.30, pier 4?";
+    const struct px_variant *v;
+    card key[PX_MAXCARDS];
+    char *ct, *pt;
+    int i, j, n;
+
+    for (i = 0; i < 3; i++) {
+        v = px_variant(names[i]);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(v);
+        CU_ASSERT_EQUAL((v->ncards - 2) % v->nletters, 0);
+        CU_ASSERT_EQUAL(px_vkeygen(v, passwords[2], key), 0);
+
+        n = px_vencrypt(v, key, msg, &ct);
+        CU_ASSERT_FATAL(n > 0);
+        CU_ASSERT_EQUAL((n - 1) % 5, 0);
+        for (j = 0; j < n - 1; j++) {
+            CU_ASSERT_PTR_NOT_NULL(strchr(v->alphabet, ct[j]));
+        }
+
+        CU_ASSERT_EQUAL(px_vdecrypt(v, key, ct, &pt), n);
+        free(ct);
+
+        /* "MEETMEAT..." in the plain alphabets, the digits and marks
+           stay in the extended one */
+        if (v->ncards == 82) {
+            CU_ASSERT_STRING_EQUAL(pt, "MEETMEAT10.30,PIER4?");
+        } else {
+            CU_ASSERT_STRING_EQUAL(pt, "MEETMEATPIERXXX");
+        }
+        free(pt);
+    }
+}
+
+static void variants_invalid(void) {
+    const struct px_variant *v = px_variant("small");
+    card deck[28];
+    char ks[10];
+    int i;
+
+    CU_ASSERT_PTR_NULL(px_variant("huge"));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(v);
+
+    /* no jokers */
+    for (i = 0; i < 28; i++) deck[i] = 1 + i % 26;
+    CU_ASSERT_EQUAL(px_vstream(v, deck, ks, 10), -1);
+}
+
+static int initsuite_px_variant(void) {
+    return 0;
+}
+
+static int cleansuite_px_variant(void) {
+    return 0;
+}
+
+int addsuite_px_variant(void) {
+    CU_pSuite suite;
+    suite = CU_add_suite(
+        "Pontifex deck variant tests",
+        initsuite_px_variant, cleansuite_px_variant);
+
+    if (suite == NULL) {
+        return -1;
+    }
+
+    CU_add_test(
+        suite,
+        "Variant: 54 cards match the standard cipher",
+        std_matches_standard);
+    CU_add_test(
+        suite,
+        "Variant: encrypt and decrypt with every deck",
+        variants_roundtrip);
+    CU_add_test(
+        suite,
+        "Variant: unknown names and invalid decks",
+        variants_invalid);
+
+    return 0;
+}
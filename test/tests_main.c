@@ -19,9 +19,19 @@
 
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
+#include "./px_alloc_tests.h"
+#include "./px_attack_tests.h"
+#include "./px_batch_tests.h"
 #include "./px_crypto_tests.h"
+#include "./px_deck_tests.h"
 #include "./px_io_tests.h"
+#include "./px_keyring_tests.h"
 #include "./px_common_tests.h"
+#include "./px_ngram_tests.h"
+#include "./px_par_tests.h"
+#include "./px_secmem_tests.h"
+#include "./px_shard_tests.h"
+#include "./px_variant_tests.h"
 
 int loglevel = -1;
 
@@ -33,6 +43,16 @@ int main(int argc, char **argv) {
    if (addsuite_px_common() == -1) goto cleanup;
    if (addsuite_px_crypto() == -1) goto cleanup;
    if (addsuite_px_io() == -1) goto cleanup;
+   if (addsuite_px_par() == -1) goto cleanup;
+   if (addsuite_px_batch() == -1) goto cleanup;
+   if (addsuite_px_secmem() == -1) goto cleanup;
+   if (addsuite_px_keyring() == -1) goto cleanup;
+   if (addsuite_px_attack() == -1) goto cleanup;
+   if (addsuite_px_deck() == -1) goto cleanup;
+   if (addsuite_px_variant() == -1) goto cleanup;
+   if (addsuite_px_alloc() == -1) goto cleanup;
+   if (addsuite_px_shard() == -1) goto cleanup;
+   if (addsuite_px_ngram() == -1) goto cleanup;
 
    CU_basic_set_mode(CU_BRM_VERBOSE);
    CU_basic_run_tests();
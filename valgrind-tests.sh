@@ -98,6 +98,26 @@ $testrunner ./enoch -s 20 -k 010203040506070809101112131415161718192021222324252
 $testrunner ./enoch -s 20 -k 01020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849505152535401
 [ $? -eq "-1" ] && fail=1
 
+#====================================================================
+echo_red "Binary output tests"
+# without -q, the password warning must not end up in the output
+pt=$(printf solitaire | ./enoch -p cryptonomicon --format=packed | \
+    $testrunner ./enoch -d -p cryptonomicon --format=packed)
+[ "$pt" == "SOLITAIREX" ] || fail=1
+n=$($testrunner ./enoch -p cryptonomicon -s 10 --format=cards | wc -c)
+[ "$n" -eq 10 ] || fail=1
+n=$($testrunner ./enoch -p cryptonomicon --random=16 | wc -c)
+[ "$n" -eq 16 ] || fail=1
+
+#====================================================================
+echo_red "Deck variant tests"
+pt=$(echo "Meet me at 10.30, ok?" | ./enoch -q --deck=ext -p cryptonomicon | \
+    $testrunner ./enoch -q -d --deck=ext -p cryptonomicon)
+[ "$pt" == "MEETMEAT10.30,OK?XXX" ] || fail=1
+key=$($testrunner ./enoch -q -r --deck=small -p cryptonomicon --gen-key)
+ks=$($testrunner ./enoch -q --deck=small -k "$key" -s 20)
+[ "$ks" == "$(./enoch -q --deck=small -p cryptonomicon -s 20)" ] || fail=1
+
 echo
 if [[ $fail == "0" ]]; then
     echo -e "\e[32mAll good :)\e[0m"